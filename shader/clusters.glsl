@@ -0,0 +1,37 @@
+// Light lists of the clusters built by LightClusters.
+#pragma once
+
+#include "lights.glsl"
+
+layout (std430, binding = 1) readonly buffer ClusterLights
+{
+    ClusterLight clusterLights[];
+};
+
+// Offset into lightIndices and number of lights of every cluster.
+layout (std430, binding = 2) readonly buffer Clusters
+{
+    uvec2 clusters[];
+};
+
+layout (std430, binding = 3) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+uniform uvec3 uClusterGrid;
+// Tiles per pixel.
+uniform vec2 uClusterTileScale;
+// The slice of view depth d is log(d) * x + y.
+uniform vec2 uClusterDepthScale;
+
+// Offset into lightIndices and number of lights of the cluster containing
+// a fragment.
+uvec2 getClusterLights(vec2 fragCoord, float viewDepth)
+{
+    float slice = max(log(viewDepth) * uClusterDepthScale.x + uClusterDepthScale.y, 0.);
+    uvec3 cluster = min(uvec3(uvec2(fragCoord * uClusterTileScale), uint(slice)),
+                        uClusterGrid - 1u);
+    return clusters[(cluster.z * uClusterGrid.y + cluster.y) * uClusterGrid.x +
+                    cluster.x];
+}
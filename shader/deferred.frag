@@ -0,0 +1,59 @@
+#version 450 core
+
+// Lighting pass of DeferredRenderer, shades the G-buffer written by the
+// GBUFFER variant of main.frag with the same lights as the forward path.
+
+#include "lights.glsl"
+#include "shading.glsl"
+#include "clusters.glsl"
+
+#define MAX_NUM_LIGHTS 16
+
+#ifndef NUM_DIR_LIGHTS
+#define NUM_DIR_LIGHTS 0
+#endif
+
+uniform DirLight uDirLights[MAX_NUM_LIGHTS];
+
+layout (binding = 0) uniform sampler2D uAlbedo;
+layout (binding = 1) uniform sampler2D uNormal;
+layout (binding = 2) uniform sampler2D uSpecular;
+layout (binding = 3) uniform sampler2D uDepth;
+
+uniform mat4 uInverseViewProjection;
+uniform mat4 uViewMatrix;
+uniform vec3 uViewPos;
+
+in vec2 fTexCoord;
+
+layout (location = 0) out vec4 fragColor;
+
+void main()
+{
+    float depth = texture(uDepth, fTexCoord).r;
+    // Nothing was drawn here.
+    if(depth == 1.)
+        discard;
+
+    vec4 position = uInverseViewProjection * vec4(vec3(fTexCoord, depth) * 2. - 1., 1.);
+    vec4 specular = texture(uSpecular, fTexCoord);
+
+    Surface surface;
+    surface.position = position.xyz / position.w;
+    surface.normal = decodeNormal(texture(uNormal, fTexCoord).xy);
+    surface.viewDir = normalize(uViewPos - surface.position);
+    surface.diffuse = texture(uAlbedo, fTexCoord).rgb;
+    surface.specular = specular.rgb;
+    surface.shininess = specular.a * MAX_SHININESS;
+
+    vec3 result = vec3(0.);
+    for(uint i = 0; i < uint(NUM_DIR_LIGHTS); i++)
+        result += shadeDirLight(uDirLights[i], surface);
+
+    float viewDepth = -(uViewMatrix * vec4(surface.position, 1.)).z;
+    uvec2 lights = getClusterLights(gl_FragCoord.xy, viewDepth);
+    for(uint i = 0; i < lights.y; i++)
+        result += shadeClusterLight(clusterLights[lightIndices[lights.x + i]], surface);
+
+    fragColor = vec4(result, 1.);
+}
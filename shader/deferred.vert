@@ -0,0 +1,12 @@
+#version 450 core
+
+// A triangle covering the whole screen, drawn without vertex buffers.
+
+out vec2 fTexCoord;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    fTexCoord = position;
+    gl_Position = vec4(position * 2. - 1., 0., 1.);
+}
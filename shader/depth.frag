@@ -0,0 +1,7 @@
+#version 450 core
+
+// Only depth is written, colour writes are masked off.
+
+void main()
+{
+}
@@ -0,0 +1,21 @@
+#version 450 core
+
+// Depth-only pre-pass of meshes in a GeometryHeap, drawn from its position
+// only vertex array. Mirrors the MULTI_DRAW variant of main.vert.
+
+#include "instances.glsl"
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 5) in uint vInstanceIndex;
+
+uniform mat4 uViewProjectionMatrix;
+
+invariant gl_Position;
+
+void main()
+{
+    mat4 modelMatrix = instances[vInstanceIndex].model;
+    mat4 modelViewProjectionMatrix = uViewProjectionMatrix * modelMatrix;
+    vec4 position = vec4(vPosition, 1.);
+    gl_Position = modelViewProjectionMatrix * position;
+}
@@ -0,0 +1,14 @@
+// Per-object data of instanced and multi-draw rendering.
+#pragma once
+
+// Matches InstanceData in InstanceBatcher.hpp.
+struct Instance
+{
+    mat4 model;
+    mat4 normal;
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
@@ -0,0 +1,66 @@
+// Material and light types shared by the lighting shaders.
+#pragma once
+
+struct Material
+{
+    sampler2D diffuse;
+    sampler2D specular; 
+    float shininess;
+};
+
+struct DirLight
+{
+    vec3 direction;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// A point or spot light of LightClusters, matches ClusterLight in
+// LightClusters.hpp.
+struct ClusterLight
+{
+    vec3 position;
+    float range;
+    vec3 direction;
+    float cutOff;
+    vec3 ambient;
+    float outerCutOff;
+    vec3 diffuse;
+    float constant;
+    vec3 specular;
+    float linear;
+    float quadratic;
+    uint isSpot;
+    float pad0;
+    float pad1;
+};
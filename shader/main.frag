@@ -1,60 +1,61 @@
 #version 450 core
 
-struct Material
-{
-    sampler2D diffuse;
-    sampler2D specular; 
-    float shininess;
-};
-
-struct DirLight
-{
-    vec3 direction;
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight
-{
-    vec3 position;
-    float constant;
-    float linear;
-    float quadratic;
+#include "lights.glsl"
+#include "shading.glsl"
+#include "clusters.glsl"
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight
-{
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
+#define MAX_NUM_LIGHTS 16
 
-    float constant;
-    float linear;
-    float quadratic;
+#ifndef CLUSTERED
+#define CLUSTERED 0
+#endif
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-#define MAX_NUM_LIGHTS 16
+// Write the surface to the G-buffer of a DeferredRenderer instead of
+// lighting it.
+#ifndef GBUFFER
+#define GBUFFER 0
+#endif
 
 uniform DirLight uDirLights[MAX_NUM_LIGHTS];
 
+#if CLUSTERED
+// Point and spot lights are read from the clusters built by LightClusters.
+uniform mat4 uViewMatrix;
+#else
 uniform PointLight uPointLights[MAX_NUM_LIGHTS];
 
 uniform SpotLight uSpotLights[MAX_NUM_LIGHTS];
+#endif
 
+// Light counts are compile time constants when a shader variant defines
+// them, otherwise they are read from uniforms.
+#ifdef NUM_DIR_LIGHTS
+#define DIR_LIGHT_COUNT uint(NUM_DIR_LIGHTS)
+#else
 uniform uint uNumDirLights;
+#define DIR_LIGHT_COUNT uNumDirLights
+#endif
+
+#if !CLUSTERED
+#ifdef NUM_POINT_LIGHTS
+#define POINT_LIGHT_COUNT uint(NUM_POINT_LIGHTS)
+#else
 uniform uint uNumPointLights;
+#define POINT_LIGHT_COUNT uNumPointLights
+#endif
+
+#ifdef NUM_SPOT_LIGHTS
+#define SPOT_LIGHT_COUNT uint(NUM_SPOT_LIGHTS)
+#else
 uniform uint uNumSpotLights;
+#define SPOT_LIGHT_COUNT uNumSpotLights
+#endif
+#endif
+
+// Without a separate specular map the diffuse texture is reused.
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
 
 uniform Material uMaterial;
 
@@ -68,15 +69,38 @@ in vec2 fTexCoord;
 in vec3 fNormal;
 in vec3 fFragPos;
 
+#if GBUFFER
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec4 gSpecular;
+#else
 layout (location = 0) out vec4 fragColor;
+#endif
 
 // Normal vector.
 vec3 normal = normalize(fNormal);
 // Texture color.
 vec4 diffuseColor = texture(uMaterial.diffuse, fTexCoord);
+#if HAS_SPECULAR_MAP
 vec4 specularColor = texture(uMaterial.specular, fTexCoord);
+#else
+vec4 specularColor = diffuseColor;
+#endif
 vec3 viewDir = normalize(uViewPos - fFragPos);
 
+Surface getSurface()
+{
+    Surface surface;
+    surface.position = fFragPos;
+    surface.normal = normal;
+    surface.viewDir = viewDir;
+    surface.diffuse = diffuseColor.rgb;
+    surface.specular = specularColor.rgb;
+    surface.shininess = uMaterial.shininess;
+    return surface;
+}
+
+#if !CLUSTERED
 vec4 doPointLight(PointLight light)
 {
     vec3 lightDir = normalize(light.position - fFragPos);
@@ -98,21 +122,6 @@ vec4 doPointLight(PointLight light)
     return vec4(ambient + diffuse + specular, 1.);
 }
 
-vec4 doDirLight(DirLight light)
-{
-    vec3 lightDir = normalize(-light.direction);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), uMaterial.shininess);
-    // combine results
-    vec3 ambient = light.ambient * diffuseColor.rgb;
-    vec3 diffuse = light.diffuse * diff * diffuseColor.rgb;
-    vec3 specular = light.specular * spec * specularColor.rgb;
-    return vec4(ambient + diffuse + specular, 1.);
-}
-
 vec4 doSpotLight(SpotLight light)
 {
     vec3 lightDir = normalize(light.position - fFragPos);
@@ -138,18 +147,34 @@ vec4 doSpotLight(SpotLight light)
     specular *= attenuation * intensity;
     return vec4(ambient + diffuse + specular, 1.);
 }
+#endif
 
 void main()
 {
+#if GBUFFER
+    gAlbedo = vec4(diffuseColor.rgb, 1.);
+    gNormal = encodeNormal(normal);
+    gSpecular = vec4(specularColor.rgb, uMaterial.shininess / MAX_SHININESS);
+#else
+    Surface surface = getSurface();
     vec4 result = vec4(0., 0., 0., 0.);
-    for(uint i = 0; i < uNumDirLights; i++)
-        result += doDirLight(uDirLights[i]);
-
-    for(uint i = 0; i < uNumPointLights; i++)
+    for(uint i = 0; i < DIR_LIGHT_COUNT; i++)
+        result += vec4(shadeDirLight(uDirLights[i], surface), 1.);
+
+#if CLUSTERED
+    float viewDepth = -(uViewMatrix * vec4(fFragPos, 1.)).z;
+    uvec2 lights = getClusterLights(gl_FragCoord.xy, viewDepth);
+    for(uint i = 0; i < lights.y; i++)
+        result += vec4(shadeClusterLight(clusterLights[lightIndices[lights.x + i]],
+                                         surface), 1.);
+#else
+    for(uint i = 0; i < POINT_LIGHT_COUNT; i++)
         result += doPointLight(uPointLights[i]);
 
-    for(uint i = 0; i < uNumSpotLights; i++)
+    for(uint i = 0; i < SPOT_LIGHT_COUNT; i++)
         result += doSpotLight(uSpotLights[i]);
+#endif
 
     fragColor = result;
+#endif
 }
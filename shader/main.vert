@@ -1,26 +1,88 @@
 #version 450 core
 
+#include "instances.glsl"
+
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec2 vTexCoord;
 layout (location = 2) in vec3 vNormal;
 
+#ifndef SKINNING
+#define SKINNING 0
+#endif
+
+#if SKINNING
+#define MAX_NUM_BONES 64
+layout (location = 3) in uvec4 vBoneIndices;
+layout (location = 4) in vec4 vBoneWeights;
+
+uniform mat4 uBones[MAX_NUM_BONES];
+#endif
+
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+#ifndef MULTI_DRAW
+#define MULTI_DRAW 0
+#endif
+
+#if MULTI_DRAW
+// Fed by an instanced attribute of 0, 1, 2, ..., so it equals the draw
+// command's baseInstance + gl_InstanceID.
+layout (location = 5) in uint vInstanceIndex;
+#endif
+
 uniform mat4 uProjectionMatrix;
 uniform mat4 uViewMatrix;
-uniform mat4 uModelMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uModelViewProjectionMatrix;
-uniform mat3 uNormalMatrix;
+
+#if INSTANCED || MULTI_DRAW
+// Index of the draw's first instance in instances.
+uniform uint uInstanceBase;
+uniform mat4 uViewProjectionMatrix;
+#else
+// Per-object matrices, uploaded together in one call: model, model-view,
+// model-view-projection and the normal matrix (in the upper 3x3).
+uniform mat4 uObjectMatrices[4];
+#endif
 
 out vec2 fTexCoord;
 out vec3 fNormal;
 out vec3 fFragPos;
+// Computed the same way as in depth.vert, so that the depth pre-pass
+// leaves exactly the depths the EQUAL test of this pass expects.
+invariant gl_Position;
 
 void main()
 {
+#if INSTANCED || MULTI_DRAW
+#if MULTI_DRAW
+    Instance instance = instances[vInstanceIndex];
+#else
+    Instance instance = instances[uInstanceBase + uint(gl_InstanceID)];
+#endif
+    mat4 modelMatrix = instance.model;
+    mat3 normalMatrix = mat3(instance.normal);
+    mat4 modelViewProjectionMatrix = uViewProjectionMatrix * modelMatrix;
+#else
+    mat4 modelMatrix = uObjectMatrices[0];
+    mat3 normalMatrix = mat3(uObjectMatrices[3]);
+    mat4 modelViewProjectionMatrix = uObjectMatrices[2];
+#endif
+
+#if SKINNING
+    mat4 skin = uBones[vBoneIndices.x] * vBoneWeights.x +
+        uBones[vBoneIndices.y] * vBoneWeights.y +
+        uBones[vBoneIndices.z] * vBoneWeights.z +
+        uBones[vBoneIndices.w] * vBoneWeights.w;
+    vec4 position = skin * vec4(vPosition, 1.);
+    vec3 normal = mat3(skin) * vNormal;
+#else
     vec4 position = vec4(vPosition, 1.);
+    vec3 normal = vNormal;
+#endif
     fTexCoord = vTexCoord;
-    fNormal = uNormalMatrix * vNormal;
-    fFragPos = vec3(uModelMatrix * position);
+    fNormal = normalMatrix * normal;
+    fFragPos = vec3(modelMatrix * position);
 
-    gl_Position = uModelViewProjectionMatrix * position;
+    gl_Position = modelViewProjectionMatrix * position;
 }
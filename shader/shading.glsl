@@ -0,0 +1,79 @@
+// Lighting shared by the forward and deferred shaders.
+#pragma once
+
+#include "lights.glsl"
+
+// Shininess is stored in the G-buffer divided by this.
+#define MAX_SHININESS 256.
+
+// What the lights need to know about a point being shaded, in world space.
+struct Surface
+{
+    vec3 position;
+    vec3 normal;
+    // Towards the camera.
+    vec3 viewDir;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+vec3 shadeDirLight(DirLight light, Surface surface)
+{
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(surface.normal, lightDir), 0.);
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(surface.viewDir, reflectDir), 0.), surface.shininess);
+
+    vec3 ambient = light.ambient * surface.diffuse;
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+    vec3 specular = light.specular * spec * surface.specular;
+    return ambient + diffuse + specular;
+}
+
+vec3 shadeClusterLight(ClusterLight light, Surface surface)
+{
+    vec3 toLight = light.position - surface.position;
+    float dist = length(toLight);
+    if(dist > light.range)
+        return vec3(0.);
+    vec3 lightDir = toLight / dist;
+
+    float diff = max(dot(surface.normal, lightDir), 0.);
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(surface.viewDir, reflectDir), 0.), surface.shininess);
+
+    float attenuation = 1. / (light.constant + light.linear * dist +
+                              light.quadratic * (dist * dist));
+    if(light.isSpot != 0u)
+    {
+        float theta = dot(lightDir, normalize(-light.direction));
+        float epsilon = light.cutOff - light.outerCutOff;
+        attenuation *= clamp((theta - light.outerCutOff) / epsilon, 0., 1.);
+    }
+
+    vec3 ambient = light.ambient * surface.diffuse;
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+    vec3 specular = light.specular * spec * surface.specular;
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0. ? 1. : -1., v.y >= 0. ? 1. : -1.);
+}
+
+// Octahedral encoding of a unit vector into [-1, 1]^2.
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0. ? n.xy : (1. - abs(n.yx)) * signNotZero(n.xy);
+}
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1. - abs(e.x) - abs(e.y));
+    if(n.z < 0.)
+        n.xy = (1. - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
@@ -0,0 +1,472 @@
+#include "benchmark.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <fmt/core.h>
+
+#include <chrono>
+#include <random>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+
+#include "graphics.hpp"
+#include "gameLayer.hpp"
+#include "renderer/Bvh.hpp"
+#include "renderer/FrustumCuller.hpp"
+#include "renderer/TransformBatch.hpp"
+#include "renderer/FrameCapture.hpp"
+#include "renderer/BufferAllocator.hpp"
+#include "renderer/renderer.hpp"
+#include "jobs.hpp"
+
+using namespace std::literals::string_literals;
+
+namespace
+{
+    using benchClock = std::chrono::steady_clock;
+
+    // Seconds taken by f().
+    template<typename F>
+    double timeIt(F &&f)
+    {
+        auto start = benchClock::now();
+        f();
+        return std::chrono::duration<double>(benchClock::now() - start).count();
+    }
+
+    glm::vec3 randomPoint(std::mt19937 &rng, float size)
+    {
+        std::uniform_real_distribution<float> dist(-size / 2.f, size / 2.f);
+        return glm::vec3(dist(rng), dist(rng), dist(rng));
+    }
+
+    glm::vec3 randomDirection(std::mt19937 &rng)
+    {
+        std::normal_distribution<float> dist;
+        glm::vec3 d(dist(rng), dist(rng), dist(rng));
+        return glm::normalize(d);
+    }
+
+    AABB randomBox(std::mt19937 &rng, float worldSize)
+    {
+        std::uniform_real_distribution<float> size(0.5f, 4.f);
+        auto min = randomPoint(rng, worldSize);
+        return AABB{min, min + glm::vec3(size(rng), size(rng), size(rng))};
+    }
+
+    // Queries against a BVH versus linear scans as the number of objects
+    // grows. Rates are in queries per second.
+    void benchBvh()
+    {
+        constexpr int NUM_FRUSTUMS = 200;
+        constexpr int NUM_RAYS = 20000;
+        constexpr int NUM_OVERLAPS = 20000;
+
+        std::mt19937 rng(1234);
+        fmt::print("{:>8} {:>10} {:>10} {:>7} {:>12} {:>12} {:>12} {:>12} {:>12}\n",
+                   "objects", "insert ms", "build ms", "height", "frustum/s",
+                   "linear/s", "rays/s", "overlaps/s", "moves/s");
+        for(std::size_t count : {1000, 4000, 16000, 64000, 256000})
+        {
+            // Keep the density the same so that every query finds about as
+            // many objects at every size.
+            float worldSize = 10.f * std::cbrt(static_cast<float>(count));
+            std::vector<AABB> boxes(count);
+            for(auto &box : boxes)
+                box = randomBox(rng, worldSize);
+
+            Bvh bvh;
+            std::vector<std::int32_t> proxies(count);
+            double insertTime = timeIt([&]()
+            {
+                for(std::size_t i = 0; i < count; i++)
+                    proxies[i] = bvh.insert(boxes[i], static_cast<std::uint32_t>(i));
+            });
+            double buildTime = timeIt([&]()
+            {
+                bvh.rebuild();
+            });
+
+            // The view distance is fixed, so bigger worlds are not seen all
+            // at once.
+            std::vector<Frustum> frustums(NUM_FRUSTUMS);
+            auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f,
+                                               0.1f, 50.f);
+            for(auto &frustum : frustums)
+            {
+                auto eye = randomPoint(rng, worldSize);
+                auto view = glm::lookAt(eye, eye + randomDirection(rng),
+                                        glm::vec3(0.f, 1.f, 0.f));
+                frustum = Frustum::fromMatrix(projection * view);
+            }
+
+            std::vector<std::uint32_t> result;
+            std::size_t numFound = 0;
+            double frustumTime = timeIt([&]()
+            {
+                for(const auto &frustum : frustums)
+                {
+                    result.clear();
+                    bvh.queryFrustum(frustum, result);
+                    numFound += result.size();
+                }
+            });
+
+            FrustumCuller culler;
+            for(const auto &box : boxes)
+                culler.add(box);
+            std::size_t numLinear = 0;
+            double linearTime = timeIt([&]()
+            {
+                for(const auto &frustum : frustums)
+                {
+                    culler.cull(frustum, result);
+                    numLinear += result.size();
+                }
+            });
+
+            // The queries are made up front so that only the tree is timed.
+            std::vector<std::pair<glm::vec3, glm::vec3>> rays(NUM_RAYS);
+            for(auto &[origin, direction] : rays)
+            {
+                origin = randomPoint(rng, worldSize);
+                direction = randomDirection(rng);
+            }
+            std::vector<AABB> queryBoxes(NUM_OVERLAPS);
+            for(auto &box : queryBoxes)
+                box = randomBox(rng, worldSize);
+
+            std::size_t numHits = 0;
+            double rayTime = timeIt([&]()
+            {
+                for(const auto &[origin, direction] : rays)
+                {
+                    RayHit hit;
+                    numHits += bvh.raycast(origin, direction, hit);
+                }
+            });
+
+            double overlapTime = timeIt([&]()
+            {
+                for(const auto &box : queryBoxes)
+                {
+                    result.clear();
+                    bvh.queryOverlap(box, result);
+                }
+            });
+
+            // Move a tenth of the objects a little, like a frame of a game.
+            std::size_t numMoves = count / 10;
+            std::vector<std::size_t> moved(numMoves);
+            std::uniform_int_distribution<std::size_t> pick(0, count - 1);
+            for(auto &index : moved)
+                index = pick(rng);
+            double moveTime = timeIt([&]()
+            {
+                for(auto index : moved)
+                {
+                    boxes[index].min += glm::vec3(0.5f);
+                    boxes[index].max += glm::vec3(0.5f);
+                    bvh.update(proxies[index], boxes[index]);
+                }
+            });
+
+            fmt::print("{:>8} {:>10.2f} {:>10.2f} {:>7} {:>12.0f} {:>12.0f} {:>12.0f} {:>12.0f} {:>12.0f}\n",
+                       count, insertTime * 1000., buildTime * 1000.,
+                       bvh.getHeight(), NUM_FRUSTUMS / frustumTime,
+                       NUM_FRUSTUMS / linearTime, NUM_RAYS / rayTime,
+                       NUM_OVERLAPS / overlapTime, numMoves / moveTime);
+            // The two can differ by boxes that touch a plane, because of
+            // rounding.
+            fmt::print("{:>8} {:.1f} objects per frustum ({:.1f} linear), "
+                       "{:.1f}% of rays hit\n", "",
+                       static_cast<double>(numFound) / NUM_FRUSTUMS,
+                       static_cast<double>(numLinear) / NUM_FRUSTUMS,
+                       100. * numHits / NUM_RAYS);
+        }
+    }
+
+    // Largest difference between the elements of a and b.
+    float maxDifference(const glm::mat4 &a, const glm::mat4 &b)
+    {
+        float diff = 0.f;
+        for(int c = 0; c < 4; c++)
+            for(int r = 0; r < 4; r++)
+                diff = std::max(diff, std::abs(a[c][r] - b[c][r]));
+        return diff;
+    }
+
+    // Model-view-projection and normal matrices of many objects, with glm
+    // one object at a time versus TransformBatch on one thread and on all
+    // of them. Times are per frame, all objects at once.
+    void benchMatrices()
+    {
+        // Objects computed per measurement, spread over enough frames.
+        constexpr std::size_t NUM_OBJECTS = 4000000;
+
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> angle(0.f, 6.2831853f);
+        std::uniform_real_distribution<float> scale(0.5f, 2.f);
+        auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 500.f);
+        auto view = glm::lookAt(glm::vec3(0.f, 10.f, 50.f), glm::vec3(0.f),
+                                glm::vec3(0.f, 1.f, 0.f));
+        auto viewProjection = projection * view;
+
+        fmt::print("{} kernel, {} threads\n", TransformBatch::getSimdName(),
+                   jobs::getNumThreads());
+        fmt::print("{:>8} {:>12} {:>12} {:>12} {:>9} {:>10}\n", "objects", "glm ms",
+                   "batch ms", "parallel ms", "speedup", "max error");
+        for(std::size_t count : {1000, 10000, 100000})
+        {
+            TransformBatch batch;
+            for(std::size_t i = 0; i < count; i++)
+            {
+                auto model = glm::translate(glm::mat4(1.f), randomPoint(rng, 200.f));
+                model = glm::rotate(model, angle(rng), randomDirection(rng));
+                model = glm::scale(model, glm::vec3(scale(rng), scale(rng), scale(rng)));
+                batch.add(model);
+            }
+
+            // Stand-ins for the frame's instance buffer.
+            std::vector<InstanceData> expectedInstances(count), instances(count);
+            std::vector<glm::mat4> expectedMvps(count), mvps(count);
+            auto frames = std::max<std::size_t>(NUM_OBJECTS / count, 1);
+            double scalarTime = timeIt([&]()
+            {
+                for(std::size_t i = 0; i < frames; i++)
+                    batch.computeScalar(viewProjection, expectedInstances.data(),
+                                        expectedMvps.data());
+            });
+            double batchTime = timeIt([&]()
+            {
+                for(std::size_t i = 0; i < frames; i++)
+                    batch.compute(viewProjection, instances.data(), mvps.data(), false);
+            });
+            double parallelTime = timeIt([&]()
+            {
+                for(std::size_t i = 0; i < frames; i++)
+                    batch.compute(viewProjection, instances.data(), mvps.data());
+            });
+
+            float error = 0.f;
+            for(std::size_t i = 0; i < count; i++)
+            {
+                error = std::max({error, maxDifference(expectedMvps[i], mvps[i]),
+                                  maxDifference(expectedInstances[i].normal,
+                                                instances[i].normal)});
+            }
+            fmt::print("{:>8} {:>12.4f} {:>12.4f} {:>12.4f} {:>8.1f}x {:>10.2e}\n",
+                       count, scalarTime * 1000. / frames, batchTime * 1000. / frames,
+                       parallelTime * 1000. / frames,
+                       scalarTime / std::min(batchTime, parallelTime), error);
+        }
+    }
+
+    // Forward against deferred shading of the game scene, in a window.
+    void benchDeferred()
+    {
+        graph::init("benchmark", 1200, 900);
+        {
+            proj::GameLayer layer;
+            layer.benchmarkRenderPaths();
+        }
+        graph::quit();
+    }
+
+    // Time per frame of the game scene without capturing, reading every
+    // frame back and dropping it, and recording every frame as PNGs.
+    void benchCapture()
+    {
+        constexpr int NUM_FRAMES = 200;
+        graph::init("benchmark", 1200, 900);
+        {
+            proj::GameLayer layer;
+            FrameCapture capture;
+            auto timeFrames = [&](auto &&perFrame)
+            {
+                auto start = benchClock::now();
+                for(int i = 0; i < NUM_FRAMES; i++)
+                {
+                    rndr::clearWindow();
+                    layer.draw(0.);
+                    perFrame();
+                    capture.endFrame();
+                }
+                capture.finish();
+                GLCall(glFinish());
+                return std::chrono::duration<double, std::milli>(
+                    benchClock::now() - start).count() / NUM_FRAMES;
+            };
+
+            double plain = timeFrames([]() {});
+            double readback = timeFrames([&]()
+            {
+                capture.capture([](CapturedImage &&) {});
+            });
+            double recording = timeFrames([&]()
+            {
+                if(!capture.isRecording())
+                    capture.startRecording("capture");
+            });
+            capture.stopRecording();
+            fmt::print("{:>12} {:>12} {:>12} {:>8}\n", "plain ms", "readback ms",
+                       "record ms", "stalls");
+            fmt::print("{:>12.3f} {:>12.3f} {:>12.3f} {:>8}\n", plain, readback,
+                       recording, capture.getStats().stalls);
+        }
+        graph::quit();
+    }
+
+    // Image regression test of the game scene against res/golden/game.png,
+    // which is written instead if it does not exist. Throws if more pixels
+    // differ than allowed.
+    void benchGolden()
+    {
+        constexpr int NUM_FRAMES = 10;
+        // Per channel, for rounding differences between drivers.
+        constexpr int TOLERANCE = 2;
+        const std::filesystem::path goldenPath = "res/golden/game.png";
+
+        graph::init("benchmark", 1200, 900);
+        ImageDifference difference;
+        bool compared = false;
+        bool created = false;
+        {
+            proj::GameLayer layer;
+            FrameCapture capture;
+            // Occlusion culling settles after a few frames.
+            for(int i = 0; i < NUM_FRAMES; i++)
+            {
+                rndr::clearWindow();
+                layer.draw(0.);
+                if(i == NUM_FRAMES - 1)
+                {
+                    capture.capture([&](CapturedImage &&image)
+                    {
+                        if(std::filesystem::exists(goldenPath))
+                        {
+                            difference = compareImages(
+                                image, CapturedImage::loadPng(goldenPath), TOLERANCE);
+                            compared = true;
+                        }
+                        else
+                        {
+                            std::filesystem::create_directories(goldenPath.parent_path());
+                            image.savePng(goldenPath);
+                            created = true;
+                        }
+                    });
+                }
+                capture.endFrame();
+            }
+            capture.finish();
+        }
+        graph::quit();
+
+        if(created)
+        {
+            fmt::print("Wrote {}\n", goldenPath.generic_string());
+            return;
+        }
+        if(!compared)
+            throw std::runtime_error("Could not compare with the golden image");
+        fmt::print("{} pixels differ, by up to {}\n", difference.numDiffering,
+                   difference.maxDifference);
+        if(difference.sizeMismatch)
+            throw std::runtime_error("The golden image is of another size");
+        if(!difference.matches())
+            throw std::runtime_error("The image does not match the golden image");
+    }
+
+    // Allocations of BufferPools, in ones that add blocks and ones that
+    // grow, of ranges larger than a block and larger than the free space
+    // left, and time per allocation and free of random sizes. Throws if a
+    // range is misplaced.
+    void benchPool()
+    {
+        constexpr std::size_t BLOCK_SIZE = 8 << 20;
+        constexpr int NUM_RANGES = 100000;
+        graph::init("benchmark", 1200, 900);
+        {
+            auto check = [](const BufferRange &range, std::size_t size, std::size_t align)
+            {
+                GLint64 bufferSize = 0;
+                GLCall(glGetNamedBufferParameteri64v(range.buffer, GL_BUFFER_SIZE,
+                                                     &bufferSize));
+                if(!range.isValid() || range.size != size || range.offset % align != 0 ||
+                   range.offset + range.size > static_cast<std::size_t>(bufferSize))
+                {
+                    throw std::runtime_error(fmt::format(
+                        "Bad range of {} bytes at {} in a buffer of {}", range.size,
+                        range.offset, bufferSize));
+                }
+            };
+
+            for(bool growable : {false, true})
+            {
+                BufferPool pool(BufferUsage::Static, BLOCK_SIZE, growable);
+                check(pool.allocate(100), 100, BufferPool::MIN_ALIGNMENT);
+                std::size_t large = BLOCK_SIZE + BLOCK_SIZE / 5;
+                check(pool.allocate(large), large, BufferPool::MIN_ALIGNMENT);
+                check(pool.allocate(BLOCK_SIZE, 256), BLOCK_SIZE, 256);
+                if(growable && pool.getStats().blocks != 1)
+                    throw std::runtime_error("A growable pool added a block");
+            }
+
+            std::mt19937 rng(7);
+            std::uniform_int_distribution<std::size_t> size(16, 64 << 10);
+            BufferPool pool(BufferUsage::Static, BLOCK_SIZE);
+            std::vector<BufferRange> ranges(NUM_RANGES);
+            double allocate = timeIt([&]()
+            {
+                for(auto &range : ranges)
+                    range = pool.allocate(size(rng));
+            });
+            std::shuffle(ranges.begin(), ranges.end(), rng);
+            double freeing = timeIt([&]()
+            {
+                for(auto &range : ranges)
+                    pool.free(range);
+            });
+            auto stats = pool.getStats();
+            if(stats.allocations != 0 || stats.freeRanges != stats.blocks)
+                throw std::runtime_error("Freed ranges were not merged back into blocks");
+            fmt::print("{:>10} {:>14} {:>14} {:>8}\n", "ranges", "allocate us", "free us",
+                       "blocks");
+            fmt::print("{:>10} {:>14.3f} {:>14.3f} {:>8}\n", NUM_RANGES,
+                       allocate * 1e6 / NUM_RANGES, freeing * 1e6 / NUM_RANGES,
+                       stats.blocks);
+        }
+        graph::quit();
+    }
+
+    const std::map<std::string, std::function<void()>> benchmarks =
+    {
+        { "bvh", benchBvh },
+        { "capture", benchCapture },
+        { "deferred", benchDeferred },
+        { "golden", benchGolden },
+        { "matrices", benchMatrices },
+        { "pool", benchPool },
+    };
+}
+
+void bench::run(const std::string &name)
+{
+    auto found = benchmarks.find(name);
+    if(found == benchmarks.end())
+    {
+        std::string names;
+        for(const auto &[benchName, f] : benchmarks)
+            names += (names.empty() ? "" : ", ") + benchName;
+        throw std::invalid_argument(fmt::format(
+            "No benchmark named \"{}\", the benchmarks are: {}", name, names));
+    }
+
+    fmt::print("Running benchmark {}\n", name);
+    found->second();
+}
@@ -0,0 +1,16 @@
+/**
+ * @brief Benchmarks of engine subsystems, run with --benchmark=<name>.
+ */
+#ifndef PROJ_BENCHMARK_HPP
+#define PROJ_BENCHMARK_HPP
+
+#include <string>
+
+namespace bench
+{
+    // Run the named benchmark and print its results. Throws
+    // std::invalid_argument if there is no such benchmark.
+    void run(const std::string &name);
+}
+
+#endif /* PROJ_BENCHMARK_HPP */
@@ -135,6 +135,12 @@ void frame::end()
     }
 }
 
+void frame::quit()
+{
+    layers.clear();
+    eventQ.clear();
+}
+
 /* Get current game tick. */
 std::uint64_t frame::getTick()
 {
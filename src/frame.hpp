@@ -71,6 +71,8 @@ namespace frame
     void start();
     /* End the frame. */
     void end();
+    /* Remove every layer, destroying them while the window still exists. */
+    void quit();
     /* Get current game tick. */
     std::uint64_t getTick();
 
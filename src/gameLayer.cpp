@@ -1,6 +1,9 @@
 #include "gameLayer.hpp"
 
 #include <memory>
+#include <random>
+#include <iostream>
+#include <fmt/core.h>
 namespace chron = std::chrono;
 using namespace std::chrono_literals;
 
@@ -8,16 +11,110 @@ using namespace std::chrono_literals;
 #include "graphics.hpp"
 #include "keyboardEvent.hpp"
 #include "renderer/Shader.hpp"
+#include "renderer/ShaderVariants.hpp"
 #include "renderer/Camera.hpp"
+#include "renderer/GeometryHeap.hpp"
+#include "renderer/RenderQueue.hpp"
+#include "renderer/RingBuffer.hpp"
+#include "renderer/FrustumCuller.hpp"
+#include "renderer/Bvh.hpp"
+#include "renderer/OcclusionCuller.hpp"
+#include "renderer/loadobj.hpp"
+#include "renderer/GpuCuller.hpp"
+#include "renderer/LightClusters.hpp"
+#include "renderer/DeferredRenderer.hpp"
+#include "renderer/DepthPrepass.hpp"
+#include "renderer/FrameCapture.hpp"
+#include "renderer/GpuProfiler.hpp"
+#include "renderer/RenderTarget.hpp"
+#include "renderer/renderer.hpp"
 
 namespace
 {
+    // Declared first so that it outlives the things in it.
+    Bvh sceneBvh;
+    std::shared_ptr<ShaderVariants> mainShaders;
     std::shared_ptr<Shader> shaderProgram;
+    // The same variant writing to the G-buffer of deferredRenderer.
+    std::shared_ptr<Shader> gbufferProgram;
     std::shared_ptr<graph::Thing> claire;
     std::shared_ptr<graph::Thing> tyrant;
     std::shared_ptr<graph::Thing> leon;
     std::shared_ptr<graph::Thing> teapot;
+    std::unique_ptr<GeometryHeap> geometry;
+    // Per-frame data of the render queue.
+    std::unique_ptr<RingBuffer> frameData;
+    std::unique_ptr<RenderQueue> renderQueue;
+    std::vector<std::shared_ptr<graph::Thing>> things;
+    std::vector<std::uint32_t> visibleThings;
+    // Things that hide others, with the mesh they are drawn with into the
+    // occlusion buffer.
+    std::vector<std::pair<std::uint32_t, std::shared_ptr<OccluderMesh>>> occluders;
+    // Grid cells along the longest side of an occluder proxy.
+    constexpr int OCCLUDER_CELLS = 24;
+    OcclusionCuller occlusionCuller;
+    std::vector<AABB> thingBounds;
+    bool occlusionCulling = true;
+    // Draws every thing, culled on the GPU, instead of the CPU culling and
+    // the render queue.
+    std::unique_ptr<GpuCuller> gpuCuller;
+    bool gpuCulling = false;
+    LightClusters lightClusters;
+    std::unique_ptr<DeferredRenderer> deferredRenderer;
+    bool deferredShading = false;
+    std::unique_ptr<DepthPrepass> prepass;
+    bool depthPrepass = false;
+    std::unique_ptr<FrameCapture> frameCapture;
+    int numScreenshots = 0;
     Camera camera(glm::vec3(30.f, 30.f, 30.f));
+
+    glm::mat4 getProjection()
+    {
+        return camera.createPerspective(1.f);
+    }
+
+    // Index in things of the closest thing under the window coordinates
+    // x, y, or -1 if there is none.
+    int pickThing(float x, float y)
+    {
+        float ndcX = 2.f * x / rndr::getWindowWidth() - 1.f;
+        float ndcY = 1.f - 2.f * y / rndr::getWindowHeight();
+        RayHit hit;
+        if(!sceneBvh.raycast(camera.getPosition(),
+                             camera.getRayDirection(ndcX, ndcY, getProjection()),
+                             hit))
+            return -1;
+        return static_cast<int>(hit.userData);
+    }
+
+    // Replace the lights with count small coloured lights scattered over
+    // the ground around the models.
+    void setLights(int count)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> position(-60.f, 60.f);
+        std::uniform_real_distribution<float> color(0.2f, 1.f);
+        lightClusters.clearLights();
+        for(int i = 0; i < count; i++)
+        {
+            ClusterLight light;
+            light.position = glm::vec3(position(rng), 2.f, position(rng));
+            light.diffuse = glm::vec3(color(rng), color(rng), color(rng));
+            light.specular = light.diffuse;
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+            lightClusters.addLight(light);
+        }
+    }
+
+    void setDirLight(const Shader &shader)
+    {
+        glm::vec3 lightColor(1.f, 1.f, 1.f);
+        shader.set("uDirLights[0].specular", lightColor * glm::vec3(1.f));
+        shader.set("uDirLights[0].diffuse", lightColor * glm::vec3(1.f));
+        shader.set("uDirLights[0].ambient", lightColor * glm::vec3(0.2f));
+        shader.set("uDirLights[0].direction", -0.2f, -1.f, -0.3f);
+    }
 }
 
 const chron::nanoseconds proj::GameLayer::LOGICAL_FRAME_TIME = 28570000ns;
@@ -27,15 +124,37 @@ proj::GameLayer::GameLayer()
       mMouseMoved(false),mLastMouseX(0.f),mLastMouseY(0.f),mXpos(0.f),
       mYpos(0.f)
 {
-    shaderProgram = std::make_shared<Shader>("shader/main.vert", "shader/main.frag");
+    mainShaders = std::make_shared<ShaderVariants>(
+        std::vector<std::filesystem::path>{"shader/main.vert", "shader/main.frag"});
+    // The scene is lit by a single directional light and every model only
+    // has a diffuse texture.
+    ShaderPermutation permutation;
+    permutation.numDirLights = 1;
+    permutation.multiDraw = true;
+    permutation.clustered = true;
+    // Queue the compile now and let the driver work on it while the models
+    // are read from disk.
+    auto gbufferPermutation = permutation;
+    gbufferPermutation.gbuffer = true;
+    mainShaders->preload(std::vector{permutation, gbufferPermutation});
+    shaderProgram = mainShaders->get(permutation);
+    gbufferProgram = mainShaders->get(gbufferPermutation);
+    deferredRenderer = std::make_unique<DeferredRenderer>(permutation.numDirLights);
+    prepass = std::make_unique<DepthPrepass>();
+    frameCapture = std::make_unique<FrameCapture>();
+    geometry = std::make_unique<GeometryHeap>();
+    frameData = std::make_unique<RingBuffer>();
+    renderQueue = std::make_unique<RenderQueue>(*geometry, *frameData);
     claire = std::make_shared<graph::Thing>("res/claire.obj", "res/claire.bmp",
-                                            shaderProgram);
-    tyrant = std::make_shared<graph::Thing>("res/tyrant.obj", "res/tyrant.png",
+                                            shaderProgram, *geometry);
+    // Read once, the tyrant is drawn as an occluder too.
+    auto tyrantMesh = loadObjFile("res/tyrant.obj");
+    tyrant = std::make_shared<graph::Thing>(geometry->add(tyrantMesh), "res/tyrant.png",
                                             shaderProgram);
     leon = std::make_shared<graph::Thing>("res/leon.obj", "res/leon.png",
-                                          shaderProgram);
+                                          shaderProgram, *geometry);
     teapot = std::make_shared<graph::Thing>("res/teapot.obj", "res/earth.png",
-                                            shaderProgram);
+                                            shaderProgram, *geometry);
 
     teapot->translate(glm::vec3(20.f, 0.f, 10.f));
 
@@ -45,6 +164,50 @@ proj::GameLayer::GameLayer()
 
     leon->translate(glm::vec3(-10.f, 0.f, 20.f));
     leon->rotate(glm::radians(90.f), glm::vec3(0.f, 1.f, 0.f));
+
+    things = {claire, tyrant, leon, teapot};
+    graph::updateTransforms();
+    // Things keep their bounds in the tree up to date as they move.
+    for(std::uint32_t i = 0; i < things.size(); i++)
+        things[i]->attach(sceneBvh, i);
+    sceneBvh.rebuild();
+
+    // Nothing moves, so the culler is never updated.
+    gpuCuller = std::make_unique<GpuCuller>(*geometry);
+    for(const auto &thing : things)
+        thing->submit(*gpuCuller);
+
+    setLights(1024);
+
+    // The tyrant is the only model big enough to hide the others. Its
+    // render mesh is far too detailed to rasterize on the CPU every frame,
+    // so a proxy stands in for it.
+    auto tyrantIndex = std::find(things.begin(), things.end(), tyrant) - things.begin();
+    occluders.emplace_back(static_cast<std::uint32_t>(tyrantIndex),
+                           OccluderMesh::simplify(tyrantMesh, OCCLUDER_CELLS));
+}
+
+proj::GameLayer::~GameLayer()
+{
+    // Pending captures are read back with GL, and the ring buffer unmaps
+    // itself, so they go while the context is current.
+    frameCapture.reset();
+    gpuCuller.reset();
+    prepass.reset();
+    deferredRenderer.reset();
+    renderQueue.reset();
+    frameData.reset();
+    // Things take themselves out of the transform hierarchy, which is gone
+    // by the time the statics of this file are destroyed.
+    things.clear();
+    claire.reset();
+    tyrant.reset();
+    leon.reset();
+    teapot.reset();
+    geometry.reset();
+    shaderProgram.reset();
+    gbufferProgram.reset();
+    mainShaders.reset();
 }
 
 void proj::GameLayer::update()
@@ -71,31 +234,134 @@ void proj::GameLayer::update()
 
 void proj::GameLayer::draw(double alpha)
 {
-    shaderProgram->bind();
-    auto persp = camera.createPerspective(1.f);
-
-    glm::vec3 lightColor(1.f, 1.f, 1.f);
-
-    shaderProgram->set("uViewMatrix", camera.getViewMatrix());
-    shaderProgram->set("uProjectionMatrix", persp);
-    shaderProgram->set("uTextureMatrix", glm::mat4(1.f));
-    shaderProgram->set("uColorMatrix", glm::mat4(1.f));
-    shaderProgram->set("uViewPos", camera.getPosition());
-    shaderProgram->set("uNumDirLights", 1u);
-    shaderProgram->set("uNumPointLights", 0u);
-    shaderProgram->set("uNumSpotLights", 0u);
-    shaderProgram->set("uDirLights[0].specular", lightColor * glm::vec3(1.f));
-    shaderProgram->set("uDirLights[0].diffuse", lightColor * glm::vec3(1.f));
-    shaderProgram->set("uDirLights[0].ambient", lightColor * glm::vec3(0.2f));
-    shaderProgram->set("uDirLights[0].direction", -0.2f, -1.f, -0.3f);
-    shaderProgram->set("uMaterial.diffuse", 0);
-    shaderProgram->set("uMaterial.specular", 0);
-    shaderProgram->set("uMaterial.shininess", 64.f);
-
-    claire->draw(camera.getViewMatrix(), persp);
-    tyrant->draw(camera.getViewMatrix(), persp);
-    leon->draw(camera.getViewMatrix(), persp);
-    teapot->draw(camera.getViewMatrix(), persp);
+    gpuprof::Zone sceneZone("scene");
+    auto persp = getProjection();
+    auto view = camera.getViewMatrix();
+    frameData->beginFrame();
+    graph::updateTransforms();
+
+    for(const auto *shader : {shaderProgram.get(), gbufferProgram.get()})
+    {
+        shader->set("uViewMatrix", view);
+        shader->set("uProjectionMatrix", persp);
+        shader->set("uTextureMatrix", glm::mat4(1.f));
+        shader->set("uColorMatrix", glm::mat4(1.f));
+        shader->set("uViewPos", camera.getPosition());
+        shader->set("uMaterial.diffuse", 0);
+        shader->set("uMaterial.shininess", 64.f);
+    }
+    setDirLight(*shaderProgram);
+    setDirLight(deferredRenderer->getLightingShader());
+
+    lightClusters.setProjection(persp);
+    gpuprof::beginZone("light clusters");
+    lightClusters.update(view);
+    gpuprof::endZone();
+
+    // Deferred shading draws everything into the G-buffer and lights it
+    // afterwards, forward shading lights as it draws.
+    Shader *geometryShader = nullptr;
+    if(deferredShading)
+    {
+        deferredRenderer->beginGeometry();
+        geometryShader = gbufferProgram.get();
+    }
+    auto *geometryPrepass = depthPrepass ? prepass.get() : nullptr;
+
+    if(gpuCulling)
+    {
+        gpuCuller->setOcclusionCulling(occlusionCulling);
+        gpuprof::beginZone("gpu cull");
+        gpuCuller->cull(view, persp);
+        gpuprof::endZone();
+        if(!deferredShading)
+            lightClusters.bind(*shaderProgram, rndr::getRenderWidth(),
+                               rndr::getRenderHeight());
+        gpuprof::Zone zone("geometry");
+        gpuCuller->draw(geometryShader, geometryPrepass);
+    }
+    else
+    {
+        if(!deferredShading)
+            lightClusters.bind(*shaderProgram, rndr::getRenderWidth(),
+                               rndr::getRenderHeight());
+        gpuprof::Zone zone("geometry");
+        drawCulled(view, persp, geometryShader, geometryPrepass);
+    }
+
+    if(deferredShading)
+    {
+        gpuprof::Zone zone("deferred lighting");
+        deferredRenderer->light(view, persp, camera.getPosition(), lightClusters);
+    }
+    if(gpuCulling)
+    {
+        gpuprof::Zone zone("hi-z");
+        gpuCuller->updateDepth();
+    }
+    frameData->endFrame();
+    frameCapture->endFrame();
+}
+
+void proj::GameLayer::drawCulled(const glm::mat4 &view, const glm::mat4 &persp,
+                                 Shader *shader, DepthPrepass *prepass)
+{
+    visibleThings.clear();
+    sceneBvh.queryFrustum(Frustum::fromMatrix(persp * view), visibleThings);
+
+    if(occlusionCulling)
+    {
+        occlusionCuller.begin(persp * view);
+        for(const auto &[thing, mesh] : occluders)
+            occlusionCuller.addOccluder(*mesh, things[thing]->getTransforms());
+        occlusionCuller.rasterize();
+
+        thingBounds.resize(things.size());
+        for(std::size_t i = 0; i < things.size(); i++)
+            thingBounds[i] = things[i]->getWorldBounds();
+        occlusionCuller.cull(thingBounds, visibleThings);
+    }
+
+    for(auto i : visibleThings)
+        things[i]->submit(*renderQueue, view);
+    renderQueue->execute(view, persp, shader, prepass);
+}
+
+void proj::GameLayer::benchmarkRenderPaths()
+{
+    constexpr int NUM_FRAMES = 200;
+    // Frames drawn first so that buffers are allocated and shaders linked.
+    constexpr int NUM_WARMUP_FRAMES = 10;
+
+    auto timeFrames = [&](bool deferred)
+    {
+        deferredShading = deferred;
+        for(int i = 0; i < NUM_WARMUP_FRAMES; i++)
+            draw(0.);
+        GLCall(glFinish());
+        auto start = chron::steady_clock::now();
+        // Never presented, so vsync does not limit the frame rate.
+        for(int i = 0; i < NUM_FRAMES; i++)
+        {
+            rndr::clearWindow();
+            draw(0.);
+        }
+        GLCall(glFinish());
+        return chron::duration<double, std::milli>(
+            chron::steady_clock::now() - start).count() / NUM_FRAMES;
+    };
+
+    bool wasDeferred = deferredShading;
+    fmt::print("{:>8} {:>12} {:>12}\n", "lights", "forward ms", "deferred ms");
+    for(int count : {0, 64, 1024, 4096})
+    {
+        setLights(count);
+        double forward = timeFrames(false);
+        double deferred = timeFrames(true);
+        fmt::print("{:>8} {:>12.3f} {:>12.3f}\n", count, forward, deferred);
+    }
+    setLights(1024);
+    deferredShading = wasDeferred;
 }
 
 
@@ -123,6 +389,11 @@ void proj::GameLayer::handleEvent(std::shared_ptr<proj::Event> event)
             mRightButtonIsPressed = true;
             event->setHandled(true);
             break;
+        case proj::MouseCode::Left:
+            if(auto picked = pickThing(mXpos, mYpos); picked >= 0)
+                std::cout << "Picked object " << picked << '\n';
+            event->setHandled(true);
+            break;
         default:
             break;
         }
@@ -155,6 +426,100 @@ void proj::GameLayer::handleEvent(std::shared_ptr<proj::Event> event)
         case proj::KeyCode::D:
             camera.processKeyboard(Camera::Movement::Right, mDeltaTime);
             break;
+        case proj::KeyCode::O:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                occlusionCulling = !occlusionCulling;
+                std::cout << "Occlusion culling "
+                          << (occlusionCulling ? "on" : "off") << '\n';
+            }
+            break;
+        case proj::KeyCode::G:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                gpuCulling = !gpuCulling;
+                std::cout << "GPU culling " << (gpuCulling ? "on" : "off")
+                          << (gpuCuller->hasIndirectCount() ? "" :
+                              " (without indirect parameters)")
+                          << '\n';
+            }
+            break;
+        case proj::KeyCode::F:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                deferredShading = !deferredShading;
+                std::cout << (deferredShading ? "Deferred" : "Forward")
+                          << " shading\n";
+            }
+            break;
+        case proj::KeyCode::Z:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                depthPrepass = !depthPrepass;
+                std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off")
+                          << '\n';
+            }
+            break;
+        case proj::KeyCode::F12:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+                frameCapture->saveScreenshot(
+                    fmt::format("screenshot_{:03}.png", numScreenshots++));
+            break;
+        case proj::KeyCode::F11:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                if(frameCapture->isRecording())
+                    frameCapture->stopRecording();
+                else
+                    frameCapture->startRecording("capture");
+                std::cout << "Recording frames to capture/ "
+                          << (frameCapture->isRecording() ? "on" : "off") << '\n';
+            }
+            break;
+        case proj::KeyCode::T:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                gpuprof::setEnabled(!gpuprof::isEnabled());
+                std::cout << "GPU profiling " << (gpuprof::isEnabled() ? "on" : "off")
+                          << '\n';
+            }
+            break;
+        case proj::KeyCode::P:
+            if(keyboardEvent.getEventType() == proj::EventType::KeyPressed)
+            {
+                const auto &stats = occlusionCuller.getStats();
+                std::cout << "Occlusion: " << stats.occluded << " of "
+                          << stats.tested << " occluded by " << stats.triangles
+                          << " triangles, rasterize " << stats.rasterizeMs
+                          << " ms, test " << stats.testMs << " ms\n";
+                const auto &lights = lightClusters.getStats();
+                std::cout << "Lights: " << lights.visibleLights << " of "
+                          << lights.lights << " in view, " << lights.references
+                          << " in clusters (at most " << lights.maxLightsPerCluster
+                          << " in one), " << lights.updateMs << " ms\n";
+                if(depthPrepass)
+                {
+                    const auto &depth = prepass->getStats();
+                    std::cout << "Depth pre-pass: " << depth.shadedFragments
+                              << " of " << depth.depthFragments << " fragments shaded, "
+                              << depth.savedFragments
+                              << (depth.pipelineStatistics ?
+                                  " fragment shader invocations saved\n" :
+                                  " samples saved\n");
+                }
+                std::cout << "Resolution: " << rndr::getRenderWidth() << 'x'
+                          << rndr::getRenderHeight() << ", "
+                          << rndr::getResolutionScale() * 100.f << "% of the window";
+                if(rndr::getGpuFrameMs() > 0.)
+                    std::cout << ", GPU frame " << rndr::getGpuFrameMs() << " ms";
+                std::cout << '\n';
+                const auto &targets = rndr::getTargetPool();
+                std::cout << "Render targets: " << targets.getNumTargets() << ", "
+                          << targets.getSize() / (1024 * 1024) << " MiB\n";
+                if(!gpuprof::getZones().empty())
+                    gpuprof::dump();
+            }
+            break;
         default:
             event->setHandled(false);
             break;
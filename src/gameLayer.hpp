@@ -13,6 +13,8 @@
 #include <cstdint>
 #include <chrono>
 
+class DepthPrepass;
+
 namespace proj
 {
     class GameLayer : public frame::Layer
@@ -20,13 +22,23 @@ namespace proj
     public:
         const static std::chrono::nanoseconds LOGICAL_FRAME_TIME;
         GameLayer();
-        virtual ~GameLayer() = default;
+        virtual ~GameLayer();
 
         virtual void update();
         virtual void draw(double alpha);
         virtual void handleEvent(std::shared_ptr<proj::Event> event);
         virtual void startFrame();
+
+        // Print the time per frame of forward and deferred shading with
+        // more and more lights. Needs a window.
+        void benchmarkRenderPaths();
     protected:
+        // Draw the things that pass CPU culling through the render queue,
+        // with shader instead of their own if it is not null, after a depth
+        // pre-pass if prepass is not null.
+        void drawCulled(const glm::mat4 &view, const glm::mat4 &persp,
+                        Shader *shader, DepthPrepass *prepass);
+
         bool mRightButtonIsPressed;
         bool mMouseMoved;
         float mLastMouseX;
@@ -5,18 +5,50 @@ extern "C" {
 }
 
 #include <string>
+#include <array>
+#include <stdexcept>
+#include <vector>
 #include "renderer/Texture.hpp"
 #include "renderer/VertexArray.hpp"
 #include "renderer/renderer.hpp"
 #include "renderer/Shader.hpp"
+#include "renderer/InstanceBatcher.hpp"
+#include "renderer/GeometryHeap.hpp"
+#include "renderer/RenderQueue.hpp"
+#include "renderer/GpuCuller.hpp"
+#include "renderer/Bvh.hpp"
+#include "settings.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+namespace
+{
+    // The thing owning every node of the hierarchy, by node.
+    std::vector<graph::Thing*> thingsByNode;
+
+    std::uint32_t createNode(graph::Thing *thing)
+    {
+        auto node = graph::getTransformHierarchy().create();
+        if(node >= thingsByNode.size())
+            thingsByNode.resize(node + 1, nullptr);
+        thingsByNode[node] = thing;
+        return node;
+    }
+}
+
 void graph::init(const std::string &windowTitle, int width,
                  int height)
 {
-    rndr::init(windowTitle, width, height);
+    rndr::init(windowTitle, width, height,
+               proj::getSetting<bool>("headless").value_or(false));
+    if(proj::getSetting<bool>("dynamicResolution").value_or(false))
+    {
+        rndr::enableDynamicResolution(
+            static_cast<float>(proj::getSetting<double>("minResolutionScale").value_or(0.5)),
+            static_cast<float>(proj::getSetting<double>("maxResolutionScale").value_or(1.)),
+            proj::getSetting<double>("frameBudgetMs").value_or(16.6));
+    }
 }
 
 void graph::quit()
@@ -55,39 +87,160 @@ void graph::present()
     rndr::present();
 }
 
+TransformHierarchy &graph::getTransformHierarchy()
+{
+    static TransformHierarchy hierarchy;
+    return hierarchy;
+}
+
+void graph::updateTransforms()
+{
+    auto &hierarchy = getTransformHierarchy();
+    hierarchy.update();
+    for(auto node : hierarchy.getChanged())
+        thingsByNode[node]->updateBounds();
+}
+
+graph::Thing::Thing()
+    : mVao(),mMesh(),mTexture(),mShader(),mNode(createNode(this)),
+      mLocalBounds(),mWorldBounds()
+{
+}
+
 graph::Thing::Thing(const std::filesystem::path &objPath,
              const std::filesystem::path &texPath,
              std::shared_ptr<Shader> shader)
-    : mVao(std::make_shared<VertexArray>(objPath)),
+    : mVao(std::make_shared<VertexArray>(objPath)),mMesh(),
       mTexture(std::make_shared<Texture>(texPath)),
-      mShader(shader),mTransforms(glm::mat4(1.f))
+      mShader(shader),mNode(createNode(this)),
+      mLocalBounds(mVao->getBounds()),mWorldBounds(mLocalBounds)
 {
 }
 
+graph::Thing::Thing(const std::filesystem::path &objPath,
+                    const std::filesystem::path &texPath,
+                    std::shared_ptr<Shader> shader, GeometryHeap &heap)
+    : mVao(),mMesh(heap.load(objPath)),
+      mTexture(std::make_shared<Texture>(texPath)),
+      mShader(shader),mNode(createNode(this)),
+      mLocalBounds(mMesh.bounds),mWorldBounds(mLocalBounds)
+{
+}
+
+graph::Thing::Thing(const MeshRange &mesh, const std::filesystem::path &texPath,
+                    std::shared_ptr<Shader> shader)
+    : mVao(),mMesh(mesh),
+      mTexture(std::make_shared<Texture>(texPath)),
+      mShader(shader),mNode(createNode(this)),
+      mLocalBounds(mMesh.bounds),mWorldBounds(mLocalBounds)
+{
+}
+
+graph::Thing::~Thing()
+{
+    detach();
+    // Children move up to the parent, as the hierarchy does.
+    getTransformHierarchy().destroy(mNode);
+    thingsByNode[mNode] = nullptr;
+}
+
 void graph::Thing::draw(const glm::mat4 &view, const glm::mat4 &projection)
 {
-    glm::mat4 modelViewMatrix = view * mTransforms;
+    if(!mVao)
+        throw std::logic_error("Things in a geometry heap can only be drawn "
+                               "through a render queue or GPU culler");
+    const auto &transforms = getTransforms();
+    glm::mat4 modelViewMatrix = view * transforms;
     glm::mat4 modelViewProjectionMatrix = projection * modelViewMatrix;
-    
-    mShader->set("uModelViewMatrix", modelViewMatrix);
-    mShader->set("uModelViewProjectionMatrix", modelViewProjectionMatrix);
-    mShader->set("uModelMatrix", mTransforms);
-    mShader->set("uNormalMatrix", glm::mat3(glm::transpose(glm::inverse(mTransforms))));
+    // Matches the layout of uObjectMatrices in main.vert.
+    const std::array<glm::mat4, 4> objectMatrices = {
+        transforms,
+        modelViewMatrix,
+        modelViewProjectionMatrix,
+        getTransformHierarchy().getNormalMatrix(mNode),
+    };
+
+    mShader->set("uObjectMatrices", objectMatrices);
     mTexture->bind();
     mVao->bind();
 }
 
+void graph::Thing::submit(InstanceBatcher &batcher) const
+{
+    if(!mVao)
+        throw std::logic_error("Things in a geometry heap can only be drawn "
+                               "through a render queue or GPU culler");
+    batcher.submit(mVao.get(), mTexture.get(), mShader.get(),
+                   getInstance());
+}
+
+void graph::Thing::submit(RenderQueue &queue, const glm::mat4 &view,
+                          std::uint8_t layer) const
+{
+    // The camera looks down -z, so depth is the negated view space z of the
+    // object's origin.
+    float viewDepth = -(view * getTransforms()[3]).z;
+    queue.submit(layer, mShader.get(), mTexture.get(), mMesh, getTransforms(),
+                 viewDepth);
+}
+
+std::uint32_t graph::Thing::submit(GpuCuller &culler) const
+{
+    return culler.add(mShader.get(), mTexture.get(), mMesh,
+                      getInstance(), mWorldBounds);
+}
+
 void graph::Thing::translate(const glm::vec3 &xyz)
 {
-    mTransforms = glm::translate(mTransforms, xyz);
+    getTransformHierarchy().translate(mNode, xyz);
 }
 
 void graph::Thing::scale(const glm::vec3 &xyz)
 {
-    mTransforms = glm::scale(mTransforms, xyz);
+    getTransformHierarchy().scale(mNode, xyz);
 }
 
 void graph::Thing::rotate(float radAngle, const glm::vec3 &xyz)
 {
-    mTransforms = glm::rotate(mTransforms, radAngle, xyz);
+    getTransformHierarchy().rotate(mNode, radAngle, xyz);
+}
+
+void graph::Thing::setParent(const Thing *parent)
+{
+    getTransformHierarchy().setParent(mNode, parent == nullptr ?
+                                      TransformHierarchy::NONE : parent->mNode);
+}
+
+void graph::Thing::setShader(std::shared_ptr<Shader> shader)
+{
+    mShader = std::move(shader);
+}
+
+void graph::Thing::attach(Bvh &bvh, std::uint32_t userData)
+{
+    detach();
+    mBvh = &bvh;
+    mProxy = bvh.insert(mWorldBounds, userData);
+}
+
+void graph::Thing::detach()
+{
+    if(mBvh == nullptr)
+        return;
+    mBvh->remove(mProxy);
+    mBvh = nullptr;
+    mProxy = -1;
+}
+
+InstanceData graph::Thing::getInstance() const
+{
+    const auto &hierarchy = getTransformHierarchy();
+    return InstanceData{hierarchy.getWorld(mNode), hierarchy.getNormalMatrix(mNode)};
+}
+
+void graph::Thing::updateBounds()
+{
+    mWorldBounds = mLocalBounds.transform(getTransforms());
+    if(mBvh != nullptr)
+        mBvh->update(mProxy, mWorldBounds);
 }
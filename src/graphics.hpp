@@ -4,11 +4,21 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <memory>
+#include <cstdint>
 #include <filesystem>
 
+#include "renderer/glutil.hpp"
+#include "renderer/TransformHierarchy.hpp"
+
 class VertexArray;
 class Texture;
 class Shader;
+class InstanceBatcher;
+class GeometryHeap;
+class RenderQueue;
+class GpuCuller;
+class Bvh;
+struct InstanceData;
 
 namespace graph
 {
@@ -21,24 +31,87 @@ namespace graph
     void clearWindow();
     void present();
 
+    // Transforms of every Thing.
+    TransformHierarchy &getTransformHierarchy();
+    // Recompute the transforms of the things that moved or whose parents
+    // did, and their world bounds. Call it once per frame before drawing.
+    void updateTransforms();
+
     class Thing
     {
     public:
         Thing(const std::filesystem::path &objPath,
               const std::filesystem::path &texPath,
               std::shared_ptr<Shader> shader);
-        Thing() = default;
-        virtual ~Thing() = default;
+        // Store the mesh in heap instead of giving it its own vertex
+        // array. Such things can only be drawn through a RenderQueue.
+        Thing(const std::filesystem::path &objPath,
+              const std::filesystem::path &texPath,
+              std::shared_ptr<Shader> shader, GeometryHeap &heap);
+        // Draw a mesh that is already in a heap, with the same
+        // requirements as above.
+        Thing(const MeshRange &mesh, const std::filesystem::path &texPath,
+              std::shared_ptr<Shader> shader);
+        Thing();
+        Thing(const Thing &) = delete;
+        virtual ~Thing();
 
+        // Draw the object with its own vertex array. Throws
+        // std::logic_error for objects in a geometry heap.
         void draw(const glm::mat4 &view, const glm::mat4 &projection);
+        // Queue the object for instanced drawing. Its shader must be an
+        // instanced variant, and like draw() it needs a vertex array of
+        // its own.
+        void submit(InstanceBatcher &batcher) const;
+        // Queue the object in a render queue. It must have been created in
+        // the queue's heap and its shader must be a multi-draw variant.
+        void submit(RenderQueue &queue, const glm::mat4 &view,
+                    std::uint8_t layer = 0) const;
+        // Register the object with a GPU culler, which draws it every
+        // frame it is visible. The same requirements as for a render queue
+        // apply. Returns the object's index in the culler.
+        std::uint32_t submit(GpuCuller &culler) const;
         void translate(const glm::vec3 &xyz);
         void scale(const glm::vec3 &xyz);
         void rotate(float radAngle, const glm::vec3 &xyz);
+        // Make the object's transforms relative to parent, or to the world
+        // if parent is null.
+        void setParent(const Thing *parent);
+        void setShader(std::shared_ptr<Shader> shader);
+        // As of the last updateTransforms().
+        const glm::mat4 &getTransforms() const
+        {
+            return getTransformHierarchy().getWorld(mNode);
+        }
+        std::uint32_t getNode() const
+        {
+            return mNode;
+        }
+        // Bounds of the mesh after the object's transforms.
+        const AABB &getWorldBounds() const
+        {
+            return mWorldBounds;
+        }
+        // Keep the object's world bounds in bvh, tagged with userData, until
+        // detached or destroyed.
+        void attach(Bvh &bvh, std::uint32_t userData);
+        void detach();
     protected:
         std::shared_ptr<VertexArray> mVao;
+        MeshRange mMesh;
         std::shared_ptr<Texture> mTexture;
         std::shared_ptr<Shader> mShader;
-        glm::mat4 mTransforms;
+        // The object's node in getTransformHierarchy().
+        std::uint32_t mNode;
+        AABB mLocalBounds;
+        AABB mWorldBounds;
+        Bvh *mBvh = nullptr;
+        std::int32_t mProxy = -1;
+
+        friend void updateTransforms();
+        // Recompute everything derived from the transforms.
+        void updateBounds();
+        InstanceData getInstance() const;
     };
 }
 
@@ -0,0 +1,130 @@
+#include "jobs.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <queue>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    class threadPool
+    {
+    public:
+        threadPool(std::size_t numThreads)
+        {
+            for(std::size_t i = 0; i < numThreads; i++)
+                mThreads.emplace_back([this]() { work(); });
+        }
+
+        ~threadPool()
+        {
+            {
+                std::lock_guard lock(mMutex);
+                mQuit = true;
+            }
+            mCondition.notify_all();
+            for(auto &thread : mThreads)
+                thread.join();
+        }
+
+        void post(std::function<void()> job)
+        {
+            {
+                std::lock_guard lock(mMutex);
+                mJobs.push(std::move(job));
+            }
+            mCondition.notify_one();
+        }
+
+        std::size_t size() const
+        {
+            return mThreads.size();
+        }
+
+    private:
+        std::vector<std::thread> mThreads;
+        std::queue<std::function<void()>> mJobs;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mQuit = false;
+
+        void work()
+        {
+            for(;;)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock lock(mMutex);
+                    mCondition.wait(lock, [this]()
+                    {
+                        return mQuit || !mJobs.empty();
+                    });
+                    if(mJobs.empty())
+                        return;
+                    job = std::move(mJobs.front());
+                    mJobs.pop();
+                }
+                job();
+            }
+        }
+    };
+
+    // Started on first use. The calling thread works too, so one core is
+    // left for it.
+    threadPool &getPool()
+    {
+        static threadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+}
+
+std::size_t jobs::getNumThreads()
+{
+    return getPool().size() + 1;
+}
+
+void jobs::parallelFor(std::size_t count, std::size_t grain,
+                       const std::function<void(std::size_t, std::size_t)> &f)
+{
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t numChunks = (count + grain - 1) / grain;
+    auto &pool = getPool();
+    if(numChunks <= 1 || pool.size() == 0)
+    {
+        if(count > 0)
+            f(0, count);
+        return;
+    }
+
+    // Every thread takes the next chunk until there are none left.
+    std::atomic<std::size_t> nextChunk = 0;
+    auto runChunks = [&]()
+    {
+        for(auto chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+            f(chunk * grain, std::min(count, (chunk + 1) * grain));
+    };
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t numHelpers = std::min(pool.size(), numChunks - 1);
+    std::size_t running = numHelpers;
+    for(std::size_t i = 0; i < numHelpers; i++)
+    {
+        pool.post([&]()
+        {
+            runChunks();
+            // Notify under the lock, the caller's stack goes away as soon
+            // as it sees running reach 0.
+            std::lock_guard lock(mutex);
+            if(--running == 0)
+                done.notify_one();
+        });
+    }
+
+    runChunks();
+    std::unique_lock lock(mutex);
+    done.wait(lock, [&running]() { return running == 0; });
+}
@@ -0,0 +1,23 @@
+/**
+ * @brief A pool of worker threads for splitting loops across cores.
+ */
+#ifndef PROJ_JOBS_HPP
+#define PROJ_JOBS_HPP
+
+#include <cstddef>
+#include <functional>
+
+namespace jobs
+{
+    // Number of threads parallelFor() runs on, including the caller.
+    std::size_t getNumThreads();
+
+    // Call f(first, last) for ranges of at most grain items that together
+    // cover [0, count), on the worker threads and the calling thread, and
+    // return once every call is done. f must not throw or call
+    // parallelFor().
+    void parallelFor(std::size_t count, std::size_t grain,
+                     const std::function<void(std::size_t, std::size_t)> &f);
+}
+
+#endif /* PROJ_JOBS_HPP */
@@ -20,6 +20,7 @@ extern "C" {
 #include "gameLayer.hpp"
 #include "util.hpp"
 #include "settings.hpp"
+#include "benchmark.hpp"
 
 using namespace std::literals::string_literals;
 using namespace std::literals::string_view_literals;
@@ -57,6 +58,13 @@ int main(int argc, const char * const argv[])
         args = std::vector<std::string>(argv + 1, argv + argc);
 #endif // _WIN32
         proj::init(args);
+        if(auto name = proj::getSetting<std::string>("benchmark");
+           name && !name->empty())
+        {
+            bench::run(*name);
+            return EXIT_SUCCESS;
+        }
+
         graph::init("project", 1200, 900);
         frame::init();
         frame::Layer::addLayer(std::make_shared<proj::GameLayer>());
@@ -83,6 +91,7 @@ int main(int argc, const char * const argv[])
         result = EXIT_FAILURE;
     }
 
+    frame::quit();
     graph::quit();
     return result;
 }
@@ -4,11 +4,13 @@
 #include <cstdint>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <exception>
 #include <stdexcept>
 #include <fmt/core.h>
 
 #include "glutil.hpp"
+#include "GLResource.hpp"
 
 class Bindable
 {
@@ -17,6 +19,23 @@ public:
     Bindable() : mId(0)
     {
     }
+    // A Bindable owns its object and hands it to glres::deleteLater() when
+    // destroyed, so it can not be copied.
+    Bindable(const Bindable &) = delete;
+    Bindable &operator=(const Bindable &) = delete;
+
+    // Moving takes over the object. Assignment swaps, so that the object
+    // assigned over goes with the other Bindable when it is destroyed.
+    Bindable(Bindable &&other) noexcept
+        : mId(std::exchange(other.mId, 0))
+    {
+    }
+
+    Bindable &operator=(Bindable &&other) noexcept
+    {
+        std::swap(mId, other.mId);
+        return *this;
+    }
     virtual ~Bindable() = default;
 
     virtual void bind() = 0;
@@ -0,0 +1,128 @@
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Axis aligned bounding box. A default constructed box is empty, so
+// expanding it by a point gives a box around just that point.
+struct AABB
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool isEmpty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 getCenter() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    // Half the size of the box along each axis.
+    glm::vec3 getExtents() const
+    {
+        return (max - min) * 0.5f;
+    }
+
+    float getSurfaceArea() const
+    {
+        auto d = max - min;
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    void expand(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const AABB &box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool contains(const AABB &box) const
+    {
+        return min.x <= box.min.x && min.y <= box.min.y && min.z <= box.min.z &&
+            max.x >= box.max.x && max.y >= box.max.y && max.z >= box.max.z;
+    }
+
+    bool overlaps(const AABB &box) const
+    {
+        return min.x <= box.max.x && max.x >= box.min.x &&
+            min.y <= box.max.y && max.y >= box.min.y &&
+            min.z <= box.max.z && max.z >= box.min.z;
+    }
+
+    // Box around this box after transforming it by m (Arvo's method).
+    AABB transform(const glm::mat4 &m) const
+    {
+        if(isEmpty())
+            return *this;
+        auto center = glm::vec3(m * glm::vec4(getCenter(), 1.f));
+        auto extents = getExtents();
+        glm::vec3 worldExtents(0.f);
+        for(int i = 0; i < 3; i++)
+            for(int j = 0; j < 3; j++)
+                worldExtents[i] += std::abs(m[j][i]) * extents[j];
+        return AABB{center - worldExtents, center + worldExtents};
+    }
+
+    static AABB merge(const AABB &a, const AABB &b)
+    {
+        AABB result = a;
+        result.expand(b);
+        return result;
+    }
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center = glm::vec3(0.f);
+    float radius = 0.f;
+};
+
+// A named part of a mesh (an OBJ "o" or "g" group) as a range of its index
+// buffer.
+struct Submesh
+{
+    std::uint32_t firstIndex = 0;
+    std::uint32_t indexCount = 0;
+    AABB bounds;
+    BoundingSphere sphere;
+};
+
+// Bounding box and sphere of the vertices referenced by
+// indices[first, first + count).
+template<typename Tindex>
+inline void computeBounds(const std::vector<glm::vec3> &vertices,
+                          const std::vector<Tindex> &indices,
+                          std::size_t first, std::size_t count,
+                          AABB &bounds, BoundingSphere &sphere)
+{
+    bounds = AABB();
+    for(std::size_t i = first; i < first + count; i++)
+        bounds.expand(vertices[indices[i]]);
+
+    // Centered on the box, the radius is the farthest vertex from there,
+    // which is never worse than half the box's diagonal.
+    sphere.center = bounds.isEmpty() ? glm::vec3(0.f) : bounds.getCenter();
+    float radius2 = 0.f;
+    for(std::size_t i = first; i < first + count; i++)
+    {
+        auto d = vertices[indices[i]] - sphere.center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    sphere.radius = std::sqrt(radius2);
+}
+
+#endif /* BOUNDS_HPP */
@@ -0,0 +1,341 @@
+#include "BufferAllocator.hpp"
+
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+
+#include "glutil.hpp"
+
+namespace
+{
+    std::size_t roundUp(std::size_t value, std::size_t align)
+    {
+        return (value + align - 1) & ~(align - 1);
+    }
+
+    // Index of the most significant set bit.
+    std::uint32_t highestBit(std::size_t value)
+    {
+        return 63 - static_cast<std::uint32_t>(
+            __builtin_clzll(static_cast<unsigned long long>(value)));
+    }
+}
+
+BufferPool::BufferPool(BufferUsage usage, std::size_t blockSize, bool growable)
+    : mUsage(usage),mBlockSize(roundUp(blockSize, MIN_ALIGNMENT)),mGrowable(growable),
+      mBlocks(),
+      mNodes(),mUnusedNodes(),mFirstLevel(0),mSecondLevel(),mFreeLists(),
+      mFreeRanges(0),mBytesReserved(0),mBytesAllocated(0),mAllocations(0)
+{
+    mSecondLevel.fill(0);
+    for(auto &lists : mFreeLists)
+        lists.fill(NONE);
+}
+
+BufferPool &BufferPool::get(BufferUsage usage)
+{
+    static BufferPool *staticPool = new BufferPool(BufferUsage::Static);
+    static BufferPool *streamPool = new BufferPool(BufferUsage::Stream);
+    return usage == BufferUsage::Static ? *staticPool : *streamPool;
+}
+
+BufferRange BufferPool::allocate(std::size_t size, std::size_t align, const void *data)
+{
+    if(size == 0)
+        throw std::invalid_argument("Cannot allocate an empty buffer range");
+    if((align & (align - 1)) != 0)
+        throw std::invalid_argument(fmt::format("Alignment {} is not a power of two",
+                                                align));
+    align = std::max(align, MIN_ALIGNMENT);
+    auto rangeSize = roundUp(size, MIN_ALIGNMENT);
+    // Ranges start at multiples of MIN_ALIGNMENT, so this is enough room
+    // for any start.
+    auto needed = rangeSize + align - MIN_ALIGNMENT;
+
+    auto index = findFree(needed);
+    if(index == NONE)
+    {
+        // A range of exactly needed bytes would be filed below the class
+        // findFree() starts from.
+        auto searchSize = getSearchSize(needed);
+        if(mGrowable && !mBlocks.empty())
+            growBlock(searchSize);
+        else
+            addBlock(std::max(mBlockSize, searchSize));
+        index = findFree(needed);
+        if(index == NONE)
+            throw std::runtime_error(fmt::format(
+                "Could not allocate {} bytes from a buffer pool", size));
+    }
+    removeFree(index);
+
+    // Padding in front of an aligned start and whatever is left after the
+    // range go back to the pool.
+    auto padding = roundUp(mNodes[index].offset, align) - mNodes[index].offset;
+    if(padding > 0)
+    {
+        auto aligned = split(index, padding);
+        insertFree(index);
+        index = aligned;
+    }
+    if(mNodes[index].size > rangeSize)
+        insertFree(split(index, rangeSize));
+    mNodes[index].free = false;
+    mBytesAllocated += rangeSize;
+    mAllocations++;
+
+    BufferRange range;
+    range.buffer = mBlocks[mNodes[index].block].get();
+    range.offset = mNodes[index].offset;
+    range.size = size;
+    range.node = index;
+    if(data == nullptr)
+        return range;
+
+    if(mUsage == BufferUsage::Stream)
+    {
+        write(range, data, size);
+    }
+    else
+    {
+        BufferHandle staging;
+        GLCall(glCreateBuffers(1, staging.put()));
+        GLCall(glNamedBufferStorage(staging.get(), size, data, 0));
+        GLCall(glCopyNamedBufferSubData(staging.get(), range.buffer, 0, range.offset, size));
+    }
+    return range;
+}
+
+void BufferPool::free(BufferRange &range)
+{
+    if(!range.isValid())
+        return;
+
+    auto index = range.node;
+    mNodes[index].free = true;
+    mBytesAllocated -= mNodes[index].size;
+    mAllocations--;
+
+    auto next = mNodes[index].nextPhysical;
+    if(next != NONE && mNodes[next].free)
+    {
+        removeFree(next);
+        merge(index, next);
+    }
+    auto previous = mNodes[index].prevPhysical;
+    if(previous != NONE && mNodes[previous].free)
+    {
+        removeFree(previous);
+        merge(previous, index);
+        index = previous;
+    }
+    insertFree(index);
+    range = BufferRange();
+}
+
+void BufferPool::write(const BufferRange &range, const void *data, std::size_t size,
+                       std::size_t offset)
+{
+    if(mUsage != BufferUsage::Stream)
+        throw std::logic_error("Only stream buffer ranges can be rewritten");
+    GLCall(glNamedBufferSubData(range.buffer, range.offset + offset, size, data));
+}
+
+BufferPoolStats BufferPool::getStats() const
+{
+    BufferPoolStats stats;
+    stats.blocks = mBlocks.size();
+    stats.bytesReserved = mBytesReserved;
+    stats.bytesAllocated = mBytesAllocated;
+    stats.allocations = mAllocations;
+    stats.freeRanges = mFreeRanges;
+    // The largest range is in the highest non-empty size class.
+    if(mFirstLevel != 0)
+    {
+        auto fl = highestBit(mFirstLevel);
+        auto sl = highestBit(mSecondLevel[fl]);
+        for(auto i = mFreeLists[fl][sl]; i != NONE; i = mNodes[i].nextFree)
+            stats.largestFreeRange = std::max(stats.largestFreeRange, mNodes[i].size);
+    }
+    return stats;
+}
+
+void BufferPool::mapInsert(std::size_t size, std::uint32_t &fl, std::uint32_t &sl)
+{
+    if(size < SL_COUNT)
+    {
+        fl = 0;
+        sl = static_cast<std::uint32_t>(size);
+        return;
+    }
+    auto f = highestBit(size);
+    fl = f - SL_LOG + 1;
+    sl = static_cast<std::uint32_t>(size >> (f - SL_LOG)) ^ SL_COUNT;
+}
+
+void BufferPool::mapSearch(std::size_t size, std::uint32_t &fl, std::uint32_t &sl)
+{
+    // Round up to the next size class so every range in it is big enough.
+    mapInsert(getSearchSize(size), fl, sl);
+}
+
+std::size_t BufferPool::getSearchSize(std::size_t size)
+{
+    if(size < SL_COUNT)
+        return size;
+    return roundUp(size, std::size_t(1) << (highestBit(size) - SL_LOG));
+}
+
+std::uint32_t BufferPool::newNode(const node &n)
+{
+    if(mUnusedNodes.empty())
+    {
+        mNodes.push_back(n);
+        return static_cast<std::uint32_t>(mNodes.size() - 1);
+    }
+    auto index = mUnusedNodes.back();
+    mUnusedNodes.pop_back();
+    mNodes[index] = n;
+    return index;
+}
+
+void BufferPool::insertFree(std::uint32_t index)
+{
+    std::uint32_t fl = 0;
+    std::uint32_t sl = 0;
+    mapInsert(mNodes[index].size, fl, sl);
+    auto &head = mFreeLists[fl][sl];
+    auto &n = mNodes[index];
+    n.free = true;
+    n.prevFree = NONE;
+    n.nextFree = head;
+    if(head != NONE)
+        mNodes[head].prevFree = index;
+    head = index;
+    mSecondLevel[fl] |= 1u << sl;
+    mFirstLevel |= std::uint64_t(1) << fl;
+    mFreeRanges++;
+}
+
+void BufferPool::removeFree(std::uint32_t index)
+{
+    std::uint32_t fl = 0;
+    std::uint32_t sl = 0;
+    mapInsert(mNodes[index].size, fl, sl);
+    auto &n = mNodes[index];
+    if(n.prevFree != NONE)
+        mNodes[n.prevFree].nextFree = n.nextFree;
+    else
+        mFreeLists[fl][sl] = n.nextFree;
+    if(n.nextFree != NONE)
+        mNodes[n.nextFree].prevFree = n.prevFree;
+    n.prevFree = NONE;
+    n.nextFree = NONE;
+
+    if(mFreeLists[fl][sl] == NONE)
+    {
+        mSecondLevel[fl] &= ~(1u << sl);
+        if(mSecondLevel[fl] == 0)
+            mFirstLevel &= ~(std::uint64_t(1) << fl);
+    }
+    mFreeRanges--;
+}
+
+std::uint32_t BufferPool::findFree(std::size_t size) const
+{
+    std::uint32_t fl = 0;
+    std::uint32_t sl = 0;
+    mapSearch(size, fl, sl);
+    if(fl >= FL_COUNT)
+        return NONE;
+
+    auto slMap = mSecondLevel[fl] & (~0u << sl);
+    if(slMap == 0)
+    {
+        auto flMap = mFirstLevel & (~std::uint64_t(0) << (fl + 1));
+        if(flMap == 0)
+            return NONE;
+        fl = static_cast<std::uint32_t>(__builtin_ctzll(flMap));
+        slMap = mSecondLevel[fl];
+    }
+    sl = static_cast<std::uint32_t>(__builtin_ctz(slMap));
+    return mFreeLists[fl][sl];
+}
+
+std::uint32_t BufferPool::split(std::uint32_t index, std::size_t size)
+{
+    auto n = mNodes[index];
+    auto rest = newNode(node{n.offset + size, n.size - size, n.block, index,
+                             n.nextPhysical, NONE, NONE, true});
+    if(n.nextPhysical != NONE)
+        mNodes[n.nextPhysical].prevPhysical = rest;
+    mNodes[index].size = size;
+    mNodes[index].nextPhysical = rest;
+    return rest;
+}
+
+void BufferPool::merge(std::uint32_t first, std::uint32_t second)
+{
+    mNodes[first].size += mNodes[second].size;
+    auto next = mNodes[second].nextPhysical;
+    mNodes[first].nextPhysical = next;
+    if(next != NONE)
+        mNodes[next].prevPhysical = first;
+    // Unused nodes have no size, growBlock() tells them apart by it.
+    mNodes[second].size = 0;
+    mUnusedNodes.push_back(second);
+}
+
+std::uint32_t BufferPool::createBuffer(std::size_t size) const
+{
+    std::uint32_t buffer = 0;
+    GLCall(glCreateBuffers(1, &buffer));
+    GLCall(glNamedBufferStorage(buffer, size, nullptr,
+                                mUsage == BufferUsage::Stream ?
+                                GL_DYNAMIC_STORAGE_BIT : 0));
+    return buffer;
+}
+
+void BufferPool::addBlock(std::size_t size)
+{
+    size = roundUp(size, MIN_ALIGNMENT);
+    mBlocks.emplace_back(createBuffer(size));
+    mBytesReserved += size;
+    insertFree(newNode(node{0, size, static_cast<std::uint32_t>(mBlocks.size() - 1),
+                            NONE, NONE, NONE, NONE, true}));
+}
+
+void BufferPool::growBlock(std::size_t needed)
+{
+    std::uint32_t last = NONE;
+    for(std::uint32_t i = 0; i < mNodes.size() && last == NONE; i++)
+    {
+        if(mNodes[i].size > 0 && mNodes[i].nextPhysical == NONE)
+            last = i;
+    }
+
+    auto oldSize = mBytesReserved;
+    auto size = roundUp(std::max(oldSize * 2, oldSize + needed), MIN_ALIGNMENT);
+    std::cout << "Growing buffer pool to " << size << " bytes.\n";
+    auto buffer = createBuffer(size);
+    GLCall(glCopyNamedBufferSubData(mBlocks[0].get(), buffer, 0, 0, oldSize));
+    mBlocks[0].reset(buffer);
+    mBytesReserved = size;
+
+    // The new space joins the free range at the end of the block, if there
+    // is one.
+    if(mNodes[last].free)
+    {
+        removeFree(last);
+        mNodes[last].size += size - oldSize;
+        insertFree(last);
+    }
+    else
+    {
+        auto tail = newNode(node{oldSize, size - oldSize, 0, last, NONE, NONE, NONE, true});
+        mNodes[last].nextPhysical = tail;
+        insertFree(tail);
+    }
+}
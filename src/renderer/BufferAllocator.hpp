@@ -0,0 +1,166 @@
+#ifndef BUFFER_ALLOCATOR_HPP
+#define BUFFER_ALLOCATOR_HPP
+
+#include <glad/glad.h>
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "GLResource.hpp"
+
+// How the data in a BufferPool is updated.
+enum class BufferUsage
+{
+    // Written once when allocated. Blocks are immutable and filled through
+    // a staging buffer.
+    Static,
+    // Rewritten now and then with BufferPool::write(), blocks have
+    // GL_DYNAMIC_STORAGE_BIT. Data changing every frame belongs in a
+    // RingBuffer instead.
+    Stream,
+};
+
+// A range of bytes in one of the buffers of a BufferPool.
+struct BufferRange
+{
+    static constexpr std::uint32_t INVALID_NODE = std::numeric_limits<std::uint32_t>::max();
+
+    std::uint32_t buffer = 0;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+    // The pool's bookkeeping entry for the range.
+    std::uint32_t node = INVALID_NODE;
+
+    bool isValid() const
+    {
+        return node != INVALID_NODE;
+    }
+};
+
+// Space used by a BufferPool.
+struct BufferPoolStats
+{
+    std::size_t blocks = 0;
+    std::size_t bytesReserved = 0;
+    std::size_t bytesAllocated = 0;
+    std::size_t allocations = 0;
+    std::size_t freeRanges = 0;
+    std::size_t largestFreeRange = 0;
+};
+
+// Sub-allocator of GPU buffers, so that many meshes share a few large
+// buffer objects. Blocks of blockSize bytes are reserved as they are
+// needed and carved up with a TLSF (two level segregated fit) allocator:
+// free ranges are kept in lists by size class, a power of two split into
+// SL_COUNT linear steps, and two levels of bitmaps find a list with a big
+// enough range in constant time. Freed ranges are merged with their free
+// neighbours right away.
+//
+// A growable pool keeps a single block instead, and moves it to a buffer
+// twice the size when it is full, for users that need all their ranges in
+// one buffer object. Ranges keep their offsets when it grows, but the
+// buffer they name is gone, getBuffer() has the current one.
+//
+// Bookkeeping is kept on the CPU, the buffers only hold the data.
+class BufferPool
+{
+public:
+    // Every range starts and ends at a multiple of this.
+    static constexpr std::size_t MIN_ALIGNMENT = 16;
+
+    BufferPool(BufferUsage usage, std::size_t blockSize = 32 << 20,
+               bool growable = false);
+    BufferPool(const BufferPool &) = delete;
+    ~BufferPool() = default;
+
+    // Shared pools of each usage, created on first use with the current
+    // context. They are never destroyed, their buffers go with the context.
+    static BufferPool &get(BufferUsage usage);
+
+    // Reserve size bytes aligned to align, a power of two. data, if not
+    // null, is copied to the range.
+    BufferRange allocate(std::size_t size, std::size_t align = MIN_ALIGNMENT,
+                         const void *data = nullptr);
+
+    // Return a range to the pool. Invalid ranges are ignored.
+    void free(BufferRange &range);
+
+    // Copy size bytes of data to range at offset. Stream pools only.
+    void write(const BufferRange &range, const void *data, std::size_t size,
+               std::size_t offset = 0);
+
+    BufferUsage getUsage() const
+    {
+        return mUsage;
+    }
+
+    // Name of a block's buffer, 0 before it is reserved.
+    std::uint32_t getBuffer(std::size_t block = 0) const
+    {
+        return block < mBlocks.size() ? mBlocks[block].get() : 0;
+    }
+
+    BufferPoolStats getStats() const;
+
+private:
+    static constexpr std::uint32_t SL_LOG = 4;
+    static constexpr std::uint32_t SL_COUNT = 1 << SL_LOG;
+    static constexpr std::uint32_t FL_COUNT = 48;
+    static constexpr std::uint32_t NONE = BufferRange::INVALID_NODE;
+
+    // A range of a block, free or in use. Ranges of a block are linked in
+    // address order, free ones are also linked in their size class list.
+    struct node
+    {
+        std::size_t offset;
+        std::size_t size;
+        std::uint32_t block;
+        std::uint32_t prevPhysical;
+        std::uint32_t nextPhysical;
+        std::uint32_t prevFree;
+        std::uint32_t nextFree;
+        bool free;
+    };
+
+    // Size class of a range of size bytes.
+    static void mapInsert(std::size_t size, std::uint32_t &fl, std::uint32_t &sl);
+    // First size class whose ranges are all at least size bytes.
+    static void mapSearch(std::size_t size, std::uint32_t &fl, std::uint32_t &sl);
+    // Smallest range that findFree(size) can find, size rounded up to the
+    // start of the class mapSearch() gives.
+    static std::size_t getSearchSize(std::size_t size);
+
+    std::uint32_t newNode(const node &n);
+    void insertFree(std::uint32_t index);
+    void removeFree(std::uint32_t index);
+    // Free range of at least size bytes, or NONE.
+    std::uint32_t findFree(std::size_t size) const;
+    // Split the range at index so that it is size bytes long, the rest
+    // becomes a free range. Returns the index of the rest or NONE.
+    std::uint32_t split(std::uint32_t index, std::size_t size);
+    void merge(std::uint32_t first, std::uint32_t second);
+    std::uint32_t createBuffer(std::size_t size) const;
+    void addBlock(std::size_t size);
+    // Move the block of a growable pool to a larger buffer with at least
+    // needed more free bytes at its end.
+    void growBlock(std::size_t needed);
+
+    BufferUsage mUsage;
+    std::size_t mBlockSize;
+    bool mGrowable;
+    std::vector<BufferHandle> mBlocks;
+    std::vector<node> mNodes;
+    std::vector<std::uint32_t> mUnusedNodes;
+    std::uint64_t mFirstLevel;
+    std::array<std::uint32_t, FL_COUNT> mSecondLevel;
+    std::array<std::array<std::uint32_t, SL_COUNT>, FL_COUNT> mFreeLists;
+    std::size_t mFreeRanges;
+    std::size_t mBytesReserved;
+    std::size_t mBytesAllocated;
+    std::size_t mAllocations;
+};
+
+#endif /* BUFFER_ALLOCATOR_HPP */
@@ -0,0 +1,541 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "FrustumCuller.hpp"
+
+namespace
+{
+    // Number of buckets along the split axis when building.
+    constexpr int NUM_BINS = 16;
+
+    // Whether the ray hits box within [0, maxDistance], and if so the
+    // distance at which it enters the box.
+    bool intersectRay(const AABB &box, const glm::vec3 &origin,
+                      const glm::vec3 &invDirection, float maxDistance,
+                      float &distance)
+    {
+        float tmin = 0.f;
+        float tmax = maxDistance;
+        for(int i = 0; i < 3; i++)
+        {
+            float t1 = (box.min[i] - origin[i]) * invDirection[i];
+            float t2 = (box.max[i] - origin[i]) * invDirection[i];
+            // Written so that NaNs, from a ray in a slab's plane, keep the
+            // current interval.
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        distance = tmin;
+        return tmin <= tmax;
+    }
+}
+
+void Bvh::clear()
+{
+    mNodes.clear();
+    mProxies.clear();
+    mFreeProxies = NULL_NODE;
+    mRoot = NULL_NODE;
+    mFreeList = NULL_NODE;
+    mNumLeaves = 0;
+}
+
+std::int32_t Bvh::insert(const AABB &bounds, std::uint32_t userData)
+{
+    std::int32_t proxy = mFreeProxies;
+    if(proxy == NULL_NODE)
+    {
+        proxy = static_cast<std::int32_t>(mProxies.size());
+        mProxies.push_back(NULL_NODE);
+    }
+    else
+        mFreeProxies = mProxies[proxy];
+
+    auto leaf = allocateNode();
+    mNodes[leaf].bounds = bounds;
+    mNodes[leaf].userData = userData;
+    mNodes[leaf].proxy = proxy;
+    mNodes[leaf].height = 0;
+    mProxies[proxy] = leaf;
+    insertLeaf(leaf);
+    mNumLeaves++;
+    return proxy;
+}
+
+void Bvh::remove(std::int32_t proxy)
+{
+    auto leaf = mProxies[proxy];
+    removeLeaf(leaf);
+    freeNode(leaf);
+    mProxies[proxy] = mFreeProxies;
+    mFreeProxies = proxy;
+    mNumLeaves--;
+}
+
+void Bvh::update(std::int32_t proxy, const AABB &bounds, bool reinsert)
+{
+    auto leaf = mProxies[proxy];
+    if(reinsert)
+    {
+        removeLeaf(leaf);
+        mNodes[leaf].bounds = bounds;
+        insertLeaf(leaf);
+    }
+    else
+    {
+        mNodes[leaf].bounds = bounds;
+        fixUpwards(mNodes[leaf].parent);
+    }
+}
+
+void Bvh::refit()
+{
+    if(mRoot == NULL_NODE)
+        return;
+
+    // Parents come before their children in preorder, so walking it
+    // backwards refits children first.
+    std::vector<std::int32_t> order;
+    order.reserve(mNodes.size());
+    mStack.clear();
+    mStack.emplace_back(mRoot, 0);
+    while(!mStack.empty())
+    {
+        auto node = mStack.back().first;
+        mStack.pop_back();
+        if(mNodes[node].isLeaf())
+            continue;
+        order.push_back(node);
+        mStack.emplace_back(mNodes[node].left, 0);
+        mStack.emplace_back(mNodes[node].right, 0);
+    }
+
+    for(auto i = order.rbegin(); i != order.rend(); i++)
+    {
+        auto &node = mNodes[*i];
+        node.bounds = AABB::merge(mNodes[node.left].bounds,
+                                  mNodes[node.right].bounds);
+        node.height = 1 + std::max(mNodes[node.left].height,
+                                   mNodes[node.right].height);
+    }
+}
+
+void Bvh::rebuild()
+{
+    std::vector<std::int32_t> leaves;
+    leaves.reserve(mNumLeaves);
+    std::vector<glm::vec3> centroids(mNodes.size());
+    for(std::int32_t i = 0; i < static_cast<std::int32_t>(mNodes.size()); i++)
+    {
+        if(mNodes[i].height == 0)
+        {
+            leaves.push_back(i);
+            centroids[i] = mNodes[i].bounds.getCenter();
+        }
+    }
+
+    // A tree of n leaves has 2n - 1 nodes.
+    std::vector<Node> nodes;
+    nodes.reserve(leaves.empty() ? 0 : 2 * leaves.size() - 1);
+    mRoot = leaves.empty() ? NULL_NODE
+        : build(nodes, leaves, centroids, 0, leaves.size());
+    mNodes = std::move(nodes);
+    mFreeList = NULL_NODE;
+    for(std::int32_t i = 0; i < static_cast<std::int32_t>(mNodes.size()); i++)
+        if(mNodes[i].isLeaf())
+            mProxies[mNodes[i].proxy] = i;
+}
+
+void Bvh::queryFrustum(const Frustum &frustum,
+                       std::vector<std::uint32_t> &visible) const
+{
+    mNumVisited = 0;
+    if(mRoot == NULL_NODE)
+        return;
+
+    // Each entry carries a mask of the planes its node is not yet known to
+    // be inside of. Children of a node inside a plane never test it again.
+    constexpr std::uint32_t ALL_PLANES = (1 << 6) - 1;
+    std::array<glm::vec3, 6> normals, absNormals;
+    for(int i = 0; i < 6; i++)
+    {
+        normals[i] = glm::vec3(frustum.planes[i]);
+        absNormals[i] = glm::abs(normals[i]);
+    }
+
+    mStack.clear();
+    mStack.emplace_back(mRoot, ALL_PLANES);
+    while(!mStack.empty())
+    {
+        auto [index, mask] = mStack.back();
+        mStack.pop_back();
+        mNumVisited++;
+        const auto &node = mNodes[index];
+
+        if(mask != 0)
+        {
+            auto c = node.bounds.getCenter();
+            auto e = node.bounds.getExtents();
+            bool outside = false;
+            for(int i = 0; i < 6 && !outside; i++)
+            {
+                if((mask & (1 << i)) == 0)
+                    continue;
+                float dist = glm::dot(normals[i], c) + frustum.planes[i].w;
+                float radius = glm::dot(absNormals[i], e);
+                if(dist + radius < 0.f)
+                    outside = true;
+                else if(dist - radius >= 0.f)
+                    mask &= ~(1 << i);
+            }
+            if(outside)
+                continue;
+        }
+
+        if(node.isLeaf())
+            visible.push_back(node.userData);
+        else
+        {
+            // Left first, it is usually the next node in memory.
+            mStack.emplace_back(node.right, mask);
+            mStack.emplace_back(node.left, mask);
+        }
+    }
+}
+
+void Bvh::queryOverlap(const AABB &bounds,
+                       std::vector<std::uint32_t> &result) const
+{
+    mNumVisited = 0;
+    if(mRoot == NULL_NODE)
+        return;
+
+    mStack.clear();
+    mStack.emplace_back(mRoot, 0);
+    while(!mStack.empty())
+    {
+        const auto &node = mNodes[mStack.back().first];
+        mStack.pop_back();
+        mNumVisited++;
+        if(!node.bounds.overlaps(bounds))
+            continue;
+
+        if(node.isLeaf())
+            result.push_back(node.userData);
+        else
+        {
+            mStack.emplace_back(node.right, 0);
+            mStack.emplace_back(node.left, 0);
+        }
+    }
+}
+
+bool Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                  RayHit &hit, float maxDistance) const
+{
+    mNumVisited = 0;
+    if(mRoot == NULL_NODE)
+        return false;
+
+    glm::vec3 invDirection = 1.f / direction;
+    float closest = maxDistance;
+    bool found = false;
+
+    float t = 0.f;
+    mStack.clear();
+    if(intersectRay(mNodes[mRoot].bounds, origin, invDirection, closest, t))
+        mStack.emplace_back(mRoot, 0);
+    while(!mStack.empty())
+    {
+        auto index = mStack.back().first;
+        mStack.pop_back();
+        mNumVisited++;
+        const auto &node = mNodes[index];
+
+        if(node.isLeaf())
+        {
+            if(intersectRay(node.bounds, origin, invDirection, closest, t))
+            {
+                closest = t;
+                hit.userData = node.userData;
+                hit.distance = t;
+                found = true;
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so that the farther one is more
+        // likely to be skipped.
+        float tLeft = 0.f, tRight = 0.f;
+        bool hitLeft = intersectRay(mNodes[node.left].bounds, origin,
+                                    invDirection, closest, tLeft);
+        bool hitRight = intersectRay(mNodes[node.right].bounds, origin,
+                                     invDirection, closest, tRight);
+        if(hitLeft && hitRight)
+        {
+            bool leftFirst = tLeft <= tRight;
+            mStack.emplace_back(leftFirst ? node.right : node.left, 0);
+            mStack.emplace_back(leftFirst ? node.left : node.right, 0);
+        }
+        else if(hitLeft)
+            mStack.emplace_back(node.left, 0);
+        else if(hitRight)
+            mStack.emplace_back(node.right, 0);
+    }
+    return found;
+}
+
+int Bvh::getHeight() const
+{
+    return mRoot == NULL_NODE ? 0 : mNodes[mRoot].height + 1;
+}
+
+float Bvh::getAreaRatio() const
+{
+    if(mRoot == NULL_NODE)
+        return 0.f;
+
+    float total = 0.f;
+    for(const auto &node : mNodes)
+        if(node.height > 0)
+            total += node.bounds.getSurfaceArea();
+    float rootArea = mNodes[mRoot].bounds.getSurfaceArea();
+    return rootArea > 0.f ? total / rootArea : 0.f;
+}
+
+std::int32_t Bvh::allocateNode()
+{
+    if(mFreeList == NULL_NODE)
+    {
+        mNodes.emplace_back();
+        return static_cast<std::int32_t>(mNodes.size() - 1);
+    }
+
+    auto node = mFreeList;
+    mFreeList = mNodes[node].parent;
+    mNodes[node] = Node();
+    return node;
+}
+
+void Bvh::freeNode(std::int32_t node)
+{
+    mNodes[node].parent = mFreeList;
+    mNodes[node].left = NULL_NODE;
+    mNodes[node].right = NULL_NODE;
+    mNodes[node].height = -1;
+    mFreeList = node;
+}
+
+void Bvh::insertLeaf(std::int32_t leaf)
+{
+    if(mRoot == NULL_NODE)
+    {
+        mRoot = leaf;
+        mNodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // Walk down to the best sibling. Making a node the sibling costs the
+    // area of the new parent, and every ancestor on the way grows by the
+    // leaf's box (the inherited cost).
+    const auto box = mNodes[leaf].bounds;
+    auto index = mRoot;
+    while(!mNodes[index].isLeaf())
+    {
+        const auto &node = mNodes[index];
+        float area = node.bounds.getSurfaceArea();
+        float combinedArea = AABB::merge(node.bounds, box).getSurfaceArea();
+        float cost = 2.f * combinedArea;
+        float inheritedCost = 2.f * (combinedArea - area);
+
+        auto childCost = [&](std::int32_t child)
+        {
+            const auto &childBounds = mNodes[child].bounds;
+            float merged = AABB::merge(childBounds, box).getSurfaceArea();
+            if(mNodes[child].isLeaf())
+                return merged + inheritedCost;
+            return merged - childBounds.getSurfaceArea() + inheritedCost;
+        };
+        float leftCost = childCost(node.left);
+        float rightCost = childCost(node.right);
+
+        if(cost < leftCost && cost < rightCost)
+            break;
+        index = leftCost < rightCost ? node.left : node.right;
+    }
+
+    auto sibling = index;
+    auto oldParent = mNodes[sibling].parent;
+    auto newParent = allocateNode();
+    mNodes[newParent].parent = oldParent;
+    mNodes[newParent].left = sibling;
+    mNodes[newParent].right = leaf;
+    mNodes[newParent].bounds = AABB::merge(box, mNodes[sibling].bounds);
+    mNodes[newParent].height = mNodes[sibling].height + 1;
+    mNodes[sibling].parent = newParent;
+    mNodes[leaf].parent = newParent;
+
+    if(oldParent == NULL_NODE)
+        mRoot = newParent;
+    else if(mNodes[oldParent].left == sibling)
+        mNodes[oldParent].left = newParent;
+    else
+        mNodes[oldParent].right = newParent;
+
+    fixUpwards(oldParent);
+}
+
+void Bvh::removeLeaf(std::int32_t leaf)
+{
+    if(leaf == mRoot)
+    {
+        mRoot = NULL_NODE;
+        return;
+    }
+
+    // The leaf's sibling takes its parent's place.
+    auto parent = mNodes[leaf].parent;
+    auto grandParent = mNodes[parent].parent;
+    auto sibling = mNodes[parent].left == leaf ? mNodes[parent].right
+        : mNodes[parent].left;
+
+    mNodes[sibling].parent = grandParent;
+    if(grandParent == NULL_NODE)
+        mRoot = sibling;
+    else
+    {
+        if(mNodes[grandParent].left == parent)
+            mNodes[grandParent].left = sibling;
+        else
+            mNodes[grandParent].right = sibling;
+    }
+    freeNode(parent);
+    mNodes[leaf].parent = NULL_NODE;
+    fixUpwards(grandParent);
+}
+
+void Bvh::fixUpwards(std::int32_t node)
+{
+    while(node != NULL_NODE)
+    {
+        auto &n = mNodes[node];
+        n.bounds = AABB::merge(mNodes[n.left].bounds, mNodes[n.right].bounds);
+        n.height = 1 + std::max(mNodes[n.left].height, mNodes[n.right].height);
+        node = n.parent;
+    }
+}
+
+std::int32_t Bvh::build(std::vector<Node> &nodes,
+                        std::vector<std::int32_t> &leaves,
+                        const std::vector<glm::vec3> &centroids,
+                        std::size_t first, std::size_t last)
+{
+    // Nodes are added in preorder, so a node's left child comes right
+    // after it.
+    auto node = static_cast<std::int32_t>(nodes.size());
+    std::size_t count = last - first;
+    if(count == 1)
+    {
+        nodes.push_back(mNodes[leaves[first]]);
+        nodes[node].parent = NULL_NODE;
+        return node;
+    }
+    nodes.emplace_back();
+
+    AABB centroidBounds;
+    for(auto i = first; i < last; i++)
+        centroidBounds.expand(centroids[leaves[i]]);
+    auto size = centroidBounds.max - centroidBounds.min;
+    int axis = 0;
+    if(size.y > size[axis])
+        axis = 1;
+    if(size.z > size[axis])
+        axis = 2;
+
+    auto begin = leaves.begin() + first;
+    auto end = leaves.begin() + last;
+    auto middle = begin;
+    if(size[axis] > 0.f)
+    {
+        // Sort the centroids into equal buckets along the axis, then split
+        // between the two buckets where the sum of each side's area times
+        // its number of leaves is lowest.
+        std::array<AABB, NUM_BINS> binBounds;
+        std::array<std::size_t, NUM_BINS> binCounts{};
+        float scale = NUM_BINS / size[axis];
+        auto binOf = [&](std::int32_t leaf)
+        {
+            int bin = static_cast<int>((centroids[leaf][axis]
+                                        - centroidBounds.min[axis]) * scale);
+            return std::min(bin, NUM_BINS - 1);
+        };
+        for(auto i = first; i < last; i++)
+        {
+            int bin = binOf(leaves[i]);
+            binBounds[bin].expand(mNodes[leaves[i]].bounds);
+            binCounts[bin]++;
+        }
+
+        // rightCosts[i] is the cost of the buckets after split i.
+        std::array<float, NUM_BINS - 1> rightCosts;
+        AABB side;
+        std::size_t sideCount = 0;
+        for(int i = NUM_BINS - 1; i > 0; i--)
+        {
+            side.expand(binBounds[i]);
+            sideCount += binCounts[i];
+            rightCosts[i - 1] = sideCount == 0 ? 0.f
+                : side.getSurfaceArea() * sideCount;
+        }
+
+        int bestSplit = -1;
+        float bestCost = std::numeric_limits<float>::max();
+        side = AABB();
+        sideCount = 0;
+        for(int i = 0; i < NUM_BINS - 1; i++)
+        {
+            side.expand(binBounds[i]);
+            sideCount += binCounts[i];
+            if(sideCount == 0 || sideCount == count)
+                continue;
+            float cost = side.getSurfaceArea() * sideCount + rightCosts[i];
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        if(bestSplit >= 0)
+            middle = std::partition(begin, end, [&](std::int32_t leaf)
+            {
+                return binOf(leaf) <= bestSplit;
+            });
+    }
+
+    // Every centroid in one place, or in one bucket: split in half.
+    if(middle == begin || middle == end)
+    {
+        middle = begin + count / 2;
+        std::nth_element(begin, middle, end, [&](std::int32_t a, std::int32_t b)
+        {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+    }
+
+    std::size_t mid = first + (middle - begin);
+    auto left = build(nodes, leaves, centroids, first, mid);
+    auto right = build(nodes, leaves, centroids, mid, last);
+
+    nodes[node].parent = NULL_NODE;
+    nodes[node].left = left;
+    nodes[node].right = right;
+    nodes[node].bounds = AABB::merge(nodes[left].bounds, nodes[right].bounds);
+    nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+    nodes[left].parent = node;
+    nodes[right].parent = node;
+    return node;
+}
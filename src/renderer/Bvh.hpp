@@ -0,0 +1,153 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+#include "Bounds.hpp"
+
+struct Frustum;
+
+// Result of Bvh::raycast().
+struct RayHit
+{
+    // User data of the box that was hit.
+    std::uint32_t userData = 0;
+    // Distance along the ray, in units of the ray's direction.
+    float distance = std::numeric_limits<float>::infinity();
+};
+
+// Dynamic bounding volume hierarchy over world space boxes, with one box
+// (proxy) per leaf. The tree can be built all at once with a binned surface
+// area heuristic, and is kept up to date by inserting and removing leaves
+// one at a time or by refitting the boxes of the inner nodes after leaves
+// have moved. A build also lays the nodes out depth first, so queries walk
+// memory mostly forwards.
+class Bvh
+{
+public:
+    static constexpr std::int32_t NULL_NODE = -1;
+
+    Bvh() = default;
+    Bvh(const Bvh &) = delete;
+    ~Bvh() = default;
+
+    // Remove every proxy.
+    void clear();
+
+    // Add a box to the tree, choosing its sibling by the increase in
+    // surface area. Returns the proxy, which stays valid until removed.
+    std::int32_t insert(const AABB &bounds, std::uint32_t userData);
+
+    // Remove a proxy from the tree.
+    void remove(std::int32_t proxy);
+
+    // Change the box of a proxy. By default the leaf is reinserted, which
+    // keeps the tree good when objects move far. With reinsert false only
+    // the boxes of its ancestors are grown or shrunk to fit.
+    void update(std::int32_t proxy, const AABB &bounds, bool reinsert = true);
+
+    // Recompute the box of every inner node from its children.
+    void refit();
+
+    // Throw away the inner nodes and build them again top down with the
+    // binned surface area heuristic. Proxies are kept.
+    void rebuild();
+
+    // Append the user data of every box at least partly inside frustum to
+    // visible. Subtrees outside a plane are skipped, and subtrees inside
+    // every plane are accepted without testing their leaves.
+    void queryFrustum(const Frustum &frustum,
+                      std::vector<std::uint32_t> &visible) const;
+
+    // Append the user data of every box that overlaps bounds to result.
+    void queryOverlap(const AABB &bounds,
+                      std::vector<std::uint32_t> &result) const;
+
+    // Find the closest box hit by the ray origin + t * direction, with
+    // 0 <= t <= maxDistance. Returns false if nothing is hit.
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                 RayHit &hit,
+                 float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+    const AABB &getBounds(std::int32_t proxy) const
+    {
+        return mNodes[mProxies[proxy]].bounds;
+    }
+
+    std::uint32_t getUserData(std::int32_t proxy) const
+    {
+        return mNodes[mProxies[proxy]].userData;
+    }
+
+    // Number of proxies.
+    std::size_t size() const
+    {
+        return mNumLeaves;
+    }
+
+    // Number of nodes on the longest path from the root to a leaf, 0 when
+    // empty.
+    int getHeight() const;
+
+    // Sum of the surface areas of the inner nodes divided by that of the
+    // root. Lower is better.
+    float getAreaRatio() const;
+
+    // Number of nodes visited by the last query.
+    std::size_t getNumVisited() const
+    {
+        return mNumVisited;
+    }
+
+private:
+    struct Node
+    {
+        AABB bounds;
+        // Next free node when the node is on the free list.
+        std::int32_t parent = NULL_NODE;
+        std::int32_t left = NULL_NODE;
+        std::int32_t right = NULL_NODE;
+        std::uint32_t userData = 0;
+        std::int32_t proxy = NULL_NODE;
+        // Leaves are at height 0, free nodes at -1.
+        std::int32_t height = -1;
+
+        bool isLeaf() const
+        {
+            return left == NULL_NODE;
+        }
+    };
+
+    std::vector<Node> mNodes;
+    // Node of each proxy, or the next free proxy.
+    std::vector<std::int32_t> mProxies;
+    std::int32_t mFreeProxies = NULL_NODE;
+    std::int32_t mRoot = NULL_NODE;
+    std::int32_t mFreeList = NULL_NODE;
+    std::size_t mNumLeaves = 0;
+    mutable std::size_t mNumVisited = 0;
+    // Traversal stack of nodes and, for frustum queries, the planes each
+    // still has to be tested against.
+    mutable std::vector<std::pair<std::int32_t, std::uint32_t>> mStack;
+
+    std::int32_t allocateNode();
+    void freeNode(std::int32_t node);
+    void insertLeaf(std::int32_t leaf);
+    void removeLeaf(std::int32_t leaf);
+    // Recompute the boxes and heights from node up to the root.
+    void fixUpwards(std::int32_t node);
+    // Build a subtree over the old leaves[first, last) into nodes, returns
+    // its root.
+    std::int32_t build(std::vector<Node> &nodes,
+                       std::vector<std::int32_t> &leaves,
+                       const std::vector<glm::vec3> &centroids,
+                       std::size_t first, std::size_t last);
+};
+
+#endif /* BVH_HPP */
@@ -28,6 +28,15 @@ void Camera::updateCameraVectors()
     mUp = glm::normalize(glm::cross(mRight, mFront));
 }
 
+glm::vec3 Camera::getRayDirection(float ndcX, float ndcY,
+                                  const glm::mat4 &projection) const
+{
+    // Unproject the point on the far plane back to world space.
+    auto inverse = glm::inverse(projection * getViewMatrix());
+    auto far = inverse * glm::vec4(ndcX, ndcY, 1.f, 1.f);
+    return glm::normalize(glm::vec3(far) / far.w - mPosition);
+}
+
 void Camera::processMouseScroll(float yoffset)
 {
     mZoom -= yoffset;
@@ -57,6 +57,11 @@ public:
         return glm::perspective(mZoom, aspect, near, far);
     }
 
+    // Direction of the ray from the camera through a point on the screen,
+    // given in normalized device coordinates, for projection.
+    glm::vec3 getRayDirection(float ndcX, float ndcY,
+                              const glm::mat4 &projection) const;
+
     // Get camera position.
     inline glm::vec3 getPosition() const
     {
@@ -0,0 +1,137 @@
+#include "ComputePipeline.hpp"
+
+#include <vector>
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool isImageType(GLint type)
+    {
+        // The image types are numbered contiguously from GL_IMAGE_1D up to
+        // GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY.
+        return type >= GL_IMAGE_1D &&
+            type <= GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY;
+    }
+
+    std::string getResourceName(std::uint32_t program, GLenum interface,
+                                GLuint index)
+    {
+        GLint length = 0;
+        const GLenum prop = GL_NAME_LENGTH;
+        GLCall(glGetProgramResourceiv(program, interface, index, 1, &prop, 1,
+                                      nullptr, &length));
+        std::string name(static_cast<std::size_t>(std::max(length, 1)), '\0');
+        GLCall(glGetProgramResourceName(program, interface, index, length,
+                                        nullptr, name.data()));
+        name.resize(std::char_traits<char>::length(name.c_str()));
+        return name;
+    }
+
+    const fs::path &checkIsCompute(const fs::path &path)
+    {
+        if(Shader::getShaderType(path) != GL_COMPUTE_SHADER)
+            throw std::invalid_argument(fmt::format("{} is not a compute shader",
+                                                    path.generic_string()));
+        return path;
+    }
+}
+
+ComputePipeline::ComputePipeline(const fs::path &path,
+                                 const ShaderDefines &defines)
+    : mShader(std::make_unique<Shader>(std::vector<fs::path>{checkIsCompute(path)},
+                                       defines)),
+      mWorkGroupSize(1),mStorageBindings(),mImageUnits()
+{
+    auto program = mShader->getProgramID();
+
+    GLint size[3] = {1, 1, 1};
+    GLCall(glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, size));
+    mWorkGroupSize = glm::uvec3(size[0], size[1], size[2]);
+
+    GLint numBlocks = 0;
+    GLCall(glGetProgramInterfaceiv(program, GL_SHADER_STORAGE_BLOCK,
+                                   GL_ACTIVE_RESOURCES, &numBlocks));
+    for(GLint i = 0; i < numBlocks; i++)
+    {
+        GLCall(glShaderStorageBlockBinding(program, i, i));
+        mStorageBindings.emplace(getResourceName(program, GL_SHADER_STORAGE_BLOCK, i),
+                                 static_cast<std::uint32_t>(i));
+    }
+
+    GLint numUniforms = 0;
+    GLCall(glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES,
+                                   &numUniforms));
+    std::uint32_t unit = 0;
+    for(GLint i = 0; i < numUniforms; i++)
+    {
+        const GLenum props[] = {GL_TYPE, GL_LOCATION};
+        GLint values[2] = {};
+        GLCall(glGetProgramResourceiv(program, GL_UNIFORM, i, 2, props, 2,
+                                      nullptr, values));
+        if(!isImageType(values[0]) || values[1] < 0)
+            continue;
+        GLCall(glProgramUniform1i(program, values[1], unit));
+        mImageUnits.emplace(getResourceName(program, GL_UNIFORM, i), unit++);
+    }
+}
+
+void ComputePipeline::bindStorage(const std::string &name, std::uint32_t buffer,
+                                  GLintptr offset, GLsizeiptr size)
+{
+    auto binding = getBinding(mStorageBindings, name, "storage block");
+    if(size == 0)
+    {
+        GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer));
+    }
+    else
+    {
+        GLCall(glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer,
+                                 offset, size));
+    }
+}
+
+void ComputePipeline::bindImage(const std::string &name, std::uint32_t texture,
+                                GLint level, GLenum access, GLenum format)
+{
+    auto unit = getBinding(mImageUnits, name, "image");
+    GLCall(glBindImageTexture(unit, texture, level, GL_TRUE, 0, access, format));
+}
+
+void ComputePipeline::dispatch(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+{
+    mShader->bind();
+    GLCall(glDispatchCompute(x, y, z));
+}
+
+void ComputePipeline::dispatchThreads(std::uint32_t x, std::uint32_t y,
+                                      std::uint32_t z)
+{
+    auto groups = [](std::uint32_t n, std::uint32_t size)
+    {
+        return (n + size - 1) / size;
+    };
+    dispatch(groups(x, mWorkGroupSize.x), groups(y, mWorkGroupSize.y),
+             groups(z, mWorkGroupSize.z));
+}
+
+void ComputePipeline::dispatchIndirect(std::uint32_t buffer, GLintptr offset)
+{
+    mShader->bind();
+    GLCall(glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer));
+    GLCall(glDispatchComputeIndirect(offset));
+    GLCall(glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0));
+}
+
+std::uint32_t ComputePipeline::getBinding(
+    const std::unordered_map<std::string, std::uint32_t> &bindings,
+    const std::string &name, const char *kind) const
+{
+    auto it = bindings.find(name);
+    if(it == bindings.end())
+        throw std::invalid_argument(fmt::format("Compute shader has no active {} \"{}\"",
+                                                kind, name));
+    return it->second;
+}
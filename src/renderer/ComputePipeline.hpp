@@ -0,0 +1,102 @@
+#ifndef COMPUTE_PIPELINE_HPP
+#define COMPUTE_PIPELINE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+#include "Shader.hpp"
+#include "StorageBuffer.hpp"
+
+// Memory barriers that can be placed after a dispatch, named after the way
+// the written data is read afterwards.
+enum class Barrier : GLbitfield
+{
+    Storage = GL_SHADER_STORAGE_BARRIER_BIT,
+    ImageAccess = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT,
+    TextureFetch = GL_TEXTURE_FETCH_BARRIER_BIT,
+    Command = GL_COMMAND_BARRIER_BIT,
+    VertexAttrib = GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT,
+    ElementArray = GL_ELEMENT_ARRAY_BARRIER_BIT,
+    Uniform = GL_UNIFORM_BARRIER_BIT,
+    BufferUpdate = GL_BUFFER_UPDATE_BARRIER_BIT,
+    AtomicCounter = GL_ATOMIC_COUNTER_BARRIER_BIT,
+    Framebuffer = GL_FRAMEBUFFER_BARRIER_BIT,
+    All = GL_ALL_BARRIER_BITS,
+};
+
+inline Barrier operator|(Barrier lhs, Barrier rhs)
+{
+    return static_cast<Barrier>(static_cast<GLbitfield>(lhs) |
+                                static_cast<GLbitfield>(rhs));
+}
+
+// A compute shader program. Shader storage blocks and image uniforms get a
+// binding point each when the program is created, so buffers and images
+// are bound by their names in the shader.
+class ComputePipeline
+{
+public:
+    ComputePipeline(const std::filesystem::path &path,
+                    const ShaderDefines &defines = {});
+    ComputePipeline(const ComputePipeline &) = delete;
+    ~ComputePipeline() = default;
+
+    // Bind buffer to the shader storage block called name. A size of 0
+    // binds the whole buffer.
+    void bindStorage(const std::string &name, std::uint32_t buffer,
+                     GLintptr offset = 0, GLsizeiptr size = 0);
+
+    template<typename T>
+    void bindStorage(const std::string &name, const StorageBuffer<T> &buffer)
+    {
+        bindStorage(name, buffer.getID());
+    }
+
+    // Bind level of texture to the image uniform called name.
+    void bindImage(const std::string &name, std::uint32_t texture,
+                   GLint level, GLenum access, GLenum format);
+
+    // Bind the program and launch x * y * z work groups.
+    void dispatch(std::uint32_t x, std::uint32_t y = 1, std::uint32_t z = 1);
+
+    // Launch enough work groups to cover x * y * z invocations.
+    void dispatchThreads(std::uint32_t x, std::uint32_t y = 1,
+                         std::uint32_t z = 1);
+
+    // Bind the program and launch the work groups described by the
+    // DispatchIndirectCommand at offset in buffer.
+    void dispatchIndirect(std::uint32_t buffer, GLintptr offset = 0);
+
+    static void barrier(Barrier barriers)
+    {
+        GLCall(glMemoryBarrier(static_cast<GLbitfield>(barriers)));
+    }
+
+    glm::uvec3 getWorkGroupSize() const
+    {
+        return mWorkGroupSize;
+    }
+
+    Shader &getShader()
+    {
+        return *mShader;
+    }
+
+private:
+    // Look up the binding point of a storage block or image uniform.
+    std::uint32_t getBinding(const std::unordered_map<std::string, std::uint32_t> &bindings,
+                             const std::string &name, const char *kind) const;
+
+    std::unique_ptr<Shader> mShader;
+    glm::uvec3 mWorkGroupSize;
+    std::unordered_map<std::string, std::uint32_t> mStorageBindings;
+    std::unordered_map<std::string, std::uint32_t> mImageUnits;
+};
+
+#endif /* COMPUTE_PIPELINE_HPP */
@@ -21,7 +21,7 @@ public:
 
         GLCall(glCreateBuffers(1, &mId));
         GLCall(glNamedBufferStorage(mId, sizeof(T) * vertices.size(),
-                                    vertices.data(), GL_DYNAMIC_STORAGE_BIT));
+                                    vertices.data(), 0));
         GLCall(glVertexArrayVertexBuffer(vaoId, index, mId, 0, sizeof(T)););
 
         GLCall(glEnableVertexArrayAttrib(vaoId, index));
@@ -64,7 +64,7 @@ public:
         
         GLCall(glCreateBuffers(1, &mId));
         GLCall(glNamedBufferStorage(mId, sizeof(interleavedType) * vertices.size(),
-                                    vertices.data(), GL_DYNAMIC_STORAGE_BIT));
+                                    vertices.data(), 0));
         // First 0, might be something else.
         GLCall(glVertexArrayVertexBuffer(vaoId, positionIndex, mId, 0, sizeof(interleavedType)));
 
@@ -99,7 +99,10 @@ public:
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    virtual ~ConstantBuffer() = default;
+    virtual ~ConstantBuffer()
+    {
+        glres::deleteLater(GLObject::Buffer, mId);
+    }
 
 protected:
     std::uint32_t mCountVertices;
@@ -0,0 +1,79 @@
+#include "DeferredRenderer.hpp"
+
+#include <string>
+#include <vector>
+
+#include "glutil.hpp"
+#include "LightClusters.hpp"
+#include "renderer.hpp"
+
+DeferredRenderer::DeferredRenderer(std::uint32_t numDirLights)
+    : mLighting(std::vector<std::filesystem::path>{"shader/deferred.vert",
+                                                    "shader/deferred.frag"},
+                ShaderDefines{{"NUM_DIR_LIGHTS", std::to_string(numDirLights)}}),
+      mEmptyVao(),mGBuffer()
+{
+    GLCall(glCreateVertexArrays(1, mEmptyVao.put()));
+}
+
+void DeferredRenderer::beginGeometry()
+{
+    GLint viewport[4] = {};
+    GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+    RenderTargetDesc desc;
+    desc.width = viewport[2];
+    desc.height = viewport[3];
+    // Octahedral normals need signed values. Specular color, and shininess
+    // over MAX_SHININESS in alpha.
+    desc.colorFormats = {GL_RGBA8, GL_RG16_SNORM, GL_RGBA8};
+    desc.depthFormat = GL_DEPTH24_STENCIL8;
+    mGBuffer = rndr::getTargetPool().acquire(desc);
+
+    auto framebuffer = mGBuffer->getFramebuffer();
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+    const float zero[4] = {};
+    const float one = 1.f;
+    GLCall(glClearNamedFramebufferfv(framebuffer, GL_COLOR, 0, zero));
+    GLCall(glClearNamedFramebufferfv(framebuffer, GL_COLOR, 1, zero));
+    GLCall(glClearNamedFramebufferfv(framebuffer, GL_COLOR, 2, zero));
+    GLCall(glClearNamedFramebufferfi(framebuffer, GL_DEPTH_STENCIL, 0, one, 0));
+}
+
+void DeferredRenderer::light(const glm::mat4 &view, const glm::mat4 &projection,
+                             const glm::vec3 &viewPos, const LightClusters &lights)
+{
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, rndr::getFramebuffer()));
+    int width = mGBuffer->getDesc().width;
+    int height = mGBuffer->getDesc().height;
+
+    mLighting.set("uInverseViewProjection", glm::inverse(projection * view));
+    mLighting.set("uViewMatrix", view);
+    mLighting.set("uViewPos", viewPos);
+    lights.bind(mLighting, static_cast<float>(width), static_cast<float>(height));
+    GLCall(glBindTextureUnit(ALBEDO_TEXTURE_UNIT, mGBuffer->getColorTexture(0)));
+    GLCall(glBindTextureUnit(NORMAL_TEXTURE_UNIT, mGBuffer->getColorTexture(1)));
+    GLCall(glBindTextureUnit(SPECULAR_TEXTURE_UNIT, mGBuffer->getColorTexture(2)));
+    GLCall(glBindTextureUnit(DEPTH_TEXTURE_UNIT, mGBuffer->getDepthTexture()));
+
+    // Every pixel is lit once, whatever is already in the depth buffer.
+    GLCall(glDisable(GL_DEPTH_TEST));
+    GLCall(glDepthMask(GL_FALSE));
+    mLighting.bind();
+    GLCall(glBindVertexArray(mEmptyVao.get()));
+    GLCall(glDrawArrays(GL_TRIANGLES, 0, 3));
+    GLCall(glBindVertexArray(0));
+    GLCall(glDepthMask(GL_TRUE));
+    GLCall(glEnable(GL_DEPTH_TEST));
+
+    for(auto unit : {ALBEDO_TEXTURE_UNIT, NORMAL_TEXTURE_UNIT,
+                     SPECULAR_TEXTURE_UNIT, DEPTH_TEXTURE_UNIT})
+    {
+        GLCall(glBindTextureUnit(unit, 0));
+    }
+
+    // Both are DEPTH24_STENCIL8, so the depth can be blitted as is.
+    GLCall(glBlitNamedFramebuffer(mGBuffer->getFramebuffer(), rndr::getFramebuffer(),
+                                  0, 0, width, height, 0, 0, width, height,
+                                  GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+    mGBuffer.reset();
+}
@@ -0,0 +1,70 @@
+#ifndef DEFERRED_RENDERER_HPP
+#define DEFERRED_RENDERER_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "Shader.hpp"
+#include "GLResource.hpp"
+#include "RenderTarget.hpp"
+
+class LightClusters;
+
+// Deferred shading, the alternative to lighting every fragment as it is
+// drawn. The geometry is first drawn with the GBUFFER variant of main.frag
+// into a G-buffer holding the albedo, the octahedral encoded normal, the
+// specular color and shininess, and the depth of every pixel. A full
+// screen pass then lights every visible pixel once with the directional
+// lights and the lights of a LightClusters, so overdraw costs no lighting.
+//
+// The G-buffer takes 12 bytes of color and 4 of depth per pixel, which the
+// lighting pass reads back in full, so forward shading is usually faster
+// with few lights or little overdraw.
+class DeferredRenderer
+{
+public:
+    // Texture units the G-buffer is read from by the lighting pass.
+    static constexpr std::uint32_t ALBEDO_TEXTURE_UNIT = 0;
+    static constexpr std::uint32_t NORMAL_TEXTURE_UNIT = 1;
+    static constexpr std::uint32_t SPECULAR_TEXTURE_UNIT = 2;
+    static constexpr std::uint32_t DEPTH_TEXTURE_UNIT = 3;
+
+    DeferredRenderer(std::uint32_t numDirLights);
+    DeferredRenderer(const DeferredRenderer &) = delete;
+    ~DeferredRenderer() = default;
+
+    // Bind and clear a G-buffer the size of the viewport, taken from
+    // rndr::getTargetPool() until light(). The geometry drawn next must use
+    // the GBUFFER variant of main.frag.
+    void beginGeometry();
+
+    // Light the G-buffer into rndr::getFramebuffer() as seen from view
+    // and projection, and copy its depth there so that later passes can
+    // test against it. The G-buffer goes back to the pool.
+    void light(const glm::mat4 &view, const glm::mat4 &projection,
+               const glm::vec3 &viewPos, const LightClusters &lights);
+
+    // The shader of the lighting pass, whose uDirLights are set by the
+    // caller.
+    Shader &getLightingShader()
+    {
+        return mLighting;
+    }
+
+    // The G-buffer's framebuffer between beginGeometry() and light(), 0
+    // otherwise.
+    std::uint32_t getFramebuffer() const
+    {
+        return mGBuffer ? mGBuffer->getFramebuffer() : 0;
+    }
+
+private:
+    Shader mLighting;
+    // Draws the full screen triangle, which has no vertex attributes.
+    VertexArrayHandle mEmptyVao;
+    // Albedo, normal and specular color attachments, and depth.
+    PooledTarget mGBuffer;
+};
+
+#endif /* DEFERRED_RENDERER_HPP */
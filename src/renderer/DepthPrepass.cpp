@@ -0,0 +1,74 @@
+#include "DepthPrepass.hpp"
+
+#include <vector>
+#include <filesystem>
+
+#include "glext.hpp"
+#include "glutil.hpp"
+
+DepthPrepass::DepthPrepass()
+    : mShader(std::vector<std::filesystem::path>{"shader/depth.vert",
+                                                  "shader/depth.frag"}),
+      mQueryTarget(glext::hasPipelineStatistics() ?
+                   GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED),
+      mQueries(),mPending(),mFrame(0),mStats()
+{
+    mStats.pipelineStatistics = glext::hasPipelineStatistics();
+    for(auto &queries : mQueries)
+    {
+        for(auto &query : queries)
+            GLCall(glCreateQueries(mQueryTarget, 1, query.put()));
+    }
+}
+
+void DepthPrepass::beginDepth()
+{
+    // The queries of this slot were issued NUM_FRAMES frames ago.
+    readResults(mFrame);
+
+    GLCall(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    GLCall(glDepthMask(GL_TRUE));
+    GLCall(glDepthFunc(GL_LESS));
+    GLCall(glBeginQuery(mQueryTarget, mQueries[mFrame][0].get()));
+}
+
+void DepthPrepass::beginShading()
+{
+    GLCall(glEndQuery(mQueryTarget));
+    GLCall(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+    GLCall(glDepthMask(GL_FALSE));
+    GLCall(glDepthFunc(GL_EQUAL));
+    GLCall(glBeginQuery(mQueryTarget, mQueries[mFrame][1].get()));
+}
+
+void DepthPrepass::end()
+{
+    GLCall(glEndQuery(mQueryTarget));
+    GLCall(glDepthMask(GL_TRUE));
+    GLCall(glDepthFunc(GL_LESS));
+    mPending[mFrame] = true;
+    mFrame = (mFrame + 1) % NUM_FRAMES;
+}
+
+void DepthPrepass::readResults(std::size_t frame)
+{
+    if(!mPending[frame])
+        return;
+    mPending[frame] = false;
+
+    // The shading query ends last, so the depth one is done if it is. A
+    // frame still in flight is skipped rather than waited for.
+    GLint available = GL_FALSE;
+    GLCall(glGetQueryObjectiv(mQueries[frame][1].get(), GL_QUERY_RESULT_AVAILABLE,
+                              &available));
+    if(!available)
+        return;
+
+    GLuint64 depth = 0;
+    GLuint64 shaded = 0;
+    GLCall(glGetQueryObjectui64v(mQueries[frame][0].get(), GL_QUERY_RESULT, &depth));
+    GLCall(glGetQueryObjectui64v(mQueries[frame][1].get(), GL_QUERY_RESULT, &shaded));
+    mStats.depthFragments = depth;
+    mStats.shadedFragments = shaded;
+    mStats.savedFragments = depth > shaded ? depth - shaded : 0;
+}
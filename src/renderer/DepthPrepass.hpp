@@ -0,0 +1,84 @@
+#ifndef DEPTH_PREPASS_HPP
+#define DEPTH_PREPASS_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#include "Shader.hpp"
+#include "GLResource.hpp"
+
+// Fragments counted by the queries of a DepthPrepass.
+struct DepthPrepassStats
+{
+    // Fragments that passed the depth test of the pre-pass, which is what
+    // the shading pass would have run on without it since both draw the
+    // same things in the same order.
+    std::uint64_t depthFragments = 0;
+    // Fragments that were shaded.
+    std::uint64_t shadedFragments = 0;
+    // Fragment shader invocations saved by the pre-pass.
+    std::uint64_t savedFragments = 0;
+    // Whether the counts are fragment shader invocations, otherwise they
+    // are samples that passed the depth test.
+    bool pipelineStatistics = false;
+};
+
+// Depth-only pre-pass. Everything is first drawn with a trivial shader
+// from the position only vertex array of a GeometryHeap with colour writes
+// off, then the shading pass runs with a GL_EQUAL depth test and depth
+// writes off, so the lighting shader runs once per pixel whatever the draw
+// order.
+//
+// Both passes are measured with GL_FRAGMENT_SHADER_INVOCATIONS_ARB queries
+// when GL_ARB_pipeline_statistics_query is present, and GL_SAMPLES_PASSED
+// otherwise. The results are read a few frames late so that the CPU never
+// waits for them.
+class DepthPrepass
+{
+public:
+    DepthPrepass();
+    DepthPrepass(const DepthPrepass &) = delete;
+    ~DepthPrepass() = default;
+
+    // The shader the pre-pass draws with, the MULTI_DRAW counterpart of
+    // the main shaders.
+    Shader &getShader()
+    {
+        return mShader;
+    }
+
+    // Mask off colour writes and start counting the pre-pass.
+    void beginDepth();
+
+    // Restore colour writes, test for depth equality without writing and
+    // start counting the shading pass.
+    void beginShading();
+
+    // Restore the default depth state and stop counting.
+    void end();
+
+    // Counts of the last frame whose queries finished.
+    const DepthPrepassStats &getStats() const
+    {
+        return mStats;
+    }
+
+private:
+    // Frames in flight before a query result is read.
+    static constexpr std::size_t NUM_FRAMES = 3;
+
+    // Read the results of frame if it was measured and the GPU is done
+    // with them.
+    void readResults(std::size_t frame);
+
+    Shader mShader;
+    GLenum mQueryTarget;
+    // Depth and shading query of every frame.
+    std::array<std::array<QueryHandle, 2>, NUM_FRAMES> mQueries;
+    std::array<bool, NUM_FRAMES> mPending;
+    std::size_t mFrame;
+    DepthPrepassStats mStats;
+};
+
+#endif /* DEPTH_PREPASS_HPP */
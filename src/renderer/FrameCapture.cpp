@@ -0,0 +1,276 @@
+#include "FrameCapture.hpp"
+#define STB_IMAGE_WRITE_IMPLEMENTATION 1
+
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fmt/core.h>
+
+#include "glutil.hpp"
+#include "renderer.hpp"
+
+namespace fs = std::filesystem;
+
+void CapturedImage::savePng(const fs::path &path) const
+{
+    const auto &str = path.generic_string();
+    if(!stbi_write_png(str.c_str(), width, height, 4, pixels.data(), width * 4))
+        throw std::runtime_error(fmt::format("Could not write image {}", str));
+}
+
+CapturedImage CapturedImage::loadPng(const fs::path &path)
+{
+    const auto &str = path.generic_string();
+    // Texture::init() flips images for OpenGL, these stay top to bottom.
+    stbi_set_flip_vertically_on_load_thread(false);
+    int width = 0;
+    int height = 0;
+    int numChannels = 0;
+    std::uint8_t *ptr = stbi_load(str.c_str(), &width, &height, &numChannels, 4);
+    if(!ptr)
+        throw std::runtime_error(fmt::format("Could not load image {}: {}", str,
+                                             stbi_failure_reason()));
+
+    CapturedImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(ptr, ptr + static_cast<std::size_t>(width) * height * 4);
+    stbi_image_free(ptr);
+    return image;
+}
+
+ImageDifference compareImages(const CapturedImage &image,
+                              const CapturedImage &reference, int tolerance)
+{
+    ImageDifference result;
+    if(image.width != reference.width || image.height != reference.height)
+    {
+        result.sizeMismatch = true;
+        return result;
+    }
+
+    for(std::size_t i = 0; i < image.pixels.size(); i += 4)
+    {
+        int pixelDifference = 0;
+        for(std::size_t c = i; c < i + 4; c++)
+            pixelDifference = std::max(pixelDifference,
+                                       std::abs(image.pixels[c] - reference.pixels[c]));
+        result.maxDifference = std::max(result.maxDifference, pixelDifference);
+        if(pixelDifference > tolerance)
+            result.numDiffering++;
+    }
+    return result;
+}
+
+FrameCapture::FrameCapture()
+    : mReadbacks(),mPending(),mFree(),mFrame(0),mRecording(false),
+      mRecordDirectory(),mNumRecorded(0),mStats(),mQueue(),mBusy(false),
+      mStop(false),mMutex(),mWake(),mDone(),mWorker()
+{
+    for(std::size_t i = 0; i < NUM_BUFFERS; i++)
+        mFree.push_back(i);
+    mWorker = std::thread(&FrameCapture::work, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    finish();
+    {
+        std::lock_guard lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    mWorker.join();
+}
+
+void FrameCapture::capture(std::uint32_t framebuffer, int x, int y, int width,
+                           int height, Handler handler)
+{
+    if(width <= 0 || height <= 0)
+        throw std::invalid_argument(fmt::format("Cannot capture {}x{} pixels",
+                                                width, height));
+
+    // Every buffer is in flight, the oldest has to be done before reuse.
+    if(mFree.empty())
+    {
+        collect(true);
+        mStats.stalls++;
+    }
+    std::size_t index = mFree.front();
+    mFree.pop_front();
+    auto &readback = mReadbacks[index];
+
+    std::size_t size = static_cast<std::size_t>(width) * height * 4;
+    if(readback.size < size)
+    {
+        GLCall(glCreateBuffers(1, readback.buffer.put()));
+        GLCall(glNamedBufferStorage(readback.buffer.get(), size, nullptr,
+                                    GL_MAP_READ_BIT));
+        readback.size = size;
+    }
+
+    GLint readFramebuffer = 0;
+    GLCall(glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer));
+    GLCall(glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer));
+    GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.get()));
+    GLCall(glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    GLCall(glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer));
+    GLCall(readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+    readback.image.width = width;
+    readback.image.height = height;
+    readback.image.frame = mFrame;
+    readback.handler = std::move(handler);
+    mPending.push_back(index);
+    mStats.captures++;
+}
+
+void FrameCapture::capture(Handler handler)
+{
+    GLint viewport[4] = {};
+    GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+    capture(rndr::getFramebuffer(), viewport[0], viewport[1], viewport[2],
+            viewport[3], std::move(handler));
+}
+
+void FrameCapture::saveScreenshot(const fs::path &path)
+{
+    capture([path](CapturedImage &&image)
+    {
+        image.savePng(path);
+        std::cout << "Saved screenshot " << path.generic_string() << '\n';
+    });
+}
+
+void FrameCapture::startRecording(const fs::path &directory)
+{
+    fs::create_directories(directory);
+    mRecordDirectory = directory;
+    mNumRecorded = 0;
+    mRecording = true;
+}
+
+void FrameCapture::stopRecording()
+{
+    mRecording = false;
+}
+
+void FrameCapture::endFrame()
+{
+    if(mRecording)
+    {
+        auto path = mRecordDirectory / fmt::format("frame_{:05}.png", mNumRecorded++);
+        capture([path](CapturedImage &&image)
+        {
+            image.savePng(path);
+        });
+    }
+
+    while(!mPending.empty() && collect(false))
+        ;
+    mFrame++;
+}
+
+void FrameCapture::finish()
+{
+    while(!mPending.empty())
+        collect(true);
+
+    std::unique_lock lock(mMutex);
+    mDone.wait(lock, [this]()
+    {
+        return mQueue.empty() && !mBusy;
+    });
+}
+
+bool FrameCapture::collect(bool wait)
+{
+    std::size_t index = mPending.front();
+    auto &readback = mReadbacks[index];
+    GLenum status = GL_TIMEOUT_EXPIRED;
+    if(wait)
+    {
+        while(status == GL_TIMEOUT_EXPIRED)
+        {
+            GLCall(status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                             1000000000));
+        }
+    }
+    else
+    {
+        GLCall(status = glClientWaitSync(readback.fence, 0, 0));
+    }
+    if(status == GL_TIMEOUT_EXPIRED)
+        return false;
+    GLCall(glDeleteSync(readback.fence));
+    readback.fence = nullptr;
+
+    // OpenGL's rows go from the bottom up, flip them while copying out.
+    auto &image = readback.image;
+    std::size_t rowSize = static_cast<std::size_t>(image.width) * 4;
+    std::size_t size = rowSize * image.height;
+    image.pixels.resize(size);
+    const std::uint8_t *mapped = nullptr;
+    GLCall(mapped = static_cast<const std::uint8_t*>(
+               glMapNamedBufferRange(readback.buffer.get(), 0, size, GL_MAP_READ_BIT)));
+    for(int row = 0; row < image.height; row++)
+        std::memcpy(image.pixels.data() + (image.height - 1 - row) * rowSize,
+                    mapped + row * rowSize, rowSize);
+    GLCall(glUnmapNamedBuffer(readback.buffer.get()));
+
+    {
+        std::unique_lock lock(mMutex);
+        if(mQueue.size() >= MAX_QUEUED)
+        {
+            mStats.stalls++;
+            mDone.wait(lock, [this]()
+            {
+                return mQueue.size() < MAX_QUEUED;
+            });
+        }
+        mQueue.emplace_back(std::move(image), std::move(readback.handler));
+    }
+    mWake.notify_one();
+    readback.image = CapturedImage();
+    readback.handler = nullptr;
+    mPending.pop_front();
+    mFree.push_back(index);
+    return true;
+}
+
+void FrameCapture::work()
+{
+    std::unique_lock lock(mMutex);
+    while(true)
+    {
+        mWake.wait(lock, [this]()
+        {
+            return mStop || !mQueue.empty();
+        });
+        if(mQueue.empty())
+            return;
+
+        auto [image, handler] = std::move(mQueue.front());
+        mQueue.pop_front();
+        mBusy = true;
+        lock.unlock();
+        // There is nobody to throw to on this thread.
+        try
+        {
+            handler(std::move(image));
+        }
+        catch(const std::exception &e)
+        {
+            std::cerr << "Frame capture failed: " << e.what() << '\n';
+        }
+        lock.lock();
+        mBusy = false;
+        mDone.notify_all();
+    }
+}
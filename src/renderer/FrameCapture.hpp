@@ -0,0 +1,162 @@
+#ifndef FRAME_CAPTURE_HPP
+#define FRAME_CAPTURE_HPP
+
+#include <glad/glad.h>
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+#include "GLResource.hpp"
+
+// An RGBA8 image read back from a framebuffer, rows from top to bottom.
+struct CapturedImage
+{
+    int width = 0;
+    int height = 0;
+    // Number of the FrameCapture::endFrame() call the image was taken in.
+    std::uint64_t frame = 0;
+    std::vector<std::uint8_t> pixels;
+
+    // Write the image as a PNG. Throws std::runtime_error on failure.
+    void savePng(const std::filesystem::path &path) const;
+
+    // Read a PNG as RGBA8. Throws std::runtime_error on failure.
+    static CapturedImage loadPng(const std::filesystem::path &path);
+};
+
+// How far an image is from a reference image.
+struct ImageDifference
+{
+    bool sizeMismatch = false;
+    // Pixels with a channel off by more than the tolerance.
+    std::size_t numDiffering = 0;
+    // Largest difference of a channel over the whole image.
+    int maxDifference = 0;
+
+    bool matches() const
+    {
+        return !sizeMismatch && numDiffering == 0;
+    }
+};
+
+// Compare image against reference, channel by channel. A channel differing
+// by up to tolerance counts as equal, to allow for drivers rounding
+// differently.
+ImageDifference compareImages(const CapturedImage &image,
+                              const CapturedImage &reference, int tolerance);
+
+// Number of captures and stalls since a FrameCapture was created.
+struct CaptureStats
+{
+    std::size_t captures = 0;
+    // Captures that had to wait for an older one to finish because every
+    // buffer was in use, or for the worker to catch up.
+    std::size_t stalls = 0;
+};
+
+// Reads framebuffers back without waiting for the GPU.
+//
+// glReadPixels into a pixel pack buffer only queues a copy, so capture()
+// returns at once and a fence is placed after it. endFrame() maps the
+// buffers whose fences have signaled, usually a frame or two later, and
+// hands their images to a worker thread, where the handler of the capture
+// runs. Encoding PNGs or comparing images there keeps it out of the frame.
+//
+// NUM_BUFFERS captures can be in flight, capturing more waits for the
+// oldest, so recording every frame stalls only if the GPU falls that far
+// behind.
+class FrameCapture
+{
+public:
+    static constexpr std::size_t NUM_BUFFERS = 3;
+    // Images read back but not handled yet, past which endFrame() waits
+    // for the worker instead of using more memory.
+    static constexpr std::size_t MAX_QUEUED = 8;
+
+    // Called on the worker thread with every captured image.
+    using Handler = std::function<void(CapturedImage &&)>;
+
+    FrameCapture();
+    FrameCapture(const FrameCapture &) = delete;
+    // Finishes every capture first.
+    ~FrameCapture();
+
+    // Read the width by height pixels at x, y of framebuffer's color.
+    void capture(std::uint32_t framebuffer, int x, int y, int width,
+                 int height, Handler handler);
+
+    // Read the viewport of rndr::getFramebuffer().
+    void capture(Handler handler);
+
+    // Capture the viewport and write it to path once read.
+    void saveScreenshot(const std::filesystem::path &path);
+
+    // Capture every frame into directory as frame_00000.png and so on,
+    // until stopRecording().
+    void startRecording(const std::filesystem::path &directory);
+    void stopRecording();
+
+    bool isRecording() const
+    {
+        return mRecording;
+    }
+
+    // Capture the frame if recording, then pass the finished captures to
+    // the worker thread. Call once a frame, after drawing and before
+    // presenting.
+    void endFrame();
+
+    // Wait for every capture and every handler to be done.
+    void finish();
+
+    const CaptureStats &getStats() const
+    {
+        return mStats;
+    }
+
+private:
+    struct readback
+    {
+        BufferHandle buffer;
+        std::size_t size = 0;
+        GLsync fence = nullptr;
+        CapturedImage image;
+        Handler handler;
+    };
+
+    // Map the buffer of mPending's first readback and queue its image.
+    // If wait is false it is left alone until its fence has signaled, and
+    // false is returned.
+    bool collect(bool wait);
+    void work();
+
+    std::array<readback, NUM_BUFFERS> mReadbacks;
+    // Indices into mReadbacks, oldest first.
+    std::deque<std::size_t> mPending;
+    std::deque<std::size_t> mFree;
+    std::uint64_t mFrame;
+    bool mRecording;
+    std::filesystem::path mRecordDirectory;
+    std::uint64_t mNumRecorded;
+    CaptureStats mStats;
+
+    // Images waiting for the worker, which is busy while mBusy.
+    std::deque<std::pair<CapturedImage, Handler>> mQueue;
+    bool mBusy;
+    bool mStop;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    // Notified whenever the worker has handled an image.
+    std::condition_variable mDone;
+    std::thread mWorker;
+};
+
+#endif /* FRAME_CAPTURE_HPP */
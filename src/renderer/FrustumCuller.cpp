@@ -0,0 +1,211 @@
+#include "FrustumCuller.hpp"
+
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Plane coefficients laid out for the kernels: the normal, its
+    // absolute value and the distance, per plane.
+    struct planeData
+    {
+        float nx[6], ny[6], nz[6];
+        float ax[6], ay[6], az[6];
+        float d[6];
+    };
+
+    planeData getPlaneData(const Frustum &frustum)
+    {
+        planeData p;
+        for(int i = 0; i < 6; i++)
+        {
+            const auto &plane = frustum.planes[i];
+            p.nx[i] = plane.x;
+            p.ny[i] = plane.y;
+            p.nz[i] = plane.z;
+            p.ax[i] = std::abs(plane.x);
+            p.ay[i] = std::abs(plane.y);
+            p.az[i] = std::abs(plane.z);
+            p.d[i] = plane.w;
+        }
+        return p;
+    }
+
+    // A box is outside if, for some plane, its center is farther behind the
+    // plane than the box's projected radius on the plane normal.
+    bool isVisible(const planeData &p, float cx, float cy, float cz,
+                   float ex, float ey, float ez)
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            float dist = p.nx[i] * cx + p.ny[i] * cy + p.nz[i] * cz + p.d[i];
+            float radius = p.ax[i] * ex + p.ay[i] * ey + p.az[i] * ez;
+            if(dist + radius < 0.f)
+                return false;
+        }
+        return true;
+    }
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 &m)
+{
+    // Gribb and Hartmann, for OpenGL clip space (-w <= z <= w).
+    auto row = [&m](int i)
+    {
+        return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+
+    Frustum frustum;
+    frustum.planes[Left] = row(3) + row(0);
+    frustum.planes[Right] = row(3) - row(0);
+    frustum.planes[Bottom] = row(3) + row(1);
+    frustum.planes[Top] = row(3) - row(1);
+    frustum.planes[Near] = row(3) + row(2);
+    frustum.planes[Far] = row(3) - row(2);
+    for(auto &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+bool Frustum::intersects(const AABB &box) const
+{
+    auto c = box.getCenter();
+    auto e = box.getExtents();
+    for(const auto &plane : planes)
+    {
+        glm::vec3 n(plane);
+        if(glm::dot(n, c) + plane.w + glm::dot(glm::abs(n), e) < 0.f)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const
+{
+    for(const auto &plane : planes)
+        if(glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    return true;
+}
+
+void FrustumCuller::clear()
+{
+    mCenterX.clear();
+    mCenterY.clear();
+    mCenterZ.clear();
+    mExtentX.clear();
+    mExtentY.clear();
+    mExtentZ.clear();
+}
+
+std::uint32_t FrustumCuller::add(const AABB &bounds)
+{
+    auto index = static_cast<std::uint32_t>(size());
+    mCenterX.push_back(0.f);
+    mCenterY.push_back(0.f);
+    mCenterZ.push_back(0.f);
+    mExtentX.push_back(0.f);
+    mExtentY.push_back(0.f);
+    mExtentZ.push_back(0.f);
+    set(index, bounds);
+    return index;
+}
+
+void FrustumCuller::set(std::uint32_t index, const AABB &bounds)
+{
+    auto c = bounds.getCenter();
+    auto e = bounds.getExtents();
+    mCenterX[index] = c.x;
+    mCenterY[index] = c.y;
+    mCenterZ[index] = c.z;
+    mExtentX[index] = e.x;
+    mExtentY[index] = e.y;
+    mExtentZ[index] = e.z;
+}
+
+void FrustumCuller::cull(const Frustum &frustum, std::vector<std::uint32_t> &visible)
+{
+    visible.clear();
+    auto p = getPlaneData(frustum);
+    const std::size_t n = size();
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    for(; i + 8 <= n; i += 8)
+    {
+        auto cx = _mm256_loadu_ps(&mCenterX[i]);
+        auto cy = _mm256_loadu_ps(&mCenterY[i]);
+        auto cz = _mm256_loadu_ps(&mCenterZ[i]);
+        auto ex = _mm256_loadu_ps(&mExtentX[i]);
+        auto ey = _mm256_loadu_ps(&mExtentY[i]);
+        auto ez = _mm256_loadu_ps(&mExtentZ[i]);
+        auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int j = 0; j < 6; j++)
+        {
+            auto dist = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.nx[j]), cx),
+                              _mm256_mul_ps(_mm256_set1_ps(p.ny[j]), cy)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.nz[j]), cz),
+                              _mm256_set1_ps(p.d[j])));
+            auto radius = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.ax[j]), ex),
+                              _mm256_mul_ps(_mm256_set1_ps(p.ay[j]), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(p.az[j]), ez));
+            inside = _mm256_and_ps(inside,
+                                   _mm256_cmp_ps(_mm256_add_ps(dist, radius),
+                                                 _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        for(int mask = _mm256_movemask_ps(inside); mask; mask &= mask - 1)
+            visible.push_back(static_cast<std::uint32_t>(i + __builtin_ctz(mask)));
+    }
+#elif defined(__SSE2__)
+    for(; i + 4 <= n; i += 4)
+    {
+        auto cx = _mm_loadu_ps(&mCenterX[i]);
+        auto cy = _mm_loadu_ps(&mCenterY[i]);
+        auto cz = _mm_loadu_ps(&mCenterZ[i]);
+        auto ex = _mm_loadu_ps(&mExtentX[i]);
+        auto ey = _mm_loadu_ps(&mExtentY[i]);
+        auto ez = _mm_loadu_ps(&mExtentZ[i]);
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int j = 0; j < 6; j++)
+        {
+            auto dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.nx[j]), cx),
+                           _mm_mul_ps(_mm_set1_ps(p.ny[j]), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.nz[j]), cz),
+                           _mm_set1_ps(p.d[j])));
+            auto radius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.ax[j]), ex),
+                           _mm_mul_ps(_mm_set1_ps(p.ay[j]), ey)),
+                _mm_mul_ps(_mm_set1_ps(p.az[j]), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, radius),
+                                                     _mm_setzero_ps()));
+        }
+        for(int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1)
+            visible.push_back(static_cast<std::uint32_t>(i + __builtin_ctz(mask)));
+    }
+#endif
+
+    for(; i < n; i++)
+        if(isVisible(p, mCenterX[i], mCenterY[i], mCenterZ[i],
+                     mExtentX[i], mExtentY[i], mExtentZ[i]))
+            visible.push_back(static_cast<std::uint32_t>(i));
+
+    mNumTested = n;
+    mNumVisible = visible.size();
+}
+
+const char *FrustumCuller::getSimdName()
+{
+#if defined(__AVX__)
+    return "AVX";
+#elif defined(__SSE2__)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef FRUSTUM_CULLER_HPP
+#define FRUSTUM_CULLER_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Bounds.hpp"
+
+// The six planes of a view frustum, pointing inwards and normalized, as
+// (normal, distance) with dot(normal, p) + distance >= 0 inside.
+struct Frustum
+{
+    enum Plane { Left, Right, Bottom, Top, Near, Far };
+
+    std::array<glm::vec4, 6> planes;
+
+    // Extract the planes of a projection * view matrix (or projection *
+    // view * model for a frustum in model space).
+    static Frustum fromMatrix(const glm::mat4 &viewProjection);
+
+    bool intersects(const AABB &box) const;
+    bool intersects(const BoundingSphere &sphere) const;
+};
+
+// Frustum culling of many world space boxes at once. The boxes are kept as
+// structure of arrays (center and extents per axis) and tested 8 at a time
+// with AVX or 4 at a time with SSE, depending on what the compiler targets,
+// with a scalar fallback.
+class FrustumCuller
+{
+public:
+    FrustumCuller() = default;
+    FrustumCuller(const FrustumCuller &) = delete;
+    ~FrustumCuller() = default;
+
+    // Remove every box.
+    void clear();
+
+    // Add a box, returns its index.
+    std::uint32_t add(const AABB &bounds);
+
+    // Replace the box at index.
+    void set(std::uint32_t index, const AABB &bounds);
+
+    std::size_t size() const
+    {
+        return mCenterX.size();
+    }
+
+    // Replace the contents of visible with the indices of the boxes that
+    // are at least partly inside frustum, in increasing order.
+    void cull(const Frustum &frustum, std::vector<std::uint32_t> &visible);
+
+    // Number of boxes tested by the last cull().
+    std::size_t getNumTested() const
+    {
+        return mNumTested;
+    }
+
+    // Number of boxes found visible by the last cull().
+    std::size_t getNumVisible() const
+    {
+        return mNumVisible;
+    }
+
+    // Name of the instruction set cull() uses.
+    static const char *getSimdName();
+
+private:
+    std::vector<float> mCenterX;
+    std::vector<float> mCenterY;
+    std::vector<float> mCenterZ;
+    std::vector<float> mExtentX;
+    std::vector<float> mExtentY;
+    std::vector<float> mExtentZ;
+    std::size_t mNumTested = 0;
+    std::size_t mNumVisible = 0;
+};
+
+#endif /* FRUSTUM_CULLER_HPP */
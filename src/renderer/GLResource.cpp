@@ -0,0 +1,128 @@
+#include "GLResource.hpp"
+
+#include <deque>
+#include <vector>
+#include <utility>
+#include <glad/glad.h>
+
+#include "glutil.hpp"
+
+namespace
+{
+    struct object
+    {
+        GLObject type;
+        std::uint32_t name;
+    };
+
+    // Objects released during a frame and the fence placed after it.
+    struct retiredFrame
+    {
+        GLsync fence;
+        std::vector<object> objects;
+        std::vector<std::function<void()>> releases;
+    };
+
+    retiredFrame current{nullptr, {}, {}};
+    std::deque<retiredFrame> retired;
+    std::size_t numPending = 0;
+    bool closed = false;
+
+    void destroy(const object &o)
+    {
+        switch(o.type)
+        {
+        case GLObject::Buffer:
+            GLCall(glDeleteBuffers(1, &o.name));
+            break;
+        case GLObject::Texture:
+            GLCall(glDeleteTextures(1, &o.name));
+            break;
+        case GLObject::VertexArray:
+            GLCall(glDeleteVertexArrays(1, &o.name));
+            break;
+        case GLObject::Framebuffer:
+            GLCall(glDeleteFramebuffers(1, &o.name));
+            break;
+        case GLObject::Program:
+            GLCall(glDeleteProgram(o.name));
+            break;
+        case GLObject::Shader:
+            GLCall(glDeleteShader(o.name));
+            break;
+        case GLObject::Query:
+            GLCall(glDeleteQueries(1, &o.name));
+            break;
+        }
+    }
+
+    void destroyFrame(retiredFrame &frame)
+    {
+        for(const auto &o : frame.objects)
+            destroy(o);
+        for(const auto &release : frame.releases)
+            release();
+        numPending -= frame.objects.size() + frame.releases.size();
+        if(frame.fence != nullptr)
+        {
+            GLCall(glDeleteSync(frame.fence));
+        }
+    }
+}
+
+void glres::deleteLater(GLObject type, std::uint32_t name)
+{
+    if(name == 0 || closed)
+        return;
+    current.objects.push_back(object{type, name});
+    numPending++;
+}
+
+void glres::releaseLater(std::function<void()> release)
+{
+    if(closed)
+    {
+        release();
+        return;
+    }
+    current.releases.push_back(std::move(release));
+    numPending++;
+}
+
+void glres::endFrame()
+{
+    if(!current.objects.empty() || !current.releases.empty())
+    {
+        GLCall(current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        retired.push_back(std::exchange(current, retiredFrame{nullptr, {}, {}}));
+    }
+
+    // Frames finish in order, so stop at the first one still running.
+    while(!retired.empty())
+    {
+        GLenum status = GL_TIMEOUT_EXPIRED;
+        GLCall(status = glClientWaitSync(retired.front().fence, 0, 0));
+        if(status == GL_TIMEOUT_EXPIRED)
+            break;
+        destroyFrame(retired.front());
+        retired.pop_front();
+    }
+}
+
+void glres::shutdown()
+{
+    if(closed)
+        return;
+    GLCall(glFinish());
+    for(auto &frame : retired)
+        destroyFrame(frame);
+    retired.clear();
+    destroyFrame(current);
+    current = retiredFrame{nullptr, {}, {}};
+    closed = true;
+}
+
+std::size_t glres::getNumPending()
+{
+    return numPending;
+}
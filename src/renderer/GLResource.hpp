@@ -0,0 +1,122 @@
+#ifndef GL_RESOURCE_HPP
+#define GL_RESOURCE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <functional>
+
+// Kinds of OpenGL objects, each with its own delete function.
+enum class GLObject
+{
+    Buffer,
+    Texture,
+    VertexArray,
+    Framebuffer,
+    Program,
+    Shader,
+    Query,
+};
+
+// Deferred deletion of OpenGL objects. Deleting an object the GPU still
+// uses can make the driver wait for it, so objects that are let go of are
+// queued instead. At the end of every frame the objects queued during it
+// are tagged with a fence, and they are deleted once a later frame finds
+// that fence signaled.
+namespace glres
+{
+    // Queue name for deletion once the commands issued so far are done.
+    // Names of 0 are ignored, as are names released after shutdown().
+    void deleteLater(GLObject type, std::uint32_t name);
+
+    // Call release under the same rule, for resources that are not whole
+    // objects, like ranges of a shared buffer. Called right away after
+    // shutdown().
+    void releaseLater(std::function<void()> release);
+
+    // Fence the objects queued during this frame and delete those of
+    // earlier frames that the GPU is done with. Called when the frame is
+    // presented.
+    void endFrame();
+
+    // Wait for the GPU and delete everything that is queued. Objects
+    // released afterwards are ignored, they go away with the context.
+    void shutdown();
+
+    // Objects waiting to be deleted.
+    std::size_t getNumPending();
+}
+
+// Owner of the name of one OpenGL object, of the given type. Handles can
+// be moved but not copied, and give their object to glres::deleteLater()
+// when they are destroyed or reset.
+template<GLObject Type>
+class GLHandle
+{
+public:
+    GLHandle()
+        : mName(0)
+    {
+    }
+
+    explicit GLHandle(std::uint32_t name)
+        : mName(name)
+    {
+    }
+
+    GLHandle(const GLHandle &) = delete;
+    GLHandle &operator=(const GLHandle &) = delete;
+
+    GLHandle(GLHandle &&other) noexcept
+        : mName(std::exchange(other.mName, 0))
+    {
+    }
+
+    GLHandle &operator=(GLHandle &&other) noexcept
+    {
+        if(this != &other)
+            reset(std::exchange(other.mName, 0));
+        return *this;
+    }
+
+    ~GLHandle()
+    {
+        reset();
+    }
+
+    std::uint32_t get() const
+    {
+        return mName;
+    }
+
+    // Release the current object and return where the glCreate* function
+    // should write the new name.
+    std::uint32_t *put()
+    {
+        reset();
+        return &mName;
+    }
+
+    // Release the current object and take ownership of name.
+    void reset(std::uint32_t name = 0)
+    {
+        glres::deleteLater(Type, mName);
+        mName = name;
+    }
+
+    explicit operator bool() const
+    {
+        return mName != 0;
+    }
+
+private:
+    std::uint32_t mName;
+};
+
+using BufferHandle = GLHandle<GLObject::Buffer>;
+using TextureHandle = GLHandle<GLObject::Texture>;
+using VertexArrayHandle = GLHandle<GLObject::VertexArray>;
+using FramebufferHandle = GLHandle<GLObject::Framebuffer>;
+using QueryHandle = GLHandle<GLObject::Query>;
+
+#endif /* GL_RESOURCE_HPP */
@@ -0,0 +1,180 @@
+#include "GeometryHeap.hpp"
+#include "loadobj.hpp"
+
+#include <vector>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Binding indices of the vertex buffer and the instance index stream.
+    constexpr std::uint32_t VERTEX_BINDING = 0;
+    constexpr std::uint32_t INSTANCE_INDEX_BINDING = 1;
+
+    // Vertex ranges are aligned to whole vertices so that their offsets
+    // give base vertices.
+    constexpr std::size_t VERTEX_SIZE = sizeof(interleavedType);
+    static_assert((VERTEX_SIZE & (VERTEX_SIZE - 1)) == 0,
+                  "Vertices must be a power of two bytes");
+
+    std::uint32_t createBuffer(std::size_t size)
+    {
+        std::uint32_t buffer = 0;
+        GLCall(glCreateBuffers(1, &buffer));
+        GLCall(glNamedBufferStorage(buffer, size, nullptr, GL_DYNAMIC_STORAGE_BIT));
+        return buffer;
+    }
+}
+
+GeometryHeap::GeometryHeap(std::size_t vertexCapacity, std::size_t indexCapacity)
+    : Bindable(),mVertices(BufferUsage::Static, vertexCapacity * VERTEX_SIZE, true),
+      mIndices(BufferUsage::Static, indexCapacity * sizeof(std::uint32_t), true),
+      mVertexBuffer(0),mIndexBuffer(0),mPositionBuffer(),mPositionCapacity(0),
+      mPositionVao(),mNumVertices(0),mNumIndices(0),mAllocations(),mMeshes()
+{
+    GLCall(glCreateVertexArrays(1, &mId));
+    const std::uint32_t positionIndex = 0;
+    const std::uint32_t texIndex = 1;
+    const std::uint32_t normalIndex = 2;
+    for(auto index : {positionIndex, texIndex, normalIndex})
+    {
+        GLCall(glEnableVertexArrayAttrib(mId, index));
+        GLCall(glVertexArrayAttribBinding(mId, index, VERTEX_BINDING));
+    }
+    GLCall(glVertexArrayAttribFormat(mId, positionIndex, glm::vec3::length(), GL_FLOAT,
+                                     GL_FALSE, offsetof(interleavedType, vertexCoords)));
+    GLCall(glVertexArrayAttribFormat(mId, texIndex, glm::vec2::length(), GL_FLOAT,
+                                     GL_FALSE, offsetof(interleavedType, texCoords)));
+    GLCall(glVertexArrayAttribFormat(mId, normalIndex, glm::vec3::length(), GL_FLOAT,
+                                     GL_FALSE, offsetof(interleavedType, normalCoords)));
+
+    GLCall(glCreateVertexArrays(1, mPositionVao.put()));
+    auto positionVao = mPositionVao.get();
+    GLCall(glEnableVertexArrayAttrib(positionVao, positionIndex));
+    GLCall(glVertexArrayAttribBinding(positionVao, positionIndex, VERTEX_BINDING));
+    GLCall(glVertexArrayAttribFormat(positionVao, positionIndex, glm::vec3::length(),
+                                     GL_FLOAT, GL_FALSE, 0));
+}
+
+GeometryHeap::~GeometryHeap()
+{
+    glres::deleteLater(GLObject::VertexArray, mId);
+}
+
+MeshRange GeometryHeap::add(const interleavedBuffers &bufs)
+{
+    allocation a;
+    a.vertices = mVertices.allocate(bufs.interleavedBufs.size() * VERTEX_SIZE, VERTEX_SIZE,
+                                    bufs.interleavedBufs.data());
+    try
+    {
+        a.indices = mIndices.allocate(bufs.indexBuf.size() * sizeof(std::uint32_t),
+                                      BufferPool::MIN_ALIGNMENT, bufs.indexBuf.data());
+    }
+    catch(...)
+    {
+        mVertices.free(a.vertices);
+        throw;
+    }
+    updateBuffers();
+
+    MeshRange range;
+    range.baseVertex = static_cast<std::uint32_t>(a.vertices.offset / VERTEX_SIZE);
+    range.firstIndex = static_cast<std::uint32_t>(a.indices.offset / sizeof(std::uint32_t));
+    range.indexCount = static_cast<std::uint32_t>(bufs.indexBuf.size());
+    range.bounds = bufs.bounds;
+    range.sphere = bufs.sphere;
+
+    std::vector<glm::vec3> positions;
+    positions.reserve(bufs.interleavedBufs.size());
+    for(const auto &vertex : bufs.interleavedBufs)
+        positions.push_back(vertex.vertexCoords);
+    GLCall(glNamedBufferSubData(mPositionBuffer.get(),
+                                range.baseVertex * sizeof(glm::vec3),
+                                positions.size() * sizeof(glm::vec3), positions.data()));
+    mNumVertices += bufs.interleavedBufs.size();
+    mNumIndices += bufs.indexBuf.size();
+    mAllocations.emplace(range.firstIndex, a);
+    return range;
+}
+
+MeshRange GeometryHeap::load(const fs::path &path)
+{
+    auto key = path.lexically_normal().generic_string();
+    if(auto it = mMeshes.find(key); it != mMeshes.end())
+        return it->second;
+
+    auto range = add(loadObjFile(path));
+    mMeshes.emplace(std::move(key), range);
+    return range;
+}
+
+void GeometryHeap::remove(const MeshRange &mesh)
+{
+    auto found = mAllocations.find(mesh.firstIndex);
+    if(found == mAllocations.end())
+        throw std::invalid_argument("Mesh is not stored in this GeometryHeap");
+
+    // Writes to the space are queued after the draws already issued, so it
+    // can be handed out again right away.
+    auto &a = found->second;
+    mNumVertices -= a.vertices.size / VERTEX_SIZE;
+    mNumIndices -= a.indices.size / sizeof(std::uint32_t);
+    mVertices.free(a.vertices);
+    mIndices.free(a.indices);
+    mAllocations.erase(found);
+    for(auto it = mMeshes.begin(); it != mMeshes.end(); ++it)
+    {
+        if(it->second.firstIndex == mesh.firstIndex)
+        {
+            mMeshes.erase(it);
+            break;
+        }
+    }
+}
+void GeometryHeap::setInstanceIndexBuffer(std::uint32_t buffer)
+{
+    for(auto vao : {mId, mPositionVao.get()})
+    {
+        GLCall(glVertexArrayVertexBuffer(vao, INSTANCE_INDEX_BINDING, buffer, 0,
+                                         sizeof(std::uint32_t)));
+        GLCall(glVertexArrayBindingDivisor(vao, INSTANCE_INDEX_BINDING, 1));
+        GLCall(glEnableVertexArrayAttrib(vao, INSTANCE_INDEX_LOCATION));
+        GLCall(glVertexArrayAttribIFormat(vao, INSTANCE_INDEX_LOCATION, 1,
+                                          GL_UNSIGNED_INT, 0));
+        GLCall(glVertexArrayAttribBinding(vao, INSTANCE_INDEX_LOCATION,
+                                          INSTANCE_INDEX_BINDING));
+    }
+}
+
+void GeometryHeap::updateBuffers()
+{
+    auto vertexBuffer = mVertices.getBuffer();
+    if(vertexBuffer != mVertexBuffer)
+    {
+        mVertexBuffer = vertexBuffer;
+        GLCall(glVertexArrayVertexBuffer(mId, VERTEX_BINDING, mVertexBuffer, 0,
+                                         VERTEX_SIZE));
+
+        auto capacity = mVertices.getStats().bytesReserved / VERTEX_SIZE;
+        auto buffer = createBuffer(capacity * sizeof(glm::vec3));
+        if(mPositionBuffer)
+        {
+            GLCall(glCopyNamedBufferSubData(mPositionBuffer.get(), buffer, 0, 0,
+                                            mPositionCapacity * sizeof(glm::vec3)));
+        }
+        mPositionBuffer.reset(buffer);
+        mPositionCapacity = capacity;
+        GLCall(glVertexArrayVertexBuffer(mPositionVao.get(), VERTEX_BINDING, buffer, 0,
+                                         sizeof(glm::vec3)));
+    }
+
+    auto indexBuffer = mIndices.getBuffer();
+    if(indexBuffer != mIndexBuffer)
+    {
+        mIndexBuffer = indexBuffer;
+        GLCall(glVertexArrayElementBuffer(mId, mIndexBuffer));
+        GLCall(glVertexArrayElementBuffer(mPositionVao.get(), mIndexBuffer));
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef GEOMETRY_HEAP_HPP
+#define GEOMETRY_HEAP_HPP
+
+#include "Bindable.hpp"
+#include "BufferAllocator.hpp"
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <unordered_map>
+#include <glad/glad.h>
+
+// One vertex buffer, one index buffer and one vertex array shared by every
+// mesh added to it, so switching meshes needs no state changes and many
+// meshes can be drawn by a single multi-draw call. Vertices use the
+// interleavedType layout at the same attribute locations as VertexArray.
+//
+// Meshes are sub-allocated from growable BufferPools, one for vertices
+// and one for indices, so removed meshes leave room for new ones.
+//
+// The positions are also kept in a tightly packed buffer of their own with
+// a second vertex array, so depth-only passes fetch 12 bytes per vertex
+// instead of the whole interleaved vertex. A vertex's position is at the
+// same index as the vertex, the buffer follows the size of the vertex
+// pool.
+class GeometryHeap : public Bindable
+{
+public:
+    // Attribute location of the per-instance index stream, see
+    // setInstanceIndexBuffer().
+    static constexpr std::uint32_t INSTANCE_INDEX_LOCATION = 5;
+
+    GeometryHeap(std::size_t vertexCapacity = 1 << 18,
+                 std::size_t indexCapacity = 1 << 20);
+    GeometryHeap(const GeometryHeap &) = delete;
+    virtual ~GeometryHeap();
+
+    // Copy a mesh into the heap, growing it if needed. Throws
+    // std::invalid_argument for a mesh without indices.
+    MeshRange add(const interleavedBuffers &bufs);
+
+    MeshRange add(const buffers &bufs)
+    {
+        return add(bufsToInterleaved(bufs));
+    }
+
+    // Load an OBJ file into the heap. Files that were loaded before are
+    // not loaded again.
+    MeshRange load(const std::filesystem::path &path);
+
+    // Give the space of a mesh returned by add() or load() back to the
+    // heap. Nothing may draw it afterwards.
+    void remove(const MeshRange &mesh);
+
+    // Source attribute INSTANCE_INDEX_LOCATION from buffer, one uint32 per
+    // instance. Multi-draw commands then read their per-instance data at
+    // baseInstance + gl_InstanceID through it. Applies to both vertex
+    // arrays.
+    void setInstanceIndexBuffer(std::uint32_t buffer);
+
+    std::size_t getNumVertices() const
+    {
+        return mNumVertices;
+    }
+
+    std::size_t getNumIndices() const
+    {
+        return mNumIndices;
+    }
+
+    virtual void bind()
+    {
+        GLCall(glBindVertexArray(mId));
+    }
+
+    virtual void unbind()
+    {
+        GLCall(glBindVertexArray(0));
+    }
+
+    // Bind the vertex array that only has the positions, at location 0,
+    // and the instance index stream. Undone by unbind().
+    void bindPositions()
+    {
+        GLCall(glBindVertexArray(mPositionVao.get()));
+    }
+
+private:
+    struct allocation
+    {
+        BufferRange vertices;
+        BufferRange indices;
+    };
+
+    // Point the vertex arrays at the pools' buffers after they grew, and
+    // grow the position buffer along with the vertex pool.
+    void updateBuffers();
+
+    BufferPool mVertices;
+    BufferPool mIndices;
+    // The pools' buffers the vertex arrays use.
+    std::uint32_t mVertexBuffer;
+    std::uint32_t mIndexBuffer;
+    BufferHandle mPositionBuffer;
+    std::size_t mPositionCapacity;
+    VertexArrayHandle mPositionVao;
+    std::size_t mNumVertices;
+    std::size_t mNumIndices;
+    // Keyed by first index.
+    std::unordered_map<std::uint32_t, allocation> mAllocations;
+    std::unordered_map<std::string, MeshRange> mMeshes;
+};
+
+#endif /* GEOMETRY_HEAP_HPP */
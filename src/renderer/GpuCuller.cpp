@@ -0,0 +1,283 @@
+#include "GpuCuller.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "glext.hpp"
+#include "GLResource.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "DepthPrepass.hpp"
+#include "FrustumCuller.hpp"
+#include "renderer.hpp"
+
+namespace
+{
+    ShaderDefines getCullDefines(bool indirectCount)
+    {
+        return {{"COMPACT", indirectCount ? "1" : "0"}};
+    }
+}
+
+GpuCuller::GpuCuller(GeometryHeap &heap)
+    : mHeap(heap),mIndirectCount(glext::hasIndirectParameters()),
+      mOcclusionCulling(true),
+      mCull("shader/cull.comp", getCullDefines(mIndirectCount)),
+      mHiZFromDepth("shader/hiz.comp", {{"FROM_DEPTH", "1"}}),
+      mHiZReduce("shader/hiz.comp"),mGroups(),mRanks(),mObjectInstances(),
+      mObjects(),mInstances(),mCommands(),mDrawCounts(),mInstanceIndices(),
+      mDirty(false),mDepthTexture(),mDepthFramebuffer(),mHiZ(),mWidth(0),
+      mHeight(0),mNumLevels(0),mViewProjection(1.f),mHiZViewProjection(1.f),
+      mHasHiZ(false)
+{
+    mHiZFromDepth.getShader().set("uDepth", static_cast<std::int32_t>(HIZ_TEXTURE_UNIT));
+    mCull.getShader().set("uHiZ", static_cast<std::int32_t>(HIZ_TEXTURE_UNIT));
+}
+
+std::uint32_t GpuCuller::add(Shader *shader, Texture *texture,
+                             const MeshRange &mesh, const InstanceData &instance,
+                             const AABB &bounds)
+{
+    auto found = std::find_if(mGroups.begin(), mGroups.end(), [&](const group &g)
+    {
+        return g.shader == shader && g.texture == texture;
+    });
+    if(found == mGroups.end())
+        found = mGroups.insert(mGroups.end(), group{shader, texture, 0, 0});
+
+    auto object = static_cast<std::uint32_t>(mObjectInstances.size());
+    GpuObject o = {};
+    o.boundsMin = glm::vec4(bounds.min, 1.f);
+    o.boundsMax = glm::vec4(bounds.max, 1.f);
+    o.count = mesh.indexCount;
+    o.firstIndex = mesh.firstIndex;
+    o.baseVertex = static_cast<std::int32_t>(mesh.baseVertex);
+    o.group = static_cast<std::uint32_t>(found - mGroups.begin());
+    mRanks.push_back(found->count++);
+    mObjectInstances.push_back(instance);
+    mObjects.resize(mObjectInstances.size());
+    mObjects[object] = o;
+
+    mInstances.resize(mObjects.size());
+    mCommands.resize(mObjects.size());
+    mDrawCounts.resize(mGroups.size());
+    mInstanceIndices.resize(mObjects.size());
+    std::iota(mInstanceIndices.data().begin(), mInstanceIndices.data().end(), 0u);
+    mInstanceIndices.upload();
+    assignSlots();
+    return object;
+}
+
+void GpuCuller::update(std::uint32_t object, const InstanceData &instance,
+                       const AABB &bounds)
+{
+    auto &o = mObjects[object];
+    o.boundsMin = glm::vec4(bounds.min, 1.f);
+    o.boundsMax = glm::vec4(bounds.max, 1.f);
+    mObjectInstances[object] = instance;
+    mInstances[o.slot] = instance;
+    mDirty = true;
+}
+
+void GpuCuller::cull(const glm::mat4 &view, const glm::mat4 &projection)
+{
+    mViewProjection = projection * view;
+    if(mObjects.size() == 0)
+        return;
+
+    if(mDirty)
+    {
+        mObjects.upload();
+        mInstances.upload();
+        mDirty = false;
+    }
+
+    if(mIndirectCount)
+    {
+        GLCall(glClearNamedBufferData(mDrawCounts.getID(), GL_R32UI,
+                                      GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+    }
+
+    auto frustum = Frustum::fromMatrix(mViewProjection);
+    auto &cullShader = mCull.getShader();
+    cullShader.set("uNumObjects", static_cast<std::uint32_t>(mObjects.size()));
+    cullShader.set("uFrustumPlanes", frustum.planes);
+    cullShader.set("uUseHiZ", mOcclusionCulling && mHasHiZ);
+    if(mHasHiZ)
+    {
+        cullShader.set("uPrevViewProjection", mHiZViewProjection);
+        cullShader.set("uHiZSize", glm::vec2(mWidth, mHeight));
+        cullShader.set("uHiZLevels", static_cast<std::int32_t>(mNumLevels));
+        GLCall(glBindTextureUnit(HIZ_TEXTURE_UNIT, mHiZ.get()));
+    }
+    mCull.bindStorage("Objects", mObjects);
+    mCull.bindStorage("Commands", mCommands);
+    if(mIndirectCount)
+        mCull.bindStorage("DrawCounts", mDrawCounts);
+    mCull.dispatchThreads(static_cast<std::uint32_t>(mObjects.size()));
+    ComputePipeline::barrier(Barrier::Command | Barrier::Storage);
+}
+
+void GpuCuller::draw(Shader *shader, DepthPrepass *prepass)
+{
+    if(mObjects.size() == 0)
+        return;
+
+    // The heap's instance index stream is shared with the render queue.
+    mHeap.setInstanceIndexBuffer(mInstanceIndices.getID());
+    mInstances.bindBase(InstanceBatcher::INSTANCE_BINDING);
+
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommands.getID()));
+    if(mIndirectCount)
+    {
+        GLCall(glBindBuffer(GL_PARAMETER_BUFFER_ARB, mDrawCounts.getID()));
+    }
+
+    if(prepass != nullptr)
+    {
+        prepass->beginDepth();
+        auto &depthShader = prepass->getShader();
+        depthShader.set("uViewProjectionMatrix", mViewProjection);
+        depthShader.bind();
+        mHeap.bindPositions();
+        if(mIndirectCount)
+        {
+            for(std::size_t g = 0; g < mGroups.size(); g++)
+                drawGroup(g);
+        }
+        else
+        {
+            // Every object has a command, culled ones draw no instances.
+            GLCall(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                               static_cast<GLsizei>(mObjects.size()), 0));
+        }
+        prepass->beginShading();
+    }
+
+    mHeap.bind();
+    for(std::size_t g = 0; g < mGroups.size(); g++)
+    {
+        const auto &group = mGroups[g];
+        auto *groupShader = shader != nullptr ? shader : group.shader;
+        groupShader->set("uViewProjectionMatrix", mViewProjection);
+        groupShader->bind();
+        group.texture->bind();
+        drawGroup(g);
+    }
+    if(mIndirectCount)
+    {
+        GLCall(glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0));
+    }
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    mHeap.unbind();
+    if(prepass != nullptr)
+        prepass->end();
+}
+
+void GpuCuller::updateDepth()
+{
+    GLint viewport[4] = {};
+    GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+    if(viewport[2] <= 0 || viewport[3] <= 0)
+        return;
+    if(viewport[2] != mWidth || viewport[3] != mHeight)
+        createDepthTargets(viewport[2], viewport[3]);
+
+    // The window's depth has to be copied before it can be
+    // sampled. Blits need matching depth formats, so the copy is
+    // DEPTH24_STENCIL8 like the usual default framebuffer.
+    GLCall(glBlitNamedFramebuffer(rndr::getFramebuffer(), mDepthFramebuffer.get(),
+                                  viewport[0], viewport[1],
+                                  viewport[0] + mWidth, viewport[1] + mHeight,
+                                  0, 0, mWidth, mHeight,
+                                  GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+
+    GLCall(glBindTextureUnit(HIZ_TEXTURE_UNIT, mDepthTexture.get()));
+    mHiZFromDepth.bindImage("uDst", mHiZ.get(), 0, GL_WRITE_ONLY, GL_R32F);
+    mHiZFromDepth.dispatchThreads(static_cast<std::uint32_t>(mWidth),
+                                  static_cast<std::uint32_t>(mHeight));
+    GLCall(glBindTextureUnit(HIZ_TEXTURE_UNIT, 0));
+
+    for(int level = 1; level < mNumLevels; level++)
+    {
+        ComputePipeline::barrier(Barrier::ImageAccess);
+        mHiZReduce.bindImage("uSrc", mHiZ.get(), level - 1, GL_READ_ONLY, GL_R32F);
+        mHiZReduce.bindImage("uDst", mHiZ.get(), level, GL_WRITE_ONLY, GL_R32F);
+        mHiZReduce.dispatchThreads(static_cast<std::uint32_t>(std::max(mWidth >> level, 1)),
+                                   static_cast<std::uint32_t>(std::max(mHeight >> level, 1)));
+    }
+    ComputePipeline::barrier(Barrier::TextureFetch);
+
+    mHiZViewProjection = mViewProjection;
+    mHasHiZ = true;
+}
+
+void GpuCuller::drawGroup(std::size_t g)
+{
+    const auto &group = mGroups[g];
+    const void *commands = reinterpret_cast<const void*>(
+        group.first * sizeof(DrawElementsIndirectCommand));
+    if(mIndirectCount)
+    {
+        glext::multiDrawElementsIndirectCount(
+            GL_TRIANGLES, GL_UNSIGNED_INT, commands,
+            static_cast<GLintptr>(g * sizeof(std::uint32_t)),
+            static_cast<GLsizei>(group.count), 0);
+    }
+    else
+    {
+        GLCall(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                           commands,
+                                           static_cast<GLsizei>(group.count), 0));
+    }
+}
+
+void GpuCuller::assignSlots()
+{
+    std::uint32_t first = 0;
+    for(auto &group : mGroups)
+    {
+        group.first = first;
+        first += group.count;
+    }
+    for(std::size_t i = 0; i < mObjects.size(); i++)
+    {
+        auto &o = mObjects[i];
+        o.groupFirst = mGroups[o.group].first;
+        o.slot = o.groupFirst + mRanks[i];
+        mInstances[o.slot] = mObjectInstances[i];
+        // Without indirect parameters the cull pass only changes the
+        // instance counts, so the other fields must already be there.
+        mCommands[o.slot] = DrawElementsIndirectCommand{
+            o.count, 0, o.firstIndex, o.baseVertex, o.slot,
+        };
+    }
+    mCommands.upload();
+    mDirty = true;
+}
+
+void GpuCuller::createDepthTargets(int width, int height)
+{
+    // The handles give the old targets to glres, the last culls may still
+    // be reading the pyramid.
+    mWidth = width;
+    mHeight = height;
+    mNumLevels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+
+    GLCall(glCreateTextures(GL_TEXTURE_2D, 1, mDepthTexture.put()));
+    auto depthTexture = mDepthTexture.get();
+    GLCall(glTextureStorage2D(depthTexture, 1, GL_DEPTH24_STENCIL8, width, height));
+    GLCall(glTextureParameteri(depthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLCall(glTextureParameteri(depthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glCreateFramebuffers(1, mDepthFramebuffer.put()));
+    GLCall(glNamedFramebufferTexture(mDepthFramebuffer.get(), GL_DEPTH_STENCIL_ATTACHMENT,
+                                     depthTexture, 0));
+
+    GLCall(glCreateTextures(GL_TEXTURE_2D, 1, mHiZ.put()));
+    auto hiZ = mHiZ.get();
+    GLCall(glTextureStorage2D(hiZ, mNumLevels, GL_R32F, width, height));
+    GLCall(glTextureParameteri(hiZ, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+    GLCall(glTextureParameteri(hiZ, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    mHasHiZ = false;
+}
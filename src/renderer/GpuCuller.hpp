@@ -0,0 +1,165 @@
+#ifndef GPU_CULLER_HPP
+#define GPU_CULLER_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "glutil.hpp"
+#include "Bounds.hpp"
+#include "GLResource.hpp"
+#include "GeometryHeap.hpp"
+#include "InstanceBatcher.hpp"
+#include "RenderQueue.hpp"
+#include "StorageBuffer.hpp"
+#include "ComputePipeline.hpp"
+
+class Texture;
+class Shader;
+class DepthPrepass;
+
+// An object as read by shader/cull.comp, std430 layout.
+struct GpuObject
+{
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    std::uint32_t count;
+    std::uint32_t firstIndex;
+    std::int32_t baseVertex;
+    // Index of the object's instance data and, without indirect
+    // parameters, of its command.
+    std::uint32_t slot;
+    std::uint32_t group;
+    // First command of the object's group.
+    std::uint32_t groupFirst;
+    std::uint32_t pad[2];
+};
+
+// Visibility of the objects registered in a GpuCuller is decided on the
+// GPU, so the CPU never looks at them after they are added.
+//
+// Every frame a compute pass tests the bounds of every object against the
+// view frustum and against a Hi-Z pyramid, a mip chain of the previous
+// frame's depth buffer where every texel holds the farthest depth of the
+// texels it covers. The commands of the surviving objects are appended to
+// an indirect buffer, with an atomic counter per group of objects sharing a
+// shader and texture, and each group is drawn with
+// glMultiDrawElementsIndirectCountARB. Without GL_ARB_indirect_parameters
+// every object keeps a fixed command whose instance count is set to 0 or 1
+// instead.
+//
+// Per-instance data is indexed as in the MULTI_DRAW variant of main.vert.
+class GpuCuller
+{
+public:
+    // Texture unit the Hi-Z pyramid is sampled from.
+    static constexpr std::uint32_t HIZ_TEXTURE_UNIT = 1;
+
+    GpuCuller(GeometryHeap &heap);
+    GpuCuller(const GpuCuller &) = delete;
+    ~GpuCuller() = default;
+
+    // Register an object drawing mesh with the given shader and texture,
+    // which must outlive the culler. Returns its index for update().
+    std::uint32_t add(Shader *shader, Texture *texture, const MeshRange &mesh,
+                      const InstanceData &instance, const AABB &bounds);
+
+    // Change the placement of an object that moved.
+    void update(std::uint32_t object, const InstanceData &instance,
+                const AABB &bounds);
+
+    // Test every object as seen through projection * view and write the
+    // commands of the visible ones. The pass rebinds storage buffers, so
+    // buffers read by the shaders being drawn must be bound after it.
+    void cull(const glm::mat4 &view, const glm::mat4 &projection);
+
+    // Draw the objects found visible by the last cull(), with shader
+    // instead of their own if it is not null. If prepass is not null they
+    // are drawn into the depth buffer by it first.
+    void draw(Shader *shader = nullptr, DepthPrepass *prepass = nullptr);
+
+    // Cull every object and draw the visible ones.
+    void execute(const glm::mat4 &view, const glm::mat4 &projection,
+                 Shader *shader = nullptr, DepthPrepass *prepass = nullptr)
+    {
+        cull(view, projection);
+        draw(shader, prepass);
+    }
+
+    // Build the Hi-Z pyramid that the next cull() tests against from the
+    // depth buffer of rndr::getFramebuffer(). Call it once the frame has
+    // been drawn.
+    void updateDepth();
+
+    // Whether cull() tests against the Hi-Z pyramid. Frustum culling is
+    // always done.
+    void setOcclusionCulling(bool enabled)
+    {
+        mOcclusionCulling = enabled;
+    }
+
+    std::size_t getNumObjects() const
+    {
+        return mObjects.size();
+    }
+
+    bool hasIndirectCount() const
+    {
+        return mIndirectCount;
+    }
+
+private:
+    // Objects that share a shader and texture, drawn by one multi-draw.
+    struct group
+    {
+        Shader *shader;
+        Texture *texture;
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    // Issue the multi-draw of group g, with the draw buffers bound.
+    void drawGroup(std::size_t g);
+    // Give every object a slot so that the objects of a group are
+    // contiguous, and copy the instances to their slots.
+    void assignSlots();
+    // (Re)create the depth copy and the pyramid for a new viewport size.
+    void createDepthTargets(int width, int height);
+
+    GeometryHeap &mHeap;
+    bool mIndirectCount;
+    bool mOcclusionCulling;
+    ComputePipeline mCull;
+    ComputePipeline mHiZFromDepth;
+    ComputePipeline mHiZReduce;
+
+    std::vector<group> mGroups;
+    // Index of each object within its group.
+    std::vector<std::uint32_t> mRanks;
+    // By object, mInstances is by slot.
+    std::vector<InstanceData> mObjectInstances;
+    StorageBuffer<GpuObject> mObjects;
+    StorageBuffer<InstanceData> mInstances;
+    StorageBuffer<DrawElementsIndirectCommand> mCommands;
+    // One draw count per group.
+    StorageBuffer<std::uint32_t> mDrawCounts;
+    StorageBuffer<std::uint32_t> mInstanceIndices;
+    bool mDirty;
+
+    // Previous frame's depth, copied out of rndr::getFramebuffer().
+    TextureHandle mDepthTexture;
+    FramebufferHandle mDepthFramebuffer;
+    TextureHandle mHiZ;
+    int mWidth;
+    int mHeight;
+    int mNumLevels;
+    // The view of the last cull(), and the one the pyramid was made
+    // from. The pyramid is invalid until the first updateDepth().
+    glm::mat4 mViewProjection;
+    glm::mat4 mHiZViewProjection;
+    bool mHasHiZ;
+};
+
+#endif /* GPU_CULLER_HPP */
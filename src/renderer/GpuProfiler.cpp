@@ -0,0 +1,261 @@
+#include "GpuProfiler.hpp"
+
+#include <array>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <glad/glad.h>
+#include <fmt/core.h>
+
+#include "glutil.hpp"
+#include "GLResource.hpp"
+
+namespace
+{
+    using cpuClock = std::chrono::steady_clock;
+
+    // Parent of the outermost zones.
+    constexpr std::size_t ROOT = static_cast<std::size_t>(-1);
+
+    struct zone
+    {
+        std::string name;
+        std::size_t parent;
+        int depth;
+        std::vector<std::size_t> children;
+        // The last WINDOW frames the zone ran in, oldest first.
+        std::deque<double> gpuMs;
+        std::deque<double> cpuMs;
+    };
+
+    // One entry into a zone, timed by two queries of its frame. Zones
+    // opened inside it write theirs in between.
+    struct record
+    {
+        std::size_t zone;
+        std::size_t firstQuery;
+        std::size_t lastQuery;
+        cpuClock::time_point start;
+        double cpuMs;
+    };
+
+    struct frameQueries
+    {
+        std::vector<QueryHandle> queries;
+        std::size_t numUsed = 0;
+        std::vector<record> records;
+    };
+
+    // A deque so that the names the map points into stay put.
+    std::deque<zone> zones;
+    std::map<std::pair<std::size_t, std::string_view>, std::size_t> zonesByName;
+    std::vector<std::size_t> outermost;
+
+    std::array<frameQueries, gpuprof::NUM_FRAMES> frames;
+    std::size_t currentFrame = 0;
+    // Records of the zones open in the current frame.
+    std::vector<std::size_t> openZones;
+    bool enabled = false;
+    bool enableNextFrame = false;
+    std::size_t numDropped = 0;
+
+    std::size_t findZone(std::size_t parent, std::string_view name)
+    {
+        auto found = zonesByName.find({parent, name});
+        if(found != zonesByName.end())
+            return found->second;
+
+        std::size_t index = zones.size();
+        int depth = parent == ROOT ? 0 : zones[parent].depth + 1;
+        zones.push_back(zone{std::string(name), parent, depth, {}, {}, {}});
+        zonesByName.emplace(std::pair(parent, std::string_view(zones.back().name)),
+                            index);
+        (parent == ROOT ? outermost : zones[parent].children).push_back(index);
+        return index;
+    }
+
+    // Write a timestamp into the next query of the current frame.
+    std::size_t writeTimestamp()
+    {
+        auto &frame = frames[currentFrame];
+        if(frame.numUsed == frame.queries.size())
+        {
+            frame.queries.emplace_back();
+            GLCall(glCreateQueries(GL_TIMESTAMP, 1, frame.queries.back().put()));
+        }
+        GLCall(glQueryCounter(frame.queries[frame.numUsed].get(), GL_TIMESTAMP));
+        return frame.numUsed++;
+    }
+
+    // Add the results of frame to the zones, if the GPU has them, and make
+    // its queries free to use again.
+    void readResults(frameQueries &frame)
+    {
+        if(frame.records.empty())
+            return;
+
+        GLint available = GL_FALSE;
+        // Queries finish in order, so the last one being ready means they
+        // all are.
+        GLCall(glGetQueryObjectiv(frame.queries[frame.numUsed - 1].get(),
+                                  GL_QUERY_RESULT_AVAILABLE, &available));
+        if(available)
+        {
+            // Sums per zone, a zone may have been entered several times.
+            std::map<std::size_t, std::pair<double, double>> times;
+            for(const auto &r : frame.records)
+            {
+                GLuint64 start = 0;
+                GLuint64 end = 0;
+                GLCall(glGetQueryObjectui64v(frame.queries[r.firstQuery].get(),
+                                             GL_QUERY_RESULT, &start));
+                GLCall(glGetQueryObjectui64v(frame.queries[r.lastQuery].get(),
+                                             GL_QUERY_RESULT, &end));
+                auto &[gpuMs, cpuMs] = times[r.zone];
+                gpuMs += static_cast<double>(end - start) / 1e6;
+                cpuMs += r.cpuMs;
+            }
+            for(const auto &[index, time] : times)
+            {
+                auto &z = zones[index];
+                z.gpuMs.push_back(time.first);
+                z.cpuMs.push_back(time.second);
+                if(z.gpuMs.size() > gpuprof::WINDOW)
+                {
+                    z.gpuMs.pop_front();
+                    z.cpuMs.pop_front();
+                }
+            }
+        }
+        else
+        {
+            numDropped++;
+        }
+        frame.records.clear();
+        frame.numUsed = 0;
+    }
+
+    void addStats(std::size_t index, std::vector<gpuprof::ZoneStats> &stats)
+    {
+        const auto &z = zones[index];
+        if(!z.gpuMs.empty())
+        {
+            gpuprof::ZoneStats s;
+            s.name = z.name;
+            s.depth = z.depth;
+            s.samples = z.gpuMs.size();
+            s.minMs = *std::min_element(z.gpuMs.begin(), z.gpuMs.end());
+            s.maxMs = *std::max_element(z.gpuMs.begin(), z.gpuMs.end());
+            for(std::size_t i = 0; i < s.samples; i++)
+            {
+                s.avgMs += z.gpuMs[i];
+                s.cpuMs += z.cpuMs[i];
+            }
+            s.avgMs /= static_cast<double>(s.samples);
+            s.cpuMs /= static_cast<double>(s.samples);
+            stats.push_back(std::move(s));
+        }
+        for(auto child : z.children)
+            addStats(child, stats);
+    }
+}
+
+void gpuprof::beginZone(std::string_view name)
+{
+    if(!enabled)
+        return;
+
+    auto &frame = frames[currentFrame];
+    std::size_t parent = openZones.empty() ? ROOT :
+        frame.records[openZones.back()].zone;
+    std::size_t index = findZone(parent, name);
+    openZones.push_back(frame.records.size());
+    frame.records.push_back(record{index, writeTimestamp(), 0, cpuClock::now(), 0.});
+}
+
+void gpuprof::endZone()
+{
+    if(!enabled)
+        return;
+    if(openZones.empty())
+        throw std::logic_error("gpuprof::endZone() without an open zone");
+
+    auto &r = frames[currentFrame].records[openZones.back()];
+    openZones.pop_back();
+    r.lastQuery = writeTimestamp();
+    r.cpuMs = std::chrono::duration<double, std::milli>(cpuClock::now() - r.start).count();
+}
+
+void gpuprof::endFrame()
+{
+    if(!openZones.empty())
+    {
+        const auto &r = frames[currentFrame].records[openZones.back()];
+        throw std::logic_error(fmt::format(
+            "GPU zone \"{}\" is still open at the end of the frame", zones[r.zone].name));
+    }
+
+    // The next frame's queries were written NUM_FRAMES - 1 frames ago.
+    currentFrame = (currentFrame + 1) % NUM_FRAMES;
+    readResults(frames[currentFrame]);
+    enabled = enableNextFrame;
+}
+
+void gpuprof::setEnabled(bool enable)
+{
+    if(enable)
+    {
+        GLint bits = 0;
+        GLCall(glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits));
+        enable = bits > 0;
+    }
+    enableNextFrame = enable;
+}
+
+bool gpuprof::isEnabled()
+{
+    return enableNextFrame;
+}
+
+std::vector<gpuprof::ZoneStats> gpuprof::getZones()
+{
+    std::vector<ZoneStats> stats;
+    for(auto index : outermost)
+        addStats(index, stats);
+    return stats;
+}
+
+std::size_t gpuprof::getNumDropped()
+{
+    return numDropped;
+}
+
+void gpuprof::dump()
+{
+    fmt::print("{:<32} {:>9} {:>9} {:>9} {:>9} {:>7}\n", "GPU zone", "min ms",
+               "avg ms", "max ms", "CPU ms", "frames");
+    for(const auto &z : getZones())
+    {
+        fmt::print("{:<32} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>7}\n",
+                   std::string(2 * z.depth, ' ') + z.name, z.minMs, z.avgMs,
+                   z.maxMs, z.cpuMs, z.samples);
+    }
+    if(numDropped > 0)
+        fmt::print("{} frames dropped, their results were late\n", numDropped);
+}
+
+void gpuprof::quit()
+{
+    for(auto &frame : frames)
+        frame = frameQueries();
+    zones.clear();
+    zonesByName.clear();
+    outermost.clear();
+    openZones.clear();
+    enabled = false;
+    enableNextFrame = false;
+    numDropped = 0;
+}
@@ -0,0 +1,95 @@
+#ifndef GPU_PROFILER_HPP
+#define GPU_PROFILER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// GPU time of named, nested zones of a frame.
+//
+// Every beginZone() and endZone() writes a GL_TIMESTAMP query, so zones
+// can nest, unlike GL_TIME_ELAPSED queries. The queries of a frame are read
+// back NUM_FRAMES frames later, when the GPU is long done with them; a
+// frame whose queries are still not ready then is dropped rather than
+// waited for. Times are kept per zone over the last WINDOW frames it ran
+// in, along with the CPU time spent between its begin and end.
+//
+// Zones are identified by their name and the zone they are nested in, so
+// the same name under two parents is two zones. Profiling is off until
+// setEnabled(true), and costs nothing until then.
+namespace gpuprof
+{
+    // Frames a query gets to finish before its result is read.
+    constexpr std::size_t NUM_FRAMES = 4;
+    // Frames a zone's statistics are computed over.
+    constexpr std::size_t WINDOW = 120;
+
+    struct ZoneStats
+    {
+        std::string name;
+        // Number of zones this one is nested in.
+        int depth = 0;
+        // GPU time per frame, a zone entered more than once in a frame
+        // counts the sum.
+        double minMs = 0.;
+        double avgMs = 0.;
+        double maxMs = 0.;
+        // Average CPU time between begin and end per frame.
+        double cpuMs = 0.;
+        // Frames the statistics are made of.
+        std::size_t samples = 0;
+    };
+
+    // Open a zone nested in the innermost open one.
+    void beginZone(std::string_view name);
+
+    // Close the innermost open zone. Throws std::logic_error if there is
+    // none.
+    void endZone();
+
+    // Read back the results of an old frame. Called when the frame is
+    // presented, every zone must be closed by then or std::logic_error is
+    // thrown.
+    void endFrame();
+
+    // Start or stop profiling from the next frame on. Stopping keeps the
+    // statistics. It stays off if the implementation's timestamps have no
+    // bits.
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    // Statistics of every zone that has results, each followed by the
+    // zones nested in it, in the order they were first entered.
+    std::vector<ZoneStats> getZones();
+
+    // Frames whose results were not ready after NUM_FRAMES frames.
+    std::size_t getNumDropped();
+
+    // Print getZones() as an indented table.
+    void dump();
+
+    // Forget every zone and query. Called before the context goes away.
+    void quit();
+
+    // Open a zone for the lifetime of the object.
+    class Zone
+    {
+    public:
+        explicit Zone(std::string_view name)
+        {
+            beginZone(name);
+        }
+
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+        ~Zone()
+        {
+            endZone();
+        }
+    };
+}
+
+#endif /* GPU_PROFILER_HPP */
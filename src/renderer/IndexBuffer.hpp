@@ -8,6 +8,8 @@
 
 #include <glad/glad.h>
 
+// Immutable index buffer of its own. Meshes allocate their indices from a
+// BufferPool instead, this is for indices that need a whole buffer.
 class IndexBuffer : public Bindable
 {
 public:
@@ -20,23 +22,16 @@ public:
         : Bindable(),mCountIndices(indices.size()),mTypeSize(1),
           mUnderlyingType(GL_UNSIGNED_BYTE)
     {
-        GLCall(glGenBuffers(1, &mId));
-
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mId));
-        GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mCountIndices,
-                            indices.data(), GL_STATIC_DRAW));
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+        GLCall(glCreateBuffers(1, &mId));
+        GLCall(glNamedBufferStorage(mId, mTypeSize * mCountIndices, indices.data(), 0));
     }
 
     IndexBuffer(const std::vector<std::uint16_t> &indices)
         : Bindable(),mCountIndices(indices.size()),mTypeSize(sizeof(std::uint16_t)),
           mUnderlyingType(GL_UNSIGNED_SHORT)
     {
-        GLCall(glGenBuffers(1, &mId));
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mId));
-        GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mTypeSize * mCountIndices,
-                            indices.data(), GL_STATIC_DRAW));
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+        GLCall(glCreateBuffers(1, &mId));
+        GLCall(glNamedBufferStorage(mId, mTypeSize * mCountIndices, indices.data(), 0));
     }
 
     IndexBuffer(const std::vector<std::uint32_t> &indices)
@@ -44,9 +39,7 @@ public:
           mUnderlyingType(GL_UNSIGNED_INT)
     {
         GLCall(glCreateBuffers(1, &mId));
-        GLCall(glNamedBufferStorage(mId, mTypeSize * indices.size(), indices.data(),
-                                    GL_DYNAMIC_STORAGE_BIT)); 
-        
+        GLCall(glNamedBufferStorage(mId, mTypeSize * mCountIndices, indices.data(), 0));
     }
 
     virtual void bind()
@@ -74,7 +67,10 @@ public:
         return mUnderlyingType;
     }
 
-    virtual ~IndexBuffer() = default;
+    virtual ~IndexBuffer()
+    {
+        glres::deleteLater(GLObject::Buffer, mId);
+    }
 
 protected:
     std::size_t mCountIndices;
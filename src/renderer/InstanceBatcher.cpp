@@ -0,0 +1,72 @@
+#include "InstanceBatcher.hpp"
+
+#include <algorithm>
+
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "VertexArray.hpp"
+
+InstanceBatcher::InstanceBatcher()
+    : mBatchIndices(),mBatches(),mInstanceBuffer(),mNumDrawCalls(0),
+      mNumInstances(0)
+{
+}
+
+void InstanceBatcher::submit(VertexArray *vao, Texture *texture, Shader *shader,
+                             const InstanceData &instance)
+{
+    batchKey key(shader, texture, vao);
+    auto it = mBatchIndices.find(key);
+    if(it == mBatchIndices.end())
+    {
+        it = mBatchIndices.emplace(key, mBatches.size()).first;
+        mBatches.push_back(batch{vao, texture, shader, {}});
+    }
+    mBatches[it->second].instances.push_back(instance);
+}
+
+void InstanceBatcher::flush(const glm::mat4 &view, const glm::mat4 &projection)
+{
+    mNumDrawCalls = 0;
+    mNumInstances = 0;
+    for(const auto &b : mBatches)
+        mNumInstances += b.instances.size();
+    if(mNumInstances == 0)
+        return;
+
+    // Every group's instances go into one buffer, back to back.
+    if(mInstanceBuffer.size() < mNumInstances)
+        mInstanceBuffer.resize(std::max(mNumInstances, mInstanceBuffer.size() * 2));
+    auto &data = mInstanceBuffer.data();
+    std::size_t offset = 0;
+    for(const auto &b : mBatches)
+    {
+        std::copy(b.instances.begin(), b.instances.end(), data.begin() + offset);
+        offset += b.instances.size();
+    }
+    mInstanceBuffer.upload(0, mNumInstances);
+    mInstanceBuffer.bindBase(INSTANCE_BINDING);
+
+    auto viewProjection = projection * view;
+    Shader *boundShader = nullptr;
+    std::uint32_t base = 0;
+    for(auto &b : mBatches)
+    {
+        if(b.instances.empty())
+            continue;
+
+        b.shader->set("uViewProjectionMatrix", viewProjection);
+        b.shader->set("uInstanceBase", base);
+        if(b.shader != boundShader)
+        {
+            b.shader->bind();
+            boundShader = b.shader;
+        }
+        b.texture->bind();
+        b.vao->drawInstanced(static_cast<std::uint32_t>(b.instances.size()));
+
+        base += static_cast<std::uint32_t>(b.instances.size());
+        b.instances.clear();
+        mNumDrawCalls++;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef INSTANCE_BATCHER_HPP
+#define INSTANCE_BATCHER_HPP
+
+#include <glm/glm.hpp>
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+
+#include "StorageBuffer.hpp"
+
+class VertexArray;
+class Texture;
+class Shader;
+
+// Per-instance data read by the INSTANCED variant of main.vert, laid out as
+// std430.
+struct InstanceData
+{
+    glm::mat4 model;
+    // Only the upper 3x3 is used, a mat4 avoids std430 mat3 padding.
+    glm::mat4 normal;
+};
+
+// Gathers the objects submitted during a frame into groups that share a
+// mesh, texture and shader. Each group is drawn with a single instanced
+// draw call, its per-instance matrices are read from one storage buffer.
+class InstanceBatcher
+{
+public:
+    // Binding point of the instance storage buffer, must match main.vert.
+    static constexpr std::uint32_t INSTANCE_BINDING = 0;
+
+    InstanceBatcher();
+    InstanceBatcher(const InstanceBatcher &) = delete;
+    ~InstanceBatcher() = default;
+
+    // Queue one instance of vao for this frame.
+    void submit(VertexArray *vao, Texture *texture, Shader *shader,
+                const InstanceData &instance);
+
+    // Upload every queued instance, draw each group and clear the queue.
+    void flush(const glm::mat4 &view, const glm::mat4 &projection);
+
+    // Number of instanced draw calls issued by the last flush.
+    std::size_t getNumDrawCalls() const
+    {
+        return mNumDrawCalls;
+    }
+
+    // Number of instances drawn by the last flush.
+    std::size_t getNumInstances() const
+    {
+        return mNumInstances;
+    }
+
+private:
+    using batchKey = std::tuple<Shader*, Texture*, VertexArray*>;
+
+    struct batch
+    {
+        VertexArray *vao;
+        Texture *texture;
+        Shader *shader;
+        std::vector<InstanceData> instances;
+    };
+
+    std::map<batchKey, std::size_t> mBatchIndices;
+    // Kept between frames so their instance vectors keep their capacity.
+    std::vector<batch> mBatches;
+    StorageBuffer<InstanceData> mInstanceBuffer;
+    std::size_t mNumDrawCalls;
+    std::size_t mNumInstances;
+};
+
+#endif /* INSTANCE_BATCHER_HPP */
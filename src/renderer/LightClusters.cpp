@@ -0,0 +1,328 @@
+#include "LightClusters.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Shader.hpp"
+#include "../jobs.hpp"
+
+static_assert(sizeof(ClusterLight) == 96, "ClusterLight must match the std430 layout");
+
+namespace
+{
+    using clusterClock = std::chrono::steady_clock;
+
+    constexpr std::uint32_t SLICE_SIZE = LightClusters::GRID_X * LightClusters::GRID_Y;
+
+    // Column or row of the tile containing a normalized device coordinate,
+    // clamped to the grid.
+    int toTile(float ndc, std::uint32_t numTiles)
+    {
+        float tile = std::floor((ndc * 0.5f + 0.5f) * numTiles);
+        return static_cast<int>(std::clamp(tile, 0.f, numTiles - 1.f));
+    }
+}
+
+LightClusters::LightClusters()
+    : mProjection(0.f),mNear(0.1f),mFar(1000.f),mDepthScale(1.f),
+      mMinX(NUM_CLUSTERS),mMaxX(NUM_CLUSTERS),mMinY(NUM_CLUSTERS),
+      mMaxY(NUM_CLUSTERS),mMinZ(NUM_CLUSTERS),mMaxZ(NUM_CLUSTERS),mLights(),
+      mLightsChanged(false),mBounds(),mSliceRefs(GRID_Z),mSliceLights(GRID_Z),
+      mSliceCounts(GRID_Z),mLightBuffer(),mClusters(NUM_CLUSTERS),
+      mLightIndices(4096),mStats()
+{
+}
+
+void LightClusters::clearLights()
+{
+    mLights.clear();
+    mLightsChanged = true;
+}
+
+std::uint32_t LightClusters::addLight(const ClusterLight &light)
+{
+    auto index = static_cast<std::uint32_t>(mLights.size());
+    mLights.emplace_back();
+    setLight(index, light);
+    return index;
+}
+
+void LightClusters::setLight(std::uint32_t index, const ClusterLight &light)
+{
+    mLights[index] = light;
+    if(light.range <= 0.f)
+        mLights[index].range = getRange(light);
+    mLightsChanged = true;
+}
+
+void LightClusters::setProjection(const glm::mat4 &projection)
+{
+    if(projection == mProjection)
+        return;
+    mProjection = projection;
+    // Inverse of the depth terms of a perspective matrix.
+    mNear = projection[3][2] / (projection[2][2] - 1.f);
+    mFar = projection[3][2] / (projection[2][2] + 1.f);
+    mDepthScale = GRID_Z / std::log(mFar / mNear);
+
+    // View space directions through the tile corners, scaled to a depth
+    // of 1.
+    auto inverse = glm::inverse(projection);
+    std::vector<glm::vec2> rays((GRID_X + 1) * (GRID_Y + 1));
+    for(std::uint32_t y = 0; y <= GRID_Y; y++)
+        for(std::uint32_t x = 0; x <= GRID_X; x++)
+        {
+            auto point = inverse * glm::vec4(2.f * x / GRID_X - 1.f,
+                                             2.f * y / GRID_Y - 1.f, 1.f, 1.f);
+            rays[y * (GRID_X + 1) + x] = glm::vec2(point) / -point.z;
+        }
+
+    for(std::uint32_t z = 0; z < GRID_Z; z++)
+    {
+        float nearDepth = mNear * std::pow(mFar / mNear, static_cast<float>(z) / GRID_Z);
+        float farDepth = mNear * std::pow(mFar / mNear, static_cast<float>(z + 1) / GRID_Z);
+        for(std::uint32_t y = 0; y < GRID_Y; y++)
+            for(std::uint32_t x = 0; x < GRID_X; x++)
+            {
+                glm::vec2 lo(std::numeric_limits<float>::max());
+                glm::vec2 hi(-std::numeric_limits<float>::max());
+                for(std::uint32_t corner = 0; corner < 4; corner++)
+                {
+                    auto ray = rays[(y + corner / 2) * (GRID_X + 1) + x + corner % 2];
+                    for(float depth : {nearDepth, farDepth})
+                    {
+                        lo = glm::min(lo, ray * depth);
+                        hi = glm::max(hi, ray * depth);
+                    }
+                }
+                auto cluster = (z * GRID_Y + y) * GRID_X + x;
+                mMinX[cluster] = lo.x;
+                mMaxX[cluster] = hi.x;
+                mMinY[cluster] = lo.y;
+                mMaxY[cluster] = hi.y;
+                mMinZ[cluster] = -farDepth;
+                mMaxZ[cluster] = -nearDepth;
+            }
+    }
+}
+
+void LightClusters::update(const glm::mat4 &view)
+{
+    auto start = clusterClock::now();
+    mBounds.resize(mLights.size());
+    jobs::parallelFor(mLights.size(), 256, [&](std::size_t first, std::size_t last)
+    {
+        for(auto i = first; i < last; i++)
+            mBounds[i] = getBounds(mLights[i], view);
+    });
+    jobs::parallelFor(GRID_Z, 1, [this](std::size_t first, std::size_t last)
+    {
+        for(auto z = first; z < last; z++)
+            fillSlice(static_cast<std::uint32_t>(z));
+    });
+
+    // Concatenate the slices.
+    std::size_t numReferences = 0;
+    for(const auto &lights : mSliceLights)
+        numReferences += lights.size();
+    if(mLightIndices.size() < numReferences)
+        mLightIndices.resize(std::max(numReferences, mLightIndices.size() * 2));
+
+    mStats = ClusterStats();
+    std::vector<bool> touched(mLights.size());
+    std::uint32_t offset = 0;
+    for(std::uint32_t z = 0; z < GRID_Z; z++)
+    {
+        for(std::uint32_t c = 0; c < SLICE_SIZE; c++)
+        {
+            auto count = mSliceCounts[z][c];
+            mClusters[z * SLICE_SIZE + c] = glm::uvec2(offset, count);
+            offset += count;
+            mStats.maxLightsPerCluster = std::max<std::size_t>(mStats.maxLightsPerCluster,
+                                                               count);
+        }
+        const auto &lights = mSliceLights[z];
+        std::copy(lights.begin(), lights.end(),
+                  mLightIndices.data().begin() + (offset - lights.size()));
+        for(auto light : lights)
+            touched[light] = true;
+    }
+
+    if(mLightsChanged)
+    {
+        if(mLightBuffer.size() < mLights.size())
+            mLightBuffer.resize(std::max(mLights.size(), mLightBuffer.size() * 2));
+        std::copy(mLights.begin(), mLights.end(), mLightBuffer.data().begin());
+        if(!mLights.empty())
+            mLightBuffer.upload(0, mLights.size());
+        mLightsChanged = false;
+    }
+    mClusters.upload();
+    if(numReferences > 0)
+        mLightIndices.upload(0, numReferences);
+
+    mStats.lights = mLights.size();
+    mStats.visibleLights = static_cast<std::size_t>(std::count(touched.begin(),
+                                                               touched.end(), true));
+    mStats.references = numReferences;
+    mStats.updateMs = std::chrono::duration<double, std::milli>(
+        clusterClock::now() - start).count();
+}
+
+void LightClusters::bind(const Shader &shader, float width, float height) const
+{
+    mLightBuffer.bindBase(LIGHT_BINDING);
+    mClusters.bindBase(CLUSTER_BINDING);
+    mLightIndices.bindBase(LIGHT_INDEX_BINDING);
+    shader.set("uClusterGrid", glm::uvec3(GRID_X, GRID_Y, GRID_Z));
+    shader.set("uClusterTileScale", glm::vec2(GRID_X / width, GRID_Y / height));
+    shader.set("uClusterDepthScale", glm::vec2(mDepthScale, -std::log(mNear) * mDepthScale));
+}
+
+float LightClusters::getRange(const ClusterLight &light)
+{
+    auto color = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+    float brightest = std::max({color.x, color.y, color.z});
+    // Solve constant + linear * d + quadratic * d^2 = 256 * brightest.
+    float c = light.constant - 256.f * brightest;
+    if(c >= 0.f)
+        return 0.f;
+    if(light.quadratic > 0.f)
+        return (-light.linear + std::sqrt(light.linear * light.linear -
+                                          4.f * light.quadratic * c)) /
+            (2.f * light.quadratic);
+    if(light.linear > 0.f)
+        return -c / light.linear;
+    throw std::invalid_argument("A light without attenuation needs a range");
+}
+
+LightClusters::lightBounds LightClusters::getBounds(const ClusterLight &light,
+                                                    const glm::mat4 &view) const
+{
+    lightBounds bounds;
+    bounds.center = glm::vec3(view * glm::vec4(light.position, 1.f));
+    bounds.radiusSq = light.range * light.range;
+    bounds.minX = 0;
+    bounds.maxX = GRID_X - 1;
+    bounds.minY = 0;
+    bounds.maxY = GRID_Y - 1;
+    // Empty until the light is found to be in view.
+    bounds.minZ = 1;
+    bounds.maxZ = 0;
+
+    float nearDepth = -bounds.center.z - light.range;
+    float farDepth = -bounds.center.z + light.range;
+    if(light.range <= 0.f || farDepth < mNear || nearDepth > mFar)
+        return bounds;
+
+    // The tiles covered by the projection of the sphere's box, unless the
+    // box crosses the near plane.
+    if(nearDepth > mNear)
+    {
+        glm::vec2 lo(std::numeric_limits<float>::max());
+        glm::vec2 hi(-std::numeric_limits<float>::max());
+        for(int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner = bounds.center + light.range *
+                glm::vec3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f,
+                          (i & 4) ? 1.f : -1.f);
+            auto clip = mProjection * glm::vec4(corner, 1.f);
+            auto ndc = glm::vec2(clip) / clip.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        if(hi.x < -1.f || lo.x > 1.f || hi.y < -1.f || lo.y > 1.f)
+            return bounds;
+        bounds.minX = toTile(lo.x, GRID_X);
+        bounds.maxX = toTile(hi.x, GRID_X);
+        bounds.minY = toTile(lo.y, GRID_Y);
+        bounds.maxY = toTile(hi.y, GRID_Y);
+    }
+
+    auto toSlice = [this](float depth)
+    {
+        float slice = std::floor(std::log(depth / mNear) * mDepthScale);
+        return static_cast<int>(std::clamp(slice, 0.f, GRID_Z - 1.f));
+    };
+    bounds.minZ = toSlice(std::max(nearDepth, mNear));
+    bounds.maxZ = toSlice(std::min(farDepth, mFar));
+    return bounds;
+}
+
+void LightClusters::fillSlice(std::uint32_t z)
+{
+    auto &refs = mSliceRefs[z];
+    refs.clear();
+    const auto slice = static_cast<int>(z);
+    for(std::uint32_t i = 0; i < mBounds.size(); i++)
+    {
+        const auto &b = mBounds[i];
+        if(slice < b.minZ || slice > b.maxZ)
+            continue;
+
+        for(int y = b.minY; y <= b.maxY; y++)
+        {
+            auto row = z * SLICE_SIZE + y * GRID_X;
+            int x = b.minX;
+#if defined(__SSE2__)
+            auto cx = _mm_set1_ps(b.center.x);
+            auto cy = _mm_set1_ps(b.center.y);
+            auto cz = _mm_set1_ps(b.center.z);
+            auto radiusSq = _mm_set1_ps(b.radiusSq);
+            auto zero = _mm_setzero_ps();
+            for(; x + 3 <= b.maxX; x += 4)
+            {
+                // Distance from the center to each box along each axis, 0
+                // inside it.
+                auto dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&mMinX[row + x]), cx),
+                                                _mm_sub_ps(cx, _mm_loadu_ps(&mMaxX[row + x]))),
+                                     zero);
+                auto dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&mMinY[row + x]), cy),
+                                                _mm_sub_ps(cy, _mm_loadu_ps(&mMaxY[row + x]))),
+                                     zero);
+                auto dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&mMinZ[row + x]), cz),
+                                                _mm_sub_ps(cz, _mm_loadu_ps(&mMaxZ[row + x]))),
+                                     zero);
+                auto distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                         _mm_mul_ps(dz, dz));
+                for(int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, radiusSq)); mask;
+                    mask &= mask - 1)
+                    refs.emplace_back(y * GRID_X + x + __builtin_ctz(mask), i);
+            }
+#endif
+            for(; x <= b.maxX; x++)
+            {
+                auto c = row + x;
+                float dx = std::max({mMinX[c] - b.center.x, b.center.x - mMaxX[c], 0.f});
+                float dy = std::max({mMinY[c] - b.center.y, b.center.y - mMaxY[c], 0.f});
+                float dz = std::max({mMinZ[c] - b.center.z, b.center.z - mMaxZ[c], 0.f});
+                if(dx * dx + dy * dy + dz * dz <= b.radiusSq)
+                    refs.emplace_back(y * GRID_X + x, i);
+            }
+        }
+    }
+
+    // Counting sort by cluster, keeping the lights in order.
+    auto &counts = mSliceCounts[z];
+    counts.fill(0);
+    for(const auto &ref : refs)
+        counts[ref.first]++;
+    std::array<std::uint32_t, SLICE_SIZE> offsets;
+    std::uint32_t offset = 0;
+    for(std::uint32_t c = 0; c < SLICE_SIZE; c++)
+    {
+        offsets[c] = offset;
+        offset += counts[c];
+    }
+    auto &lights = mSliceLights[z];
+    lights.resize(refs.size());
+    for(const auto &ref : refs)
+        lights[offsets[ref.first]++] = ref.second;
+}
@@ -0,0 +1,171 @@
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+#include "StorageBuffer.hpp"
+
+class Shader;
+
+// A point or spot light as read by the CLUSTERED variant of main.frag,
+// std430 layout. The lighting terms are those of PointLight and SpotLight
+// in lights.glsl, cut off at range.
+struct ClusterLight
+{
+    glm::vec3 position = glm::vec3(0.f);
+    // Distance past which the light is ignored, 0 to compute it with
+    // LightClusters::getRange().
+    float range = 0.f;
+    // Spot lights only, cutOff and outerCutOff are cosines.
+    glm::vec3 direction = glm::vec3(0.f, -1.f, 0.f);
+    float cutOff = 1.f;
+    glm::vec3 ambient = glm::vec3(0.f);
+    float outerCutOff = 1.f;
+    glm::vec3 diffuse = glm::vec3(1.f);
+    float constant = 1.f;
+    glm::vec3 specular = glm::vec3(1.f);
+    float linear = 0.f;
+    float quadratic = 1.f;
+    std::uint32_t isSpot = 0;
+    float pad[2] = {};
+};
+
+// Work done by the last LightClusters::update().
+struct ClusterStats
+{
+    std::size_t lights = 0;
+    // Lights that touched at least one cluster.
+    std::size_t visibleLights = 0;
+    // Entries in the light index list.
+    std::size_t references = 0;
+    std::size_t maxLightsPerCluster = 0;
+    double updateMs = 0.;
+};
+
+// Clustered forward lighting. The view frustum is cut into a grid of
+// GRID_X by GRID_Y tiles on screen and GRID_Z slices in depth, spaced
+// exponentially between the near and far planes. Every frame each light's
+// bounding sphere is tested against the view space boxes of the clusters
+// it might touch, and the lights of every cluster are listed in storage
+// buffers. The fragment shader then only loops over the lights of its own
+// cluster, so the cost per pixel depends on the local light density
+// instead of the number of lights.
+//
+// Slices are filled in parallel and the spheres are tested against 4
+// clusters of a row at a time with SSE. Spot lights are tested by the
+// sphere around their whole range, ignoring the cone.
+class LightClusters
+{
+public:
+    static constexpr std::uint32_t GRID_X = 16;
+    static constexpr std::uint32_t GRID_Y = 9;
+    static constexpr std::uint32_t GRID_Z = 24;
+    static constexpr std::uint32_t NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+
+    // Storage buffer bindings read by main.frag, after the instance data.
+    static constexpr std::uint32_t LIGHT_BINDING = 1;
+    static constexpr std::uint32_t CLUSTER_BINDING = 2;
+    static constexpr std::uint32_t LIGHT_INDEX_BINDING = 3;
+
+    LightClusters();
+    LightClusters(const LightClusters &) = delete;
+    ~LightClusters() = default;
+
+    // Remove every light.
+    void clearLights();
+
+    // Add a light, returns its index.
+    std::uint32_t addLight(const ClusterLight &light);
+
+    // Replace the light at index.
+    void setLight(std::uint32_t index, const ClusterLight &light);
+
+    const ClusterLight &getLight(std::uint32_t index) const
+    {
+        return mLights[index];
+    }
+
+    std::size_t size() const
+    {
+        return mLights.size();
+    }
+
+    // Set the perspective projection the grid is made for. The cluster
+    // boxes are only recomputed when it changes.
+    void setProjection(const glm::mat4 &projection);
+
+    // Assign the lights to clusters as seen from view and upload the
+    // result.
+    void update(const glm::mat4 &view);
+
+    // Bind the buffers and set the grid uniforms of shader, for a viewport
+    // of width by height pixels.
+    void bind(const Shader &shader, float width, float height) const;
+
+    // Offset into getLightIndices() and number of lights of every cluster,
+    // x varying fastest, then y, then z.
+    const std::vector<glm::uvec2> &getClusters() const
+    {
+        return mClusters.data();
+    }
+
+    // Lights of the clusters. Only the first getStats().references are
+    // used, the rest is room to grow.
+    const std::vector<std::uint32_t> &getLightIndices() const
+    {
+        return mLightIndices.data();
+    }
+
+    const ClusterStats &getStats() const
+    {
+        return mStats;
+    }
+
+    // Distance at which light falls below 1/256 of its brightest color.
+    // Throws std::invalid_argument if it never does.
+    static float getRange(const ClusterLight &light);
+
+private:
+    // A light in view space and the clusters it might touch.
+    struct lightBounds
+    {
+        glm::vec3 center;
+        float radiusSq;
+        int minX, maxX, minY, maxY, minZ, maxZ;
+    };
+
+    lightBounds getBounds(const ClusterLight &light, const glm::mat4 &view) const;
+    // List the lights of every cluster in slice z.
+    void fillSlice(std::uint32_t z);
+
+    glm::mat4 mProjection;
+    float mNear;
+    float mFar;
+    // Slice of view depth d is log(d / mNear) * mDepthScale.
+    float mDepthScale;
+    // Cluster boxes in view space, structure of arrays.
+    std::vector<float> mMinX, mMaxX, mMinY, mMaxY, mMinZ, mMaxZ;
+
+    std::vector<ClusterLight> mLights;
+    bool mLightsChanged;
+    std::vector<lightBounds> mBounds;
+    // (cluster in slice, light) pairs found by fillSlice().
+    std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> mSliceRefs;
+    // The lights of mSliceRefs sorted by cluster, and the number of lights
+    // of every cluster in the slice.
+    std::vector<std::vector<std::uint32_t>> mSliceLights;
+    std::vector<std::array<std::uint32_t, GRID_X * GRID_Y>> mSliceCounts;
+
+    StorageBuffer<ClusterLight> mLightBuffer;
+    StorageBuffer<glm::uvec2> mClusters;
+    StorageBuffer<std::uint32_t> mLightIndices;
+    ClusterStats mStats;
+};
+
+#endif /* LIGHT_CLUSTERS_HPP */
@@ -0,0 +1,337 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "loadobj.hpp"
+#include "../jobs.hpp"
+
+namespace
+{
+    using cullClock = std::chrono::steady_clock;
+
+    double millisecondsSince(cullClock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(cullClock::now() - start).count();
+    }
+
+    // Whether a clip space position is behind the near plane (or the
+    // camera), where dividing by w does not give a screen position.
+    bool isBehindNear(const glm::vec4 &clip)
+    {
+        return clip.w <= 0.f || clip.z < -clip.w;
+    }
+
+    // Pixel coordinates and [0, 1] depth of a clip space position.
+    glm::vec3 toScreen(const glm::vec4 &clip)
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+                         (ndc.y * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+                         ndc.z * 0.5f + 0.5f);
+    }
+}
+
+std::shared_ptr<OccluderMesh> OccluderMesh::load(const std::filesystem::path &path)
+{
+    auto bufs = loadObjFile(path);
+    auto mesh = std::make_shared<OccluderMesh>();
+    mesh->vertices = std::move(bufs.vertices);
+    mesh->indices = std::move(bufs.indices);
+    return mesh;
+}
+
+std::shared_ptr<OccluderMesh> OccluderMesh::simplify(const buffers &mesh, int cells)
+{
+    glm::vec3 extent = mesh.bounds.max - mesh.bounds.min;
+    float cellSize = std::max({extent.x, extent.y, extent.z}) / std::max(cells, 1);
+    if(cellSize <= 0.f)
+        cellSize = 1.f;
+
+    // Every vertex goes to the average of the vertices in its cube.
+    auto proxy = std::make_shared<OccluderMesh>();
+    std::unordered_map<std::uint64_t, std::uint32_t> cellVertices;
+    std::vector<std::uint32_t> vertexCounts;
+    std::vector<std::uint32_t> remap(mesh.vertices.size());
+    for(std::size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        auto cell = glm::min(glm::uvec3((mesh.vertices[i] - mesh.bounds.min) / cellSize),
+                             glm::uvec3(0xfffff));
+        std::uint64_t key = (std::uint64_t(cell.x) << 40) | (std::uint64_t(cell.y) << 20)
+            | cell.z;
+        auto [it, inserted] = cellVertices.try_emplace(
+            key, static_cast<std::uint32_t>(proxy->vertices.size()));
+        if(inserted)
+        {
+            proxy->vertices.emplace_back(0.f);
+            vertexCounts.push_back(0);
+        }
+        proxy->vertices[it->second] += mesh.vertices[i];
+        vertexCounts[it->second]++;
+        remap[i] = it->second;
+    }
+    for(std::size_t i = 0; i < proxy->vertices.size(); i++)
+        proxy->vertices[i] /= static_cast<float>(vertexCounts[i]);
+
+    // Triangles with two corners in the same cube collapse.
+    for(std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        auto a = remap[mesh.indices[i]];
+        auto b = remap[mesh.indices[i + 1]];
+        auto c = remap[mesh.indices[i + 2]];
+        if(a != b && b != c && c != a)
+            proxy->indices.insert(proxy->indices.end(), {a, b, c});
+    }
+    return proxy;
+}
+
+OcclusionCuller::OcclusionCuller()
+    : mViewProjection(1.f),mDepth(WIDTH * HEIGHT, 1.f),mNumChunks(0)
+{
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProjection)
+{
+    mViewProjection = viewProjection;
+    mOccluders.clear();
+    std::fill(mDepth.begin(), mDepth.end(), 1.f);
+    mStats = OcclusionStats();
+}
+
+void OcclusionCuller::addOccluder(const OccluderMesh &mesh, const glm::mat4 &model)
+{
+    mOccluders.push_back({&mesh, model});
+}
+
+void OcclusionCuller::rasterize()
+{
+    auto start = cullClock::now();
+    mNumChunks = 0;
+    for(const auto &o : mOccluders)
+        setupTriangles(o);
+
+    jobs::parallelFor(NUM_TILES_X * NUM_TILES_Y, 1, [this](std::size_t first, std::size_t last)
+    {
+        for(auto tile = first; tile < last; tile++)
+            rasterizeTile(static_cast<int>(tile));
+    });
+
+    mStats.occluders = mOccluders.size();
+    for(std::size_t chunk = 0; chunk < mNumChunks; chunk++)
+        mStats.triangles += mChunks[chunk].triangles.size();
+    mStats.rasterizeMs = millisecondsSince(start);
+}
+
+bool OcclusionCuller::isVisible(const AABB &box) const
+{
+    glm::vec2 screenMin(std::numeric_limits<float>::max());
+    glm::vec2 screenMax(-std::numeric_limits<float>::max());
+    float minDepth = std::numeric_limits<float>::max();
+    for(int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                         (i & 2) ? box.max.y : box.min.y,
+                         (i & 4) ? box.max.z : box.min.z);
+        auto clip = mViewProjection * glm::vec4(corner, 1.f);
+        if(isBehindNear(clip))
+            return true;
+        auto screen = toScreen(clip);
+        screenMin = glm::min(screenMin, glm::vec2(screen));
+        screenMax = glm::max(screenMax, glm::vec2(screen));
+        minDepth = std::min(minDepth, screen.z);
+    }
+
+    // Every pixel the rectangle touches.
+    int minX = std::max(0, static_cast<int>(std::floor(screenMin.x)));
+    int minY = std::max(0, static_cast<int>(std::floor(screenMin.y)));
+    int maxX = std::min(WIDTH - 1, static_cast<int>(std::floor(screenMax.x)));
+    int maxY = std::min(HEIGHT - 1, static_cast<int>(std::floor(screenMax.y)));
+    if(minX > maxX || minY > maxY)
+        return false;
+
+    for(int y = minY; y <= maxY; y++)
+    {
+        const float *row = mDepth.data() + y * WIDTH;
+        int x = minX;
+#if defined(__SSE2__)
+        __m128 depth = _mm_set1_ps(minDepth);
+        for(; x + 3 <= maxX; x += 4)
+            if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), depth)) != 0)
+                return true;
+#endif
+        for(; x <= maxX; x++)
+            if(row[x] >= minDepth)
+                return true;
+    }
+    return false;
+}
+
+void OcclusionCuller::cull(const std::vector<AABB> &bounds,
+                           std::vector<std::uint32_t> &visible)
+{
+    auto start = cullClock::now();
+    mResults.resize(visible.size());
+    jobs::parallelFor(visible.size(), 256, [&](std::size_t first, std::size_t last)
+    {
+        for(auto i = first; i < last; i++)
+            mResults[i] = isVisible(bounds[visible[i]]);
+    });
+
+    std::size_t numVisible = 0;
+    for(std::size_t i = 0; i < visible.size(); i++)
+        if(mResults[i])
+            visible[numVisible++] = visible[i];
+
+    mStats.tested += visible.size();
+    mStats.occluded += visible.size() - numVisible;
+    visible.resize(numVisible);
+    mStats.testMs += millisecondsSince(start);
+}
+
+void OcclusionCuller::setupTriangles(const occluder &o)
+{
+    const auto &vertices = o.mesh->vertices;
+    const auto &indices = o.mesh->indices;
+    auto modelViewProjection = mViewProjection * o.model;
+    mClipVertices.resize(vertices.size());
+    jobs::parallelFor(vertices.size(), 4096, [&](std::size_t first, std::size_t last)
+    {
+        for(auto i = first; i < last; i++)
+            mClipVertices[i] = modelViewProjection * glm::vec4(vertices[i], 1.f);
+    });
+
+    // Each job sets up its triangles into its own chunk, which keeps them
+    // in the same order as in the mesh.
+    std::size_t numTriangles = indices.size() / 3;
+    std::size_t firstChunk = mNumChunks;
+    mNumChunks += (numTriangles + SETUP_GRAIN - 1) / SETUP_GRAIN;
+    if(mChunks.size() < mNumChunks)
+        mChunks.resize(mNumChunks);
+    jobs::parallelFor(numTriangles, SETUP_GRAIN, [&](std::size_t first, std::size_t last)
+    {
+        auto &chunk = mChunks[firstChunk + first / SETUP_GRAIN];
+        chunk.triangles.clear();
+        for(auto &bin : chunk.bins)
+            bin.clear();
+
+        for(auto t = first; t < last; t++)
+        {
+            const auto &c0 = mClipVertices[indices[t * 3]];
+            const auto &c1 = mClipVertices[indices[t * 3 + 1]];
+            const auto &c2 = mClipVertices[indices[t * 3 + 2]];
+            // Not drawing part of an occluder only makes culling less
+            // effective, so triangles are not clipped.
+            if(isBehindNear(c0) || isBehindNear(c1) || isBehindNear(c2))
+                continue;
+
+            auto v0 = toScreen(c0);
+            auto v1 = toScreen(c1);
+            auto v2 = toScreen(c2);
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+            if(area <= 0.f)
+                continue;
+
+            screenTriangle tri;
+            tri.minX = std::max(0, static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))));
+            tri.minY = std::max(0, static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))));
+            tri.maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max({v0.x, v1.x, v2.x}))));
+            tri.maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(std::max({v0.y, v1.y, v2.y}))));
+            if(tri.minX > tri.maxX || tri.minY > tri.maxY)
+                continue;
+
+            // Edge k is opposite vertex k, and is positive on the inside.
+            const glm::vec3 *v[3] = {&v0, &v1, &v2};
+            for(int k = 0; k < 3; k++)
+            {
+                const auto &from = *v[(k + 1) % 3];
+                const auto &to = *v[(k + 2) % 3];
+                tri.edgeA[k] = from.y - to.y;
+                tri.edgeB[k] = to.x - from.x;
+                tri.edgeC[k] = -(tri.edgeA[k] * from.x + tri.edgeB[k] * from.y);
+            }
+            // Edge k over the area is the barycentric coordinate of vertex k.
+            tri.depthA = (v0.z * tri.edgeA[0] + v1.z * tri.edgeA[1] + v2.z * tri.edgeA[2]) / area;
+            tri.depthB = (v0.z * tri.edgeB[0] + v1.z * tri.edgeB[1] + v2.z * tri.edgeB[2]) / area;
+            tri.depthC = (v0.z * tri.edgeC[0] + v1.z * tri.edgeC[1] + v2.z * tri.edgeC[2]) / area;
+
+            auto index = static_cast<std::uint32_t>(chunk.triangles.size());
+            chunk.triangles.push_back(tri);
+            for(int ty = tri.minY / TILE_HEIGHT; ty <= tri.maxY / TILE_HEIGHT; ty++)
+                for(int tx = tri.minX / TILE_WIDTH; tx <= tri.maxX / TILE_WIDTH; tx++)
+                    chunk.bins[ty * NUM_TILES_X + tx].push_back(index);
+        }
+    });
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+    int tileX = (tile % NUM_TILES_X) * TILE_WIDTH;
+    int tileY = (tile / NUM_TILES_X) * TILE_HEIGHT;
+
+    for(std::size_t chunk = 0; chunk < mNumChunks; chunk++)
+    {
+        const auto &triangles = mChunks[chunk].triangles;
+        for(auto index : mChunks[chunk].bins[tile])
+        {
+            const auto &tri = triangles[index];
+            // Start on a multiple of 4 so that the SSE loop never writes past
+            // the end of the tile.
+            int minX = std::max(tri.minX, tileX) & ~3;
+            int maxX = std::min(tri.maxX, tileX + TILE_WIDTH - 1);
+            int minY = std::max(tri.minY, tileY);
+            int maxY = std::min(tri.maxY, tileY + TILE_HEIGHT - 1);
+
+            for(int y = minY; y <= maxY; y++)
+            {
+                float py = y + 0.5f;
+                float *row = mDepth.data() + y * WIDTH;
+#if defined(__SSE2__)
+                __m128 rowEdge[3];
+                __m128 edgeA[3];
+                for(int k = 0; k < 3; k++)
+                {
+                    rowEdge[k] = _mm_set1_ps(tri.edgeB[k] * py + tri.edgeC[k]);
+                    edgeA[k] = _mm_set1_ps(tri.edgeA[k]);
+                }
+                __m128 rowDepth = _mm_set1_ps(tri.depthB * py + tri.depthC);
+                __m128 depthA = _mm_set1_ps(tri.depthA);
+                __m128 zero = _mm_setzero_ps();
+                const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+                for(int x = minX; x <= maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), rowEdge[0]), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), rowEdge[1]), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), rowEdge[2]), zero));
+                    if(_mm_movemask_ps(inside) == 0)
+                        continue;
+
+                    __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                                     _mm_andnot_ps(inside, old)));
+                }
+#else
+                for(int x = minX; x <= maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for(int k = 0; k < 3; k++)
+                        inside = inside && tri.edgeA[k] * px + tri.edgeB[k] * py + tri.edgeC[k] >= 0.f;
+                    if(inside)
+                        row[x] = std::min(row[x], tri.depthA * px + tri.depthB * py + tri.depthC);
+                }
+#endif
+            }
+        }
+    }
+}
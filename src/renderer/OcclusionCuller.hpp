@@ -0,0 +1,136 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#include "Bounds.hpp"
+
+struct buffers;
+
+// Triangles drawn into the occlusion buffer. Occluders should be large,
+// closed and have few triangles, front faces counter clockwise.
+struct OccluderMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<std::uint32_t> indices;
+
+    // The positions and triangles of an OBJ file.
+    static std::shared_ptr<OccluderMesh> load(const std::filesystem::path &path);
+    // A low-poly proxy of mesh, made by merging the vertices in each cube
+    // of a grid with cells cubes along the longest side of its bounds.
+    // The proxy can stick out of the mesh by up to a cube.
+    static std::shared_ptr<OccluderMesh> simplify(const buffers &mesh, int cells);
+};
+
+// Work done by the last frame of an OcclusionCuller.
+struct OcclusionStats
+{
+    std::size_t occluders = 0;
+    // Triangles that were on screen and front facing.
+    std::size_t triangles = 0;
+    std::size_t tested = 0;
+    std::size_t occluded = 0;
+    double rasterizeMs = 0.;
+    double testMs = 0.;
+};
+
+// Software occlusion culling. Occluders are rasterized on the CPU into a
+// small depth buffer, split into tiles that are filled in parallel, 4
+// pixels at a time with SSE. Triangles are set up and binned to tiles in
+// parallel too, in chunks of SETUP_GRAIN. Objects whose screen space bounds
+// are behind every depth they cover are occluded. Nothing is read back from
+// the GPU.
+class OcclusionCuller
+{
+public:
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 128;
+    static constexpr int TILE_WIDTH = 64;
+    static constexpr int TILE_HEIGHT = 32;
+    static constexpr int NUM_TILES_X = WIDTH / TILE_WIDTH;
+    static constexpr int NUM_TILES_Y = HEIGHT / TILE_HEIGHT;
+    // Triangles per job of triangle setup.
+    static constexpr std::size_t SETUP_GRAIN = 1024;
+
+    OcclusionCuller();
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    ~OcclusionCuller() = default;
+
+    // Start a frame seen through viewProjection: clear the depth buffer and
+    // the occluders.
+    void begin(const glm::mat4 &viewProjection);
+
+    // Draw mesh, placed by model, at the next rasterize(). The mesh must
+    // stay alive until then.
+    void addOccluder(const OccluderMesh &mesh, const glm::mat4 &model);
+
+    // Draw the occluders into the depth buffer.
+    void rasterize();
+
+    // Whether any of box might be in front of the depth buffer. Boxes
+    // crossing the near plane are always visible.
+    bool isVisible(const AABB &box) const;
+
+    // Remove the indices from visible whose bounds are occluded, keeping
+    // the order of the rest.
+    void cull(const std::vector<AABB> &bounds,
+              std::vector<std::uint32_t> &visible);
+
+    // Depth of each pixel, in [0, 1] from near to far, bottom row first.
+    const std::vector<float> &getDepthBuffer() const
+    {
+        return mDepth;
+    }
+
+    const OcclusionStats &getStats() const
+    {
+        return mStats;
+    }
+
+private:
+    // A triangle in pixel coordinates, with its edge functions and depth
+    // plane set up as a * x + b * y + c.
+    struct screenTriangle
+    {
+        std::array<float, 3> edgeA, edgeB, edgeC;
+        float depthA, depthB, depthC;
+        int minX, minY, maxX, maxY;
+    };
+
+    struct occluder
+    {
+        const OccluderMesh *mesh;
+        glm::mat4 model;
+    };
+
+    // The triangles set up by one job, and the indices of the ones
+    // overlapping each tile.
+    struct setupChunk
+    {
+        std::vector<screenTriangle> triangles;
+        std::array<std::vector<std::uint32_t>, NUM_TILES_X * NUM_TILES_Y> bins;
+    };
+
+    glm::mat4 mViewProjection;
+    std::vector<float> mDepth;
+    std::vector<occluder> mOccluders;
+    // Kept across frames to reuse their memory, only the first
+    // mNumChunks are used by the current one.
+    std::vector<setupChunk> mChunks;
+    std::size_t mNumChunks;
+    std::vector<glm::vec4> mClipVertices;
+    std::vector<std::uint8_t> mResults;
+    OcclusionStats mStats;
+
+    void setupTriangles(const occluder &o);
+    void rasterizeTile(int tile);
+};
+
+#endif /* OCCLUSION_CULLER_HPP */
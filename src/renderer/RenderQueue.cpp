@@ -0,0 +1,218 @@
+#include "RenderQueue.hpp"
+
+#include <array>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "DepthPrepass.hpp"
+#include "RingBuffer.hpp"
+
+namespace
+{
+    // Packets that share a shader and texture, drawn by one multi-draw.
+    struct stateRun
+    {
+        Shader *shader;
+        Texture *texture;
+        std::size_t firstCommand;
+        std::size_t numCommands;
+    };
+}
+
+RenderQueue::RenderQueue(GeometryHeap &heap, RingBuffer &ring)
+    : mHeap(heap),mRing(ring),mNear(0.1f),mFar(1000.f),mPackets(),mKeys(),
+      mScratch(),mShaderIDs(),mTextureIDs(),mMeshIDs(),mCommands(),mModels(),
+      mInstanceIndices(),mStats()
+{
+}
+
+void RenderQueue::setDepthRange(float near, float far)
+{
+    mNear = near;
+    mFar = far;
+}
+
+void RenderQueue::submit(std::uint8_t layer, Shader *shader, Texture *texture,
+                         const MeshRange &mesh, const glm::mat4 &model,
+                         float viewDepth)
+{
+    float depth = std::clamp((viewDepth - mNear) / (mFar - mNear), 0.f, 1.f);
+    auto key = makeKey(layer, getKeyID(mShaderIDs, shader, MAX_SHADERS),
+                       getKeyID(mTextureIDs, texture, MAX_TEXTURES),
+                       getKeyID(mMeshIDs, mesh.firstIndex, MAX_MESHES),
+                       static_cast<std::uint16_t>(depth * 65535.f));
+
+    mKeys.emplace_back(key, static_cast<std::uint32_t>(mPackets.size()));
+    mPackets.push_back(packet{shader, texture, mesh, model});
+}
+
+void RenderQueue::execute(const glm::mat4 &view, const glm::mat4 &projection,
+                          Shader *shader, DepthPrepass *prepass)
+{
+    mStats = RenderQueueStats();
+    mStats.packets = mPackets.size();
+    if(mPackets.empty())
+        return;
+
+    radixSort(mKeys, mScratch);
+
+    if(mInstanceIndices.size() < mPackets.size())
+    {
+        mInstanceIndices.resize(std::max(mPackets.size(), mInstanceIndices.size() * 2));
+        std::iota(mInstanceIndices.data().begin(), mInstanceIndices.data().end(), 0u);
+        mInstanceIndices.upload();
+    }
+    // Set every frame, other users of the heap change it.
+    mHeap.setInstanceIndexBuffer(mInstanceIndices.getID());
+
+    // Turn the sorted packets into commands, starting a new command when
+    // the mesh changes and a new multi-draw when the shader or texture do.
+    // The instances are computed straight into the ring afterwards, the
+    // commands are built here first because their instance counts are read
+    // back.
+    mModels.resize(mPackets.size());
+    mCommands.resize(mPackets.size());
+    std::vector<stateRun> runs;
+    std::size_t numCommands = 0;
+    for(std::uint32_t i = 0; i < mKeys.size(); i++)
+    {
+        const auto &p = mPackets[mKeys[i].second];
+        bool newRun = runs.empty() || runs.back().shader != p.shader ||
+            runs.back().texture != p.texture;
+        if(newRun)
+            runs.push_back(stateRun{p.shader, p.texture, numCommands, 0});
+
+        auto &previous = mCommands[numCommands == 0 ? 0 : numCommands - 1];
+        if(newRun || previous.firstIndex != p.mesh.firstIndex)
+        {
+            mCommands[numCommands++] = DrawElementsIndirectCommand{
+                p.mesh.indexCount, 0, p.mesh.firstIndex,
+                static_cast<std::int32_t>(p.mesh.baseVertex), i,
+            };
+            runs.back().numCommands++;
+        }
+        mCommands[numCommands - 1].instanceCount++;
+        mModels.set(i, p.model);
+    }
+
+    auto viewProjection = projection * view;
+    auto instanceAllocation = mRing.allocateStorage<InstanceData>(mPackets.size());
+    mModels.compute(viewProjection, instanceAllocation.as<InstanceData>(), nullptr);
+    auto commandAllocation = mRing.allocate(
+        numCommands * sizeof(DrawElementsIndirectCommand),
+        alignof(DrawElementsIndirectCommand));
+    std::memcpy(commandAllocation.data, mCommands.data(), commandAllocation.size);
+    mRing.bindRange(GL_SHADER_STORAGE_BUFFER, InstanceBatcher::INSTANCE_BINDING,
+                    instanceAllocation);
+
+    // Commands are read from their offset in the ring.
+    const auto *commands = reinterpret_cast<const std::uint8_t*>(commandAllocation.offset);
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mRing.getID()));
+    if(prepass != nullptr)
+    {
+        // Every packet has the same state in the pre-pass, so all of the
+        // commands are drawn at once.
+        prepass->beginDepth();
+        auto &depthShader = prepass->getShader();
+        depthShader.set("uViewProjectionMatrix", viewProjection);
+        depthShader.bind();
+        mHeap.bindPositions();
+        GLCall(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commands,
+                                           static_cast<GLsizei>(numCommands), 0));
+        mStats.drawCalls++;
+        prepass->beginShading();
+    }
+
+    Shader *boundShader = nullptr;
+    Texture *boundTexture = nullptr;
+    mHeap.bind();
+    for(const auto &run : runs)
+    {
+        auto *runShader = shader != nullptr ? shader : run.shader;
+        if(runShader != boundShader)
+        {
+            runShader->set("uViewProjectionMatrix", viewProjection);
+            runShader->bind();
+            boundShader = runShader;
+            mStats.shaderChanges++;
+        }
+        if(run.texture != boundTexture)
+        {
+            run.texture->bind();
+            boundTexture = run.texture;
+            mStats.textureChanges++;
+        }
+        GLCall(glMultiDrawElementsIndirect(
+                   GL_TRIANGLES, GL_UNSIGNED_INT,
+                   commands + run.firstCommand * sizeof(DrawElementsIndirectCommand),
+                   static_cast<GLsizei>(run.numCommands), 0));
+        mStats.drawCalls++;
+    }
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    mHeap.unbind();
+    if(prepass != nullptr)
+        prepass->end();
+
+    mStats.commands = numCommands;
+    mPackets.clear();
+    mKeys.clear();
+}
+
+std::uint64_t RenderQueue::makeKey(std::uint8_t layer, std::uint32_t shader,
+                                   std::uint32_t texture, std::uint32_t mesh,
+                                   std::uint16_t depth)
+{
+    return (static_cast<std::uint64_t>(layer) << 56) |
+        (static_cast<std::uint64_t>(shader & (MAX_SHADERS - 1)) << 44) |
+        (static_cast<std::uint64_t>(texture & (MAX_TEXTURES - 1)) << 32) |
+        (static_cast<std::uint64_t>(mesh & (MAX_MESHES - 1)) << 16) |
+        static_cast<std::uint64_t>(depth);
+}
+
+void RenderQueue::radixSort(std::vector<std::pair<std::uint64_t, std::uint32_t>> &items,
+                            std::vector<std::pair<std::uint64_t, std::uint32_t>> &scratch)
+{
+    if(items.empty())
+        return;
+
+    scratch.resize(items.size());
+    for(unsigned shift = 0; shift < 64; shift += 8)
+    {
+        std::array<std::size_t, 256> counts = {};
+        for(const auto &item : items)
+            counts[(item.first >> shift) & 0xff]++;
+        // Every key has the same digit, the pass would not move anything.
+        if(counts[(items.front().first >> shift) & 0xff] == items.size())
+            continue;
+
+        std::size_t offset = 0;
+        for(auto &count : counts)
+        {
+            auto c = count;
+            count = offset;
+            offset += c;
+        }
+        for(const auto &item : items)
+            scratch[counts[(item.first >> shift) & 0xff]++] = item;
+        items.swap(scratch);
+    }
+}
+
+template<typename T>
+std::uint32_t RenderQueue::getKeyID(std::unordered_map<T, std::uint32_t> &ids,
+                                    T value, std::uint32_t max)
+{
+    if(auto it = ids.find(value); it != ids.end())
+        return it->second;
+    if(ids.size() >= max)
+        throw std::length_error(fmt::format("Render queue key field is full ({} IDs)",
+                                            max));
+    auto id = static_cast<std::uint32_t>(ids.size());
+    ids.emplace(value, id);
+    return id;
+}
@@ -0,0 +1,141 @@
+#ifndef RENDER_QUEUE_HPP
+#define RENDER_QUEUE_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "glutil.hpp"
+#include "GeometryHeap.hpp"
+#include "InstanceBatcher.hpp"
+#include "StorageBuffer.hpp"
+#include "TransformBatch.hpp"
+
+class Texture;
+class Shader;
+class DepthPrepass;
+class RingBuffer;
+
+// Layout of the commands read by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand
+{
+    std::uint32_t count;
+    std::uint32_t instanceCount;
+    std::uint32_t firstIndex;
+    std::int32_t baseVertex;
+    std::uint32_t baseInstance;
+};
+
+// State changes made by the last RenderQueue::execute().
+struct RenderQueueStats
+{
+    std::size_t packets = 0;
+    std::size_t shaderChanges = 0;
+    std::size_t textureChanges = 0;
+    // glMultiDrawElementsIndirect calls.
+    std::size_t drawCalls = 0;
+    // Indirect commands, one per run of packets sharing a mesh.
+    std::size_t commands = 0;
+};
+
+// Sorted queue of draw packets for meshes stored in a GeometryHeap.
+//
+// Every packet gets a 64-bit key, from the most to the least significant
+// bits: layer (8), shader (12), texture (12), mesh (16) and quantized view
+// depth (16). The keys are radix sorted every frame and the packets are
+// executed in that order, so programs and textures are only changed when
+// the key changes. Packets that share a shader and texture are drawn with
+// one glMultiDrawElementsIndirect call, packets that also share a mesh
+// become the instances of one command.
+//
+// Per-instance data is indexed as in the MULTI_DRAW variant of main.vert.
+// The commands and instances of every frame are streamed through a
+// RingBuffer, the instances' model and normal matrices are computed by a
+// TransformBatch straight into it.
+class RenderQueue
+{
+public:
+    // Maximum number of distinct values of each key field.
+    static constexpr std::uint32_t MAX_SHADERS = 1 << 12;
+    static constexpr std::uint32_t MAX_TEXTURES = 1 << 12;
+    static constexpr std::uint32_t MAX_MESHES = 1 << 16;
+
+    // The ring must be between beginFrame() and endFrame() when the queue
+    // is executed.
+    RenderQueue(GeometryHeap &heap, RingBuffer &ring);
+    RenderQueue(const RenderQueue &) = delete;
+    ~RenderQueue() = default;
+
+    // Set the range of view depths that is quantized into the key, depths
+    // outside of it are clamped.
+    void setDepthRange(float near, float far);
+
+    // Queue a draw of mesh with the affine model matrix model. Lower layers
+    // are drawn first, inside a layer packets are ordered by state and then
+    // front to back by viewDepth.
+    void submit(std::uint8_t layer, Shader *shader, Texture *texture,
+                const MeshRange &mesh, const glm::mat4 &model, float viewDepth);
+
+    // Sort the queue, draw every packet and clear the queue. If shader is
+    // not null every packet is drawn with it instead of its own, as when
+    // filling a G-buffer. If prepass is not null the packets are drawn
+    // into the depth buffer by it first.
+    void execute(const glm::mat4 &view, const glm::mat4 &projection,
+                 Shader *shader = nullptr, DepthPrepass *prepass = nullptr);
+
+    const RenderQueueStats &getStats() const
+    {
+        return mStats;
+    }
+
+    // Build a sort key. Exposed for debugging and profiling.
+    static std::uint64_t makeKey(std::uint8_t layer, std::uint32_t shader,
+                                 std::uint32_t texture, std::uint32_t mesh,
+                                 std::uint16_t depth);
+
+    // LSD radix sort of (key, value) pairs by key, 8 bits per pass. Passes
+    // in which every key has the same digit are skipped. scratch is resized
+    // as needed and reused between calls.
+    static void radixSort(std::vector<std::pair<std::uint64_t, std::uint32_t>> &items,
+                          std::vector<std::pair<std::uint64_t, std::uint32_t>> &scratch);
+
+private:
+    struct packet
+    {
+        Shader *shader;
+        Texture *texture;
+        MeshRange mesh;
+        glm::mat4 model;
+    };
+
+    // Map a pointer or mesh to a small ID for the key. IDs are handed out
+    // in order of first use and kept for the queue's lifetime.
+    template<typename T>
+    static std::uint32_t getKeyID(std::unordered_map<T, std::uint32_t> &ids,
+                                  T value, std::uint32_t max);
+
+    GeometryHeap &mHeap;
+    RingBuffer &mRing;
+    float mNear;
+    float mFar;
+    std::vector<packet> mPackets;
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> mKeys;
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> mScratch;
+    std::unordered_map<Shader*, std::uint32_t> mShaderIDs;
+    std::unordered_map<Texture*, std::uint32_t> mTextureIDs;
+    // By first index, which is unique per mesh in the heap.
+    std::unordered_map<std::uint32_t, std::uint32_t> mMeshIDs;
+
+    // Commands of the current frame, before they are copied to the ring.
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    // Model matrices of the packets in sorted order.
+    TransformBatch mModels;
+    // 0, 1, 2, ... read through the heap's instance index attribute.
+    StorageBuffer<std::uint32_t> mInstanceIndices;
+    RenderQueueStats mStats;
+};
+
+#endif /* RENDER_QUEUE_HPP */
@@ -0,0 +1,295 @@
+#include "RenderTarget.hpp"
+
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <glad/glad.h>
+#include <fmt/core.h>
+
+#include "glutil.hpp"
+
+namespace
+{
+    // Bytes per sample of the formats render targets are usually made of,
+    // 4 for the others.
+    std::size_t getBytesPerPixel(std::uint32_t format)
+    {
+        switch(format)
+        {
+        case GL_R8:
+            return 1;
+        case GL_RG8:
+        case GL_R16F:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGBA16F:
+        case GL_RG32F:
+        case GL_DEPTH32F_STENCIL8:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    bool hasStencil(std::uint32_t format)
+    {
+        return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+}
+
+RenderTarget::attachments RenderTarget::create(const RenderTargetDesc &desc, int samples)
+{
+    attachments result;
+    GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    auto createTexture = [&](TextureHandle &handle, GLenum format)
+    {
+        GLCall(glCreateTextures(target, 1, handle.put()));
+        auto texture = handle.get();
+        if(samples > 1)
+        {
+            GLCall(glTextureStorage2DMultisample(texture, samples, format, desc.width,
+                                                 desc.height, GL_TRUE));
+        }
+        else
+        {
+            GLCall(glTextureStorage2D(texture, 1, format, desc.width, desc.height));
+            GLCall(glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+            GLCall(glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+            GLCall(glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GLCall(glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        }
+    };
+
+    GLCall(glCreateFramebuffers(1, result.framebuffer.put()));
+    auto framebuffer = result.framebuffer.get();
+    std::array<GLenum, RenderTargetDesc::MAX_COLORS> drawBuffers = {};
+    GLsizei numColors = 0;
+    for(std::size_t i = 0; i < desc.colorFormats.size() && desc.colorFormats[i] != 0; i++)
+    {
+        createTexture(result.colors[i], desc.colorFormats[i]);
+        GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        GLCall(glNamedFramebufferTexture(framebuffer, attachment, result.colors[i].get(), 0));
+        drawBuffers[numColors++] = attachment;
+    }
+    if(numColors == 0)
+    {
+        GLCall(glNamedFramebufferDrawBuffer(framebuffer, GL_NONE));
+        GLCall(glNamedFramebufferReadBuffer(framebuffer, GL_NONE));
+    }
+    else
+    {
+        GLCall(glNamedFramebufferDrawBuffers(framebuffer, numColors, drawBuffers.data()));
+    }
+
+    if(desc.depthFormat != 0)
+    {
+        createTexture(result.depth, desc.depthFormat);
+        GLCall(glNamedFramebufferTexture(framebuffer,
+                                         hasStencil(desc.depthFormat) ?
+                                         GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                                         result.depth.get(), 0));
+    }
+
+    GLenum status = 0;
+    GLCall(status = glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER));
+    if(status != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error(fmt::format("Render target framebuffer is incomplete: {:#x}",
+                                             status));
+    return result;
+}
+
+RenderTarget::RenderTarget(const RenderTargetDesc &desc)
+    : mDesc(desc),mNumColors(0),mFramebuffer(),mColors(),mDepth(),mResolved()
+{
+    while(mNumColors < desc.colorFormats.size() && desc.colorFormats[mNumColors] != 0)
+        mNumColors++;
+    if(desc.width <= 0 || desc.height <= 0 || desc.samples < 1)
+    {
+        throw std::invalid_argument(fmt::format("Bad render target of {}x{} pixels, {} samples",
+                                                desc.width, desc.height, desc.samples));
+    }
+    if(mNumColors == 0 && desc.depthFormat == 0)
+        throw std::invalid_argument("Render target without attachments");
+
+    auto created = create(desc, desc.samples);
+    mFramebuffer = std::move(created.framebuffer);
+    mColors = std::move(created.colors);
+    mDepth = std::move(created.depth);
+}
+
+void RenderTarget::bind() const
+{
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer.get()));
+    GLCall(glViewport(0, 0, mDesc.width, mDesc.height));
+}
+
+void RenderTarget::resolve()
+{
+    if(mDesc.samples == 1)
+        return;
+    if(!mResolved.framebuffer)
+        mResolved = create(mDesc, 1);
+
+    auto source = mFramebuffer.get();
+    auto destination = mResolved.framebuffer.get();
+    // Blits copy one color attachment at a time.
+    for(std::size_t i = 0; i < mNumColors; i++)
+    {
+        GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        GLCall(glNamedFramebufferReadBuffer(source, attachment));
+        GLCall(glNamedFramebufferDrawBuffer(destination, attachment));
+        GLCall(glBlitNamedFramebuffer(source, destination, 0, 0, mDesc.width, mDesc.height,
+                                      0, 0, mDesc.width, mDesc.height,
+                                      GL_COLOR_BUFFER_BIT, GL_NEAREST));
+    }
+    if(mDesc.depthFormat != 0)
+    {
+        GLbitfield mask = GL_DEPTH_BUFFER_BIT
+            | (hasStencil(mDesc.depthFormat) ? GL_STENCIL_BUFFER_BIT : 0);
+        GLCall(glBlitNamedFramebuffer(source, destination, 0, 0, mDesc.width, mDesc.height,
+                                      0, 0, mDesc.width, mDesc.height, mask, GL_NEAREST));
+    }
+
+    if(mNumColors > 0)
+    {
+        std::array<GLenum, RenderTargetDesc::MAX_COLORS> drawBuffers = {};
+        for(std::size_t i = 0; i < mNumColors; i++)
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        GLCall(glNamedFramebufferReadBuffer(source, GL_COLOR_ATTACHMENT0));
+        GLCall(glNamedFramebufferDrawBuffers(destination, static_cast<GLsizei>(mNumColors),
+                                             drawBuffers.data()));
+    }
+}
+
+std::uint32_t RenderTarget::getColorTexture(std::size_t attachment) const
+{
+    return (mResolved.framebuffer ? mResolved.colors : mColors)[attachment].get();
+}
+
+std::uint32_t RenderTarget::getDepthTexture() const
+{
+    return (mResolved.framebuffer ? mResolved.depth : mDepth).get();
+}
+
+std::size_t RenderTarget::getSize() const
+{
+    std::size_t bytesPerPixel = mDesc.depthFormat != 0 ?
+        getBytesPerPixel(mDesc.depthFormat) : 0;
+    for(std::size_t i = 0; i < mNumColors; i++)
+        bytesPerPixel += getBytesPerPixel(mDesc.colorFormats[i]);
+    std::size_t samples = static_cast<std::size_t>(mDesc.samples)
+        + (mResolved.framebuffer ? 1 : 0);
+    return bytesPerPixel * samples * static_cast<std::size_t>(mDesc.width) * mDesc.height;
+}
+
+PooledTarget::PooledTarget(PooledTarget &&other) noexcept
+    : mPool(std::exchange(other.mPool, nullptr)),mIndex(other.mIndex)
+{
+}
+
+PooledTarget &PooledTarget::operator=(PooledTarget &&other) noexcept
+{
+    if(this != &other)
+    {
+        reset();
+        mPool = std::exchange(other.mPool, nullptr);
+        mIndex = other.mIndex;
+    }
+    return *this;
+}
+
+void PooledTarget::reset()
+{
+    if(mPool != nullptr)
+        std::exchange(mPool, nullptr)->release(mIndex);
+}
+
+RenderTarget &PooledTarget::operator*() const
+{
+    return *mPool->mEntries[mIndex].target;
+}
+
+RenderTargetPool::RenderTargetPool()
+    : mEntries(),mFrame(0)
+{
+}
+
+PooledTarget RenderTargetPool::acquire(const RenderTargetDesc &desc)
+{
+    std::size_t freeEntry = mEntries.size();
+    for(std::size_t i = 0; i < mEntries.size(); i++)
+    {
+        auto &e = mEntries[i];
+        if(!e.target)
+        {
+            freeEntry = std::min(freeEntry, i);
+        }
+        else if(!e.acquired && e.target->getDesc() == desc)
+        {
+            e.acquired = true;
+            e.lastUsed = mFrame;
+            return PooledTarget(this, i);
+        }
+    }
+
+    auto target = std::make_unique<RenderTarget>(desc);
+    if(freeEntry == mEntries.size())
+        mEntries.emplace_back();
+    mEntries[freeEntry] = entry{std::move(target), true, mFrame};
+    return PooledTarget(this, freeEntry);
+}
+
+void RenderTargetPool::release(std::size_t index)
+{
+    mEntries[index].acquired = false;
+    mEntries[index].lastUsed = mFrame;
+}
+
+void RenderTargetPool::endFrame()
+{
+    // Deletion waits for the GPU through glres.
+    for(auto &e : mEntries)
+    {
+        if(e.target && !e.acquired && mFrame - e.lastUsed >= UNUSED_FRAMES)
+            e.target.reset();
+    }
+    mFrame++;
+}
+
+void RenderTargetPool::clear()
+{
+    for(auto &e : mEntries)
+    {
+        if(!e.acquired)
+            e.target.reset();
+    }
+}
+
+std::size_t RenderTargetPool::getNumTargets() const
+{
+    std::size_t count = 0;
+    for(const auto &e : mEntries)
+        count += e.target != nullptr;
+    return count;
+}
+
+std::size_t RenderTargetPool::getNumAcquired() const
+{
+    std::size_t count = 0;
+    for(const auto &e : mEntries)
+        count += e.acquired;
+    return count;
+}
+
+std::size_t RenderTargetPool::getSize() const
+{
+    std::size_t size = 0;
+    for(const auto &e : mEntries)
+    {
+        if(e.target)
+            size += e.target->getSize();
+    }
+    return size;
+}
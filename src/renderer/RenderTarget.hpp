@@ -0,0 +1,199 @@
+#ifndef RENDER_TARGET_HPP
+#define RENDER_TARGET_HPP
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "GLResource.hpp"
+
+// What a RenderTarget is made of. Formats are OpenGL sized internal
+// formats, 0 for none.
+struct RenderTargetDesc
+{
+    static constexpr std::size_t MAX_COLORS = 4;
+
+    int width = 0;
+    int height = 0;
+    // Color attachments in order, the used ones first.
+    std::array<std::uint32_t, MAX_COLORS> colorFormats = {};
+    std::uint32_t depthFormat = 0;
+    // 1 for no multisampling.
+    int samples = 1;
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return width == other.width && height == other.height
+            && colorFormats == other.colorFormats && depthFormat == other.depthFormat
+            && samples == other.samples;
+    }
+
+    bool operator!=(const RenderTargetDesc &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// A framebuffer with textures of its own for every attachment, sampled
+// with GL_NEAREST and clamped to the edge.
+//
+// Multisampled targets draw to multisample textures and resolve() copies
+// them to single sampled textures, created on the first call. The
+// get*Texture() functions return the resolved ones.
+class RenderTarget
+{
+public:
+    // Throws std::invalid_argument for a target without attachments or of
+    // no size, std::runtime_error if the framebuffer is incomplete.
+    RenderTarget(const RenderTargetDesc &desc);
+    RenderTarget(const RenderTarget &) = delete;
+    ~RenderTarget() = default;
+
+    // Bind the framebuffer and set the viewport to all of it.
+    void bind() const;
+
+    // Resolve the multisampled attachments. Does nothing for single
+    // sampled targets.
+    void resolve();
+
+    std::uint32_t getFramebuffer() const
+    {
+        return mFramebuffer.get();
+    }
+
+    std::uint32_t getColorTexture(std::size_t attachment = 0) const;
+    std::uint32_t getDepthTexture() const;
+
+    const RenderTargetDesc &getDesc() const
+    {
+        return mDesc;
+    }
+
+    // Video memory taken by the attachments, resolved ones included.
+    std::size_t getSize() const;
+
+private:
+    struct attachments
+    {
+        FramebufferHandle framebuffer;
+        std::array<TextureHandle, RenderTargetDesc::MAX_COLORS> colors;
+        TextureHandle depth;
+    };
+
+    static attachments create(const RenderTargetDesc &desc, int samples);
+
+    RenderTargetDesc mDesc;
+    std::size_t mNumColors;
+    FramebufferHandle mFramebuffer;
+    std::array<TextureHandle, RenderTargetDesc::MAX_COLORS> mColors;
+    TextureHandle mDepth;
+    // Single sampled copy of a multisampled target.
+    attachments mResolved;
+};
+
+class RenderTargetPool;
+
+// A target lent by a RenderTargetPool, given back when the object is
+// destroyed or reset. Move only.
+class PooledTarget
+{
+public:
+    PooledTarget()
+        : mPool(nullptr),mIndex(0)
+    {
+    }
+
+    PooledTarget(const PooledTarget &) = delete;
+    PooledTarget &operator=(const PooledTarget &) = delete;
+    PooledTarget(PooledTarget &&other) noexcept;
+    PooledTarget &operator=(PooledTarget &&other) noexcept;
+
+    ~PooledTarget()
+    {
+        reset();
+    }
+
+    // Give the target back to the pool.
+    void reset();
+
+    RenderTarget &operator*() const;
+
+    RenderTarget *operator->() const
+    {
+        return &**this;
+    }
+
+    explicit operator bool() const
+    {
+        return mPool != nullptr;
+    }
+
+private:
+    friend class RenderTargetPool;
+
+    PooledTarget(RenderTargetPool *pool, std::size_t index)
+        : mPool(pool),mIndex(index)
+    {
+    }
+
+    RenderTargetPool *mPool;
+    std::size_t mIndex;
+};
+
+// Render targets for passes that only need them for part of a frame.
+//
+// acquire() hands out a free target matching a description, creating one
+// if there is none. Once given back it can be handed to the next pass that
+// asks for the same description, so passes that do not overlap share the
+// same memory. Targets of sizes no longer asked for, after a resize, are
+// deleted once they have gone unused for UNUSED_FRAMES frames.
+//
+// OpenGL cannot alias the memory of textures of different formats, so
+// only targets of the same description are shared.
+class RenderTargetPool
+{
+public:
+    static constexpr std::uint64_t UNUSED_FRAMES = 8;
+
+    RenderTargetPool();
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    // Every PooledTarget must have been given back.
+    ~RenderTargetPool() = default;
+
+    // A target matching desc that no one else holds until the returned
+    // object goes away.
+    PooledTarget acquire(const RenderTargetDesc &desc);
+
+    // Delete the targets unused for UNUSED_FRAMES frames. Call once a
+    // frame.
+    void endFrame();
+
+    // Delete every target not being held.
+    void clear();
+
+    std::size_t getNumTargets() const;
+    std::size_t getNumAcquired() const;
+    // Video memory taken by all the targets.
+    std::size_t getSize() const;
+
+private:
+    friend class PooledTarget;
+
+    struct entry
+    {
+        std::unique_ptr<RenderTarget> target;
+        bool acquired;
+        std::uint64_t lastUsed;
+    };
+
+    void release(std::size_t index);
+
+    // Deleted entries are left empty for reuse, so that the indices held by
+    // PooledTargets stay valid.
+    std::vector<entry> mEntries;
+    std::uint64_t mFrame;
+};
+
+#endif /* RENDER_TARGET_HPP */
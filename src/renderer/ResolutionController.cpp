@@ -0,0 +1,63 @@
+#include "ResolutionController.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+
+ResolutionController::ResolutionController(float minScale, float maxScale,
+                                           double budgetMs)
+    : mMinScale(minScale),mMaxScale(maxScale),mBudgetMs(budgetMs),
+      mScale(maxScale),mAverageMs(0.),mHold(0)
+{
+    if(!(minScale > 0.f && minScale <= maxScale))
+        throw std::invalid_argument(fmt::format("Bad resolution scale range {} to {}",
+                                                minScale, maxScale));
+    if(!(budgetMs > 0.))
+        throw std::invalid_argument(fmt::format("Bad frame budget of {} ms", budgetMs));
+}
+
+bool ResolutionController::update(double gpuMs)
+{
+    // The first frame after a change starts the average over.
+    if(mAverageMs == 0.)
+        mAverageMs = gpuMs;
+    else
+        mAverageMs += (gpuMs - mAverageMs) * SMOOTHING;
+
+    if(mHold > 0)
+    {
+        mHold--;
+        return false;
+    }
+    if(mAverageMs <= 0.)
+        return false;
+
+    float scale = mScale;
+    if(mAverageMs > mBudgetMs)
+    {
+        scale = quantize(mScale * static_cast<float>(std::sqrt(mBudgetMs / mAverageMs)));
+    }
+    else if(mAverageMs < mBudgetMs * UPSCALE_HEADROOM)
+    {
+        float target = mScale * static_cast<float>(
+            std::sqrt(mBudgetMs * UPSCALE_HEADROOM / mAverageMs));
+        scale = quantize(std::min(target, mScale + MAX_STEP_UP));
+        // Rounding down may undo a small rise.
+        scale = std::max(scale, mScale);
+    }
+
+    if(scale == mScale)
+        return false;
+    mScale = scale;
+    mAverageMs = 0.;
+    mHold = HOLD_FRAMES;
+    return true;
+}
+
+float ResolutionController::quantize(float scale) const
+{
+    // Scales that are already multiples are not pushed down by rounding.
+    float steps = std::floor(scale / STEP + 1e-3f);
+    return std::clamp(steps * STEP, mMinScale, mMaxScale);
+}
@@ -0,0 +1,63 @@
+#ifndef RESOLUTION_CONTROLLER_HPP
+#define RESOLUTION_CONTROLLER_HPP
+
+// Picks the fraction of the window's resolution the scene is rendered at,
+// so that the GPU time of a frame stays within a budget.
+//
+// GPU time is taken to grow with the number of pixels, the square of the
+// scale. Frame times are smoothed, and when the average goes over the
+// budget the scale drops to the one that would fit it. It only rises again
+// once the average is below UPSCALE_HEADROOM of the budget, toward the
+// scale that would reach that fraction, by at most MAX_STEP_UP at a time.
+// The gap between the two thresholds and a hold of HOLD_FRAMES frames after
+// every change keep it from oscillating. Scales are multiples of STEP,
+// within the range given, so render targets are not resized for changes
+// too small to matter.
+class ResolutionController
+{
+public:
+    static constexpr float STEP = 0.05f;
+    static constexpr float MAX_STEP_UP = 0.1f;
+    static constexpr double UPSCALE_HEADROOM = 0.85;
+    // Long enough for the frames measured to be drawn at the new scale.
+    static constexpr int HOLD_FRAMES = 30;
+    // Weight of every new frame in the average.
+    static constexpr double SMOOTHING = 0.1;
+
+    // Throws std::invalid_argument unless 0 < minScale <= maxScale and the
+    // budget is positive. Starts at maxScale.
+    ResolutionController(float minScale, float maxScale, double budgetMs);
+
+    // Add the GPU time of a frame. Returns whether the scale changed.
+    bool update(double gpuMs);
+
+    float getScale() const
+    {
+        return mScale;
+    }
+
+    // Smoothed GPU time per frame, 0 until the first update().
+    double getAverageMs() const
+    {
+        return mAverageMs;
+    }
+
+    double getBudgetMs() const
+    {
+        return mBudgetMs;
+    }
+
+private:
+    // The multiple of STEP at or below scale, clamped to the range.
+    float quantize(float scale) const;
+
+    float mMinScale;
+    float mMaxScale;
+    double mBudgetMs;
+    float mScale;
+    double mAverageMs;
+    // Frames left before the scale may change again.
+    int mHold;
+};
+
+#endif /* RESOLUTION_CONTROLLER_HPP */
@@ -0,0 +1,110 @@
+#include "RingBuffer.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+
+#include "glutil.hpp"
+
+namespace
+{
+    constexpr GLbitfield MAP_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+        GL_MAP_COHERENT_BIT;
+
+    std::size_t getAlignment(GLenum name)
+    {
+        GLint alignment = 0;
+        GLCall(glGetIntegerv(name, &alignment));
+        return static_cast<std::size_t>(std::max(alignment, 1));
+    }
+}
+
+RingBuffer::RingBuffer(std::size_t frameSize)
+    : mBuffer(),mMapping(nullptr),mFrameSize(frameSize),
+      mStorageAlignment(getAlignment(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT)),
+      mUniformAlignment(getAlignment(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)),
+      mRegion(0),mHead(0),mFences(),mStats(),mFrameStats()
+{
+    // Regions start at multiples of the frame size, keep them aligned for
+    // any binding.
+    auto regionAlignment = std::max(mStorageAlignment, mUniformAlignment);
+    mFrameSize = (mFrameSize + regionAlignment - 1) / regionAlignment * regionAlignment;
+
+    GLCall(glCreateBuffers(1, mBuffer.put()));
+    GLCall(glNamedBufferStorage(mBuffer.get(), mFrameSize * NUM_FRAMES, nullptr,
+                                MAP_FLAGS));
+    void *mapping = nullptr;
+    GLCall(mapping = glMapNamedBufferRange(mBuffer.get(), 0, mFrameSize * NUM_FRAMES,
+                                           MAP_FLAGS));
+    if(mapping == nullptr)
+        throw std::runtime_error("Could not map the ring buffer");
+    mMapping = static_cast<std::uint8_t*>(mapping);
+    mFences.fill(nullptr);
+}
+
+RingBuffer::~RingBuffer()
+{
+    for(auto fence : mFences)
+    {
+        if(fence != nullptr)
+        {
+            GLCall(glDeleteSync(fence));
+        }
+    }
+    GLCall(glUnmapNamedBuffer(mBuffer.get()));
+}
+
+void RingBuffer::beginFrame()
+{
+    mRegion = (mRegion + 1) % NUM_FRAMES;
+    mHead = mRegion * mFrameSize;
+    mFrameStats = RingBufferStats();
+
+    auto &fence = mFences[mRegion];
+    if(fence == nullptr)
+        return;
+    auto start = std::chrono::steady_clock::now();
+    // Flush on the first try so the fence is sure to be signaled.
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    GLenum status = GL_TIMEOUT_EXPIRED;
+    while(status == GL_TIMEOUT_EXPIRED)
+    {
+        GLCall(status = glClientWaitSync(fence, flags, 1000000));
+        flags = 0;
+    }
+    GLCall(glDeleteSync(fence));
+    fence = nullptr;
+    if(status == GL_WAIT_FAILED)
+        throw std::runtime_error("Waiting for a ring buffer fence failed");
+    mFrameStats.waitMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void RingBuffer::endFrame()
+{
+    GLCall(mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    mFrameStats.bytesUsed = mHead - mRegion * mFrameSize;
+    mStats = mFrameStats;
+}
+
+RingAllocation RingBuffer::allocate(std::size_t size, std::size_t align)
+{
+    auto offset = (mHead + align - 1) & ~(align - 1);
+    auto end = (mRegion + 1) * mFrameSize;
+    if(offset + size > end)
+        throw std::length_error(fmt::format(
+            "Ring buffer frame of {} bytes cannot fit {} more bytes",
+            mFrameSize, size));
+    mHead = offset + size;
+    mFrameStats.allocations++;
+    return RingAllocation{mMapping + offset, offset, size};
+}
+
+void RingBuffer::bindRange(GLenum target, std::uint32_t index,
+                           const RingAllocation &allocation) const
+{
+    GLCall(glBindBufferRange(target, index, mBuffer.get(),
+                             static_cast<GLintptr>(allocation.offset),
+                             static_cast<GLsizeiptr>(allocation.size)));
+}
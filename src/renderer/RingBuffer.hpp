@@ -0,0 +1,119 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#include "GLResource.hpp"
+
+// Space handed out by RingBuffer::allocate().
+struct RingAllocation
+{
+    // Where the CPU writes the data, valid until the end of the frame.
+    void *data = nullptr;
+    // Offset of the data in the ring's buffer.
+    std::size_t offset = 0;
+    std::size_t size = 0;
+
+    template<typename T>
+    T *as() const
+    {
+        return static_cast<T*>(data);
+    }
+};
+
+// Work done by the last frame of a RingBuffer.
+struct RingBufferStats
+{
+    std::size_t bytesUsed = 0;
+    std::size_t allocations = 0;
+    // Time spent waiting for the GPU to release the frame's region.
+    double waitMs = 0.;
+};
+
+// Streaming buffer for data that changes every frame. One buffer is mapped
+// persistently and coherently for the whole lifetime of the ring and split
+// into NUM_FRAMES regions. Each frame allocates linearly from its own
+// region and ends with a fence, and the region is only reused once the
+// GPU has passed that fence. The CPU writes straight into the mapping, so
+// there are no uploads, map calls or allocations per frame.
+class RingBuffer
+{
+public:
+    // Frames the CPU may run ahead of the GPU, plus the one being written.
+    static constexpr std::size_t NUM_FRAMES = 3;
+
+    // frameSize is the number of bytes every frame can allocate.
+    RingBuffer(std::size_t frameSize = 8 << 20);
+    RingBuffer(const RingBuffer &) = delete;
+    ~RingBuffer();
+
+    // Move to the next region, waiting for the GPU to be done with it if
+    // needed. Call once per frame before allocating.
+    void beginFrame();
+
+    // Fence the region of the current frame. Call after the last command
+    // reading from it.
+    void endFrame();
+
+    // Get size bytes, aligned to align bytes in the buffer, which must be
+    // a power of two. Throws std::length_error if the frame's region is
+    // full.
+    RingAllocation allocate(std::size_t size, std::size_t align = 16);
+
+    // Allocate count elements of T, aligned for binding as a shader
+    // storage buffer.
+    template<typename T>
+    RingAllocation allocateStorage(std::size_t count)
+    {
+        return allocate(count * sizeof(T), mStorageAlignment);
+    }
+
+    // Allocate count elements of T, aligned for binding as a uniform
+    // buffer.
+    template<typename T>
+    RingAllocation allocateUniform(std::size_t count)
+    {
+        return allocate(count * sizeof(T), mUniformAlignment);
+    }
+
+    // Bind the range of allocation to an indexed target, such as
+    // GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER.
+    void bindRange(GLenum target, std::uint32_t index,
+                   const RingAllocation &allocation) const;
+
+    std::uint32_t getID() const
+    {
+        return mBuffer.get();
+    }
+
+    std::size_t getFrameSize() const
+    {
+        return mFrameSize;
+    }
+
+    const RingBufferStats &getStats() const
+    {
+        return mStats;
+    }
+
+private:
+    BufferHandle mBuffer;
+    std::uint8_t *mMapping;
+    std::size_t mFrameSize;
+    std::size_t mStorageAlignment;
+    std::size_t mUniformAlignment;
+    // Region being written and the next free byte in it, from the start of
+    // the buffer.
+    std::size_t mRegion;
+    std::size_t mHead;
+    // Fence placed after the last use of each region.
+    std::array<GLsync, NUM_FRAMES> mFences;
+    RingBufferStats mStats;
+    RingBufferStats mFrameStats;
+};
+
+#endif /* RING_BUFFER_HPP */
@@ -7,36 +7,162 @@
 #include <fstream>
 #include <fmt/core.h>
 #include "../util.hpp"
+#include "glext.hpp"
+#include "glsl.hpp"
 
 namespace fs = std::filesystem;
 
-// Compile shader, return OpenGL ID of shader.
-std::uint32_t Shader::compileShader(const fs::path &path)
+Shader::Shader(const std::vector<fs::path> &paths,
+               const ShaderDefines &defines)
+    : Shader(compileAll(paths, defines))
 {
-    std::uint32_t shader = 0;
+}
 
-    auto type = getShaderType(path);
-    if(type == 0)
-        return 0;
+Shader::Shader(pendingShaders shaders)
+    : mId(0),mUniformLocations(),mLinked(false),mLinkError(),
+      mShaders(std::move(shaders))
+{
+    mId = GLCall(glCreateProgram());
+    for(const auto &[id, _] : mShaders)
+        GLCall(glAttachShader(mId, id));
+    GLCall(glLinkProgram(mId));
+}
+
+Shader::~Shader()
+{
+    for(const auto &[id, _] : mShaders)
+        glres::deleteLater(GLObject::Shader, id);
+    glres::deleteLater(GLObject::Program, mId);
+}
+
+std::vector<std::shared_ptr<Shader>>
+Shader::createBatch(const std::vector<ShaderProgramDesc> &descs)
+{
+    std::cout << "Compiling " << descs.size() << " shader programs.\n";
+    // Every compile is queued before the first link so the driver's
+    // compiler threads get all of the work at once.
+    std::vector<pendingShaders> compiled;
+    compiled.reserve(descs.size());
+    for(const auto &desc : descs)
+        compiled.push_back(compileAll(desc.paths, desc.defines));
+
+    std::vector<std::shared_ptr<Shader>> result;
+    result.reserve(descs.size());
+    for(auto &shaders : compiled)
+        result.emplace_back(new Shader(std::move(shaders)));
+    return result;
+}
+
+bool Shader::isReady() const
+{
+    if(mLinked || !mLinkError.empty() || !glext::hasParallelShaderCompile())
+        return true;
+
+    GLint done = GL_FALSE;
+    GLCall(glGetProgramiv(mId, GL_COMPLETION_STATUS_KHR, &done));
+    return done == GL_TRUE;
+}
+
+void Shader::resolve() const
+{
+    if(mLinked)
+        return;
+    if(!mLinkError.empty())
+        throw OpenGLException(mLinkError, "shader program", "Link");
+
+    GLint status = GL_FALSE;
+    GLCall(glGetProgramiv(mId, GL_LINK_STATUS, &status));
+    if(status != GL_TRUE)
+    {
+        std::string log;
+        for(const auto &[id, source] : mShaders)
+        {
+            GLint compiled = GL_FALSE;
+            GLCall(glGetShaderiv(id, GL_COMPILE_STATUS, &compiled));
+            if(compiled != GL_TRUE)
+                log += fmt::format("{}:\n{}", source->files.front().generic_string(),
+                                   source->remapLog(getInfoLog(id, false)));
+        }
+        log += getInfoLog(mId, true);
+
+        for(const auto &[id, _] : mShaders)
+            GLCall(glDeleteShader(id));
+        mShaders.clear();
+        // Kept so that the program is never used, callers such as
+        // ShaderVariants hold on to it.
+        mLinkError = log.empty() ? "No info log" : log;
+        throw OpenGLException(mLinkError, "shader program", "Link");
+    }
 
-    std::ifstream shaderCode;
-    std::string shaderString;
-    shaderCode.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
+    // The program keeps its own copy of the binaries.
+    for(const auto &[id, _] : mShaders)
     {
-        shaderCode.open(path);
-        std::stringstream shaderStream;
-        shaderStream << shaderCode.rdbuf();
-        shaderString = shaderStream.str();
+        GLCall(glDetachShader(mId, id));
+        GLCall(glDeleteShader(id));
     }
-    catch (std::ifstream::failure& e)
+    mShaders.clear();
+    mLinked = true;
+}
+
+GLint Shader::getUniformLocation(const std::string &name) const
+{
+    if(auto it = mUniformLocations.find(name); it != mUniformLocations.end())
+        return it->second;
+
+    auto location = GLCall(glGetUniformLocation(getProgramID(), name.c_str()));
+    mUniformLocations.emplace(name, location);
+    return location;
+}
+
+Shader::pendingShaders Shader::compileAll(const std::vector<fs::path> &paths,
+                                          const ShaderDefines &defines)
+{
+    pendingShaders shaders;
+    shaders.reserve(paths.size());
+    for(const auto &path : paths)
+        if(auto id = compileShader(path, defines); id != 0)
+            shaders.emplace_back(id, glsl::preprocess(path, defines));
+    return shaders;
+}
+
+std::string Shader::getInfoLog(std::uint32_t id, bool isProgram)
+{
+    GLint length = 0;
+    if(isProgram)
+    {
+        GLCall(glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length));
+    }
+    else
     {
-        throw std::runtime_error(fmt::format("Unable to read file {}: {}",
-                                             path, e.what()));
+        GLCall(glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length));
     }
+    if(length <= 0)
+        return {};
+
+    std::string log(static_cast<std::size_t>(length), '\0');
+    if(isProgram)
+    {
+        GLCall(glGetProgramInfoLog(id, length, nullptr, log.data()));
+    }
+    else
+    {
+        GLCall(glGetShaderInfoLog(id, length, nullptr, log.data()));
+    }
+    log.resize(std::char_traits<char>::length(log.c_str()));
+    return log;
+}
+
+// Compile shader, return OpenGL ID of shader.
+std::uint32_t Shader::compileShader(const fs::path &path,
+                                    const ShaderDefines &defines)
+{
+    auto type = getShaderType(path);
+    if(type == 0)
+        return 0;
 
-    const char *shaderCString = shaderString.c_str();
-    shader = GLCall(glCreateShader(type));
+    auto source = glsl::preprocess(path, defines);
+    const char *shaderCString = source->source.c_str();
+    std::uint32_t shader = GLCall(glCreateShader(type));
     GLCall(glShaderSource(shader, 1, &shaderCString, nullptr));
     GLCall(glCompileShader(shader));
 
@@ -13,9 +13,26 @@
 #include <filesystem>
 #include <cstdint>
 #include <utility>
+#include <vector>
+#include <type_traits>
+#include <memory>
+#include <unordered_map>
 
 #include "Bindable.hpp"
 
+// Preprocessor definitions injected after a shader's #version line, as
+// (name, value) pairs.
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+struct PreprocessedShader;
+
+// Everything needed to build one program.
+struct ShaderProgramDesc
+{
+    std::vector<std::filesystem::path> paths;
+    ShaderDefines defines;
+};
+
 class Shader : public Bindable
 {
 public:
@@ -34,34 +51,65 @@ public:
         std::make_pair(".gs", GL_GEOMETRY_SHADER),
     };
 
-    Shader() : mId(0)
+    Shader() : mId(0),mUniformLocations(),mLinked(true),mLinkError(),mShaders()
     {
     }
 
-    template<typename ... Args>
+    template<typename ... Args,
+             typename = std::enable_if_t<
+                 std::conjunction_v<std::is_convertible<Args,
+                                                        std::filesystem::path>...>>>
     Shader(Args &&... args)
+        : Shader(std::vector<std::filesystem::path>{
+                std::filesystem::path(std::forward<Args>(args))...})
+    {
+    }
+
+    // Compile and link every shader in paths with defines injected into
+    // each of them. Compilation and linking are only submitted to the
+    // driver here, the link status is checked on first use.
+    Shader(const std::vector<std::filesystem::path> &paths,
+           const ShaderDefines &defines = {});
+
+    Shader(const ShaderProgramDesc &desc)
+        : Shader(desc.paths, desc.defines)
     {
-        std::array unpack = {compileShader(std::forward<Args>(args))...};
-        mId = GLCall(glCreateProgram());
-        std::cout << "Compiling shaders.\n";
-        for(auto i : unpack)
-            GLCall(glAttachShader(mId, i));
-        std::cout << "Linking shaders.\n";
-        GLCall(glLinkProgram(mId));
-        std::cout << "Deleting shaders.\n";
-        for(auto i : unpack)
-            GLCall(glDeleteShader(i));
-        std::cout << "Done creating shader program.\n";
     }
 
+    Shader(const Shader &) = delete;
+    virtual ~Shader();
+
+    // Submit every shader of every program in descs before linking any of
+    // them, so the driver can compile all of them in parallel.
+    static std::vector<std::shared_ptr<Shader>>
+    createBatch(const std::vector<ShaderProgramDesc> &descs);
+
+    // Whether the driver finished compiling and linking, never blocks.
+    // Always true when GL_KHR_parallel_shader_compile is unavailable.
+    bool isReady() const;
+
+    // Wait for linking to finish and check for errors. Throws an
+    // OpenGLException with the info logs if compilation or linking failed,
+    // and again on every later call.
+    void resolve() const;
+
     // Compile shader, return OpenGL ID of shader.
-    std::uint32_t compileShader(const std::filesystem::path &path);
+    static std::uint32_t compileShader(const std::filesystem::path &path,
+                                       const ShaderDefines &defines = {});
     // Get the type of shader from its file path.
-    GLenum getShaderType(const std::filesystem::path &path);
+    static GLenum getShaderType(const std::filesystem::path &path);
+
+    // Get the OpenGL ID of the program, waiting for it to link.
+    std::uint32_t getProgramID() const
+    {
+        resolve();
+        return mId;
+    }
 
     // activate the shader
     virtual void bind() 
     { 
+        resolve();
         glUseProgram(mId); 
     }
     // Deactivate the shader.
@@ -69,71 +117,146 @@ public:
     {
         glUseProgram(0); 
     }
-    // utility uniform functions
+    // utility uniform functions. They write to the program directly
+    // (glProgramUniform*), so it does not have to be bound.
     inline void set(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(mId, name.c_str()),
-                    static_cast<std::int32_t>(value)); 
+        glProgramUniform1i(getProgramID(), getUniformLocation(name),
+                           static_cast<std::int32_t>(value)); 
     }
     inline void set(const std::string &name, std::int32_t value) const
     { 
-        glUniform1i(glGetUniformLocation(mId, name.c_str()), value); 
+        glProgramUniform1i(getProgramID(), getUniformLocation(name), value); 
     }
     inline void set(const std::string &name, std::uint32_t value) const
     { 
-        glUniform1ui(glGetUniformLocation(mId, name.c_str()), value); 
+        glProgramUniform1ui(getProgramID(), getUniformLocation(name), value); 
     }
     inline void set(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(mId, name.c_str()), value); 
+        glProgramUniform1f(getProgramID(), getUniformLocation(name), value); 
     }
     inline void set(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(mId, name.c_str()), 1,
-                     glm::value_ptr(value)); 
+        glProgramUniform2fv(getProgramID(), getUniformLocation(name), 1,
+                            glm::value_ptr(value)); 
     }
     inline void set(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(mId, name.c_str()), x, y); 
+        glProgramUniform2f(getProgramID(), getUniformLocation(name), x, y); 
     }
     inline void set(const std::string &name,
                     const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(mId, name.c_str()), 1,
-                     glm::value_ptr(value)); 
+        glProgramUniform3fv(getProgramID(), getUniformLocation(name), 1,
+                            glm::value_ptr(value)); 
     }
     inline void set(const std::string &name, float x, float y,
                     float z) const
     { 
-        glUniform3f(glGetUniformLocation(mId, name.c_str()), x, y, z); 
+        glProgramUniform3f(getProgramID(), getUniformLocation(name), x, y, z); 
+    }
+    inline void set(const std::string &name, const glm::uvec3 &value) const
+    { 
+        glProgramUniform3uiv(getProgramID(), getUniformLocation(name), 1,
+                             glm::value_ptr(value)); 
     }
     inline void set(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(mId, name.c_str()), 1,
-                     glm::value_ptr(value)); 
+        glProgramUniform4fv(getProgramID(), getUniformLocation(name), 1,
+                            glm::value_ptr(value)); 
     }
     inline void set(const std::string &name, float x, float y, float z,
-                    float w) 
+                    float w) const
     { 
-        glUniform4f(glGetUniformLocation(mId, name.c_str()), x, y, z, w); 
+        glProgramUniform4f(getProgramID(), getUniformLocation(name), x, y, z, w); 
     }
     inline void set(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(mId, name.c_str()), 1,
-                           GL_FALSE, glm::value_ptr(mat));
+        glProgramUniformMatrix2fv(getProgramID(), getUniformLocation(name), 1,
+                                  GL_FALSE, glm::value_ptr(mat));
     }
     inline void set(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(mId, name.c_str()), 1,
-                           GL_FALSE, glm::value_ptr(mat));
+        glProgramUniformMatrix3fv(getProgramID(), getUniformLocation(name), 1,
+                                  GL_FALSE, glm::value_ptr(mat));
     }
     inline void set(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(mId, name.c_str()), 1,
-                           GL_FALSE, glm::value_ptr(mat));
+        glProgramUniformMatrix4fv(getProgramID(), getUniformLocation(name), 1,
+                                  GL_FALSE, glm::value_ptr(mat));
     }
 
+    // Array uniform functions, upload count elements starting at the
+    // uniform called name (e.g. "uBones" or "uBones[4]") in one call.
+    inline void set(const std::string &name, const float *values,
+                    std::size_t count) const
+    {
+        glProgramUniform1fv(getProgramID(), getUniformLocation(name),
+                            static_cast<GLsizei>(count), values);
+    }
+    inline void set(const std::string &name, const glm::vec3 *values,
+                    std::size_t count) const
+    {
+        glProgramUniform3fv(getProgramID(), getUniformLocation(name),
+                            static_cast<GLsizei>(count), glm::value_ptr(*values));
+    }
+    inline void set(const std::string &name, const glm::vec4 *values,
+                    std::size_t count) const
+    {
+        glProgramUniform4fv(getProgramID(), getUniformLocation(name),
+                            static_cast<GLsizei>(count), glm::value_ptr(*values));
+    }
+    inline void set(const std::string &name, const glm::mat3 *mats,
+                    std::size_t count) const
+    {
+        glProgramUniformMatrix3fv(getProgramID(), getUniformLocation(name),
+                                  static_cast<GLsizei>(count), GL_FALSE,
+                                  glm::value_ptr(*mats));
+    }
+    inline void set(const std::string &name, const glm::mat4 *mats,
+                    std::size_t count) const
+    {
+        glProgramUniformMatrix4fv(getProgramID(), getUniformLocation(name),
+                                  static_cast<GLsizei>(count), GL_FALSE,
+                                  glm::value_ptr(*mats));
+    }
+    template<typename T>
+    inline void set(const std::string &name, const std::vector<T> &values) const
+    {
+        if(!values.empty())
+            set(name, values.data(), values.size());
+    }
+    template<typename T, std::size_t N>
+    inline void set(const std::string &name, const std::array<T, N> &values) const
+    {
+        set(name, values.data(), N);
+    }
+
+    // Get the location of a uniform, cached after the first lookup. -1 if
+    // the program has no active uniform called name.
+    GLint getUniformLocation(const std::string &name) const;
+
 private:
+    // Shader objects that have been compiled but not yet checked, with the
+    // source they were compiled from.
+    using pendingShaders = std::vector<std::pair<std::uint32_t,
+                                                 std::shared_ptr<const PreprocessedShader>>>;
+
+    // Attach and link shaders.
+    explicit Shader(pendingShaders shaders);
+    // Submit a compile for every file in paths.
+    static pendingShaders compileAll(const std::vector<std::filesystem::path> &paths,
+                                     const ShaderDefines &defines);
+    // Get the info log of a shader or program object.
+    static std::string getInfoLog(std::uint32_t id, bool isProgram);
+
     std::uint32_t mId;
+    mutable std::unordered_map<std::string, GLint> mUniformLocations;
+    // Whether the program linked, checked by resolve().
+    mutable bool mLinked;
+    // Info logs of a failed link, empty until one fails.
+    mutable std::string mLinkError;
+    mutable pendingShaders mShaders;
 };
 #endif // SHADER_HPP
@@ -0,0 +1,76 @@
+#include "ShaderVariants.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+ShaderDefines ShaderPermutation::toDefines() const
+{
+    return {
+        { "NUM_DIR_LIGHTS", std::to_string(numDirLights) },
+        { "NUM_POINT_LIGHTS", std::to_string(numPointLights) },
+        { "NUM_SPOT_LIGHTS", std::to_string(numSpotLights) },
+        { "HAS_SPECULAR_MAP", hasSpecularMap ? "1" : "0" },
+        { "SKINNING", skinning ? "1" : "0" },
+        { "INSTANCED", instanced ? "1" : "0" },
+        { "MULTI_DRAW", multiDraw ? "1" : "0" },
+        { "CLUSTERED", clustered ? "1" : "0" },
+        { "GBUFFER", gbuffer ? "1" : "0" },
+    };
+}
+
+ShaderVariants::ShaderVariants(const std::vector<fs::path> &paths)
+    : mPaths(paths),mVariants()
+{
+}
+
+std::shared_ptr<Shader> ShaderVariants::get(const ShaderDefines &defines)
+{
+    auto key = makeKey(defines);
+    if(auto it = mVariants.find(key); it != mVariants.end())
+        return it->second;
+
+    std::cout << "Compiling shader variant \"" << key << "\".\n";
+    auto shader = std::make_shared<Shader>(mPaths, defines);
+    mVariants.emplace(std::move(key), shader);
+    return shader;
+}
+
+void ShaderVariants::preload(const std::vector<ShaderDefines> &definesList)
+{
+    std::vector<std::string> keys;
+    std::vector<ShaderProgramDesc> descs;
+    for(const auto &defines : definesList)
+    {
+        auto key = makeKey(defines);
+        if(mVariants.count(key) ||
+           std::find(keys.begin(), keys.end(), key) != keys.end())
+            continue;
+        keys.push_back(std::move(key));
+        descs.push_back(ShaderProgramDesc{mPaths, defines});
+    }
+
+    auto shaders = Shader::createBatch(descs);
+    for(std::size_t i = 0; i < shaders.size(); i++)
+        mVariants.emplace(std::move(keys[i]), std::move(shaders[i]));
+}
+
+void ShaderVariants::preload(const std::vector<ShaderPermutation> &permutations)
+{
+    std::vector<ShaderDefines> definesList;
+    definesList.reserve(permutations.size());
+    for(const auto &permutation : permutations)
+        definesList.push_back(permutation.toDefines());
+    preload(definesList);
+}
+
+std::string ShaderVariants::makeKey(ShaderDefines defines)
+{
+    std::sort(defines.begin(), defines.end());
+    std::string key;
+    for(const auto &[name, value] : defines)
+        key += fmt::format("{}={};", name, value);
+    return key;
+}
@@ -0,0 +1,74 @@
+#ifndef SHADER_VARIANTS_HPP
+#define SHADER_VARIANTS_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include "Shader.hpp"
+
+// Feature switches for the main lighting shaders. Each distinct value is
+// compiled into its own program so the shaders need no dynamic light loops
+// or unused texture fetches.
+struct ShaderPermutation
+{
+    std::uint32_t numDirLights = 0;
+    std::uint32_t numPointLights = 0;
+    std::uint32_t numSpotLights = 0;
+    bool hasSpecularMap = false;
+    bool skinning = false;
+    // Read per-object matrices from the instance buffer.
+    bool instanced = false;
+    // Drawn by a RenderQueue from a GeometryHeap.
+    bool multiDraw = false;
+    // Read point and spot lights from LightClusters instead of the uniform
+    // arrays, the point and spot light counts are ignored.
+    bool clustered = false;
+    // Write the surface to the G-buffer of a DeferredRenderer instead of
+    // lighting it.
+    bool gbuffer = false;
+
+    ShaderDefines toDefines() const;
+};
+
+// Lazily compiled, cached set of programs built from the same shader files
+// with different preprocessor definitions.
+class ShaderVariants
+{
+public:
+    ShaderVariants(const std::vector<std::filesystem::path> &paths);
+    ShaderVariants(const ShaderVariants &) = delete;
+    ~ShaderVariants() = default;
+
+    // Get the program for defines, compiling it on first use.
+    std::shared_ptr<Shader> get(const ShaderDefines &defines);
+
+    std::shared_ptr<Shader> get(const ShaderPermutation &permutation)
+    {
+        return get(permutation.toDefines());
+    }
+
+    // Submit every variant in definesList that is not cached yet as one
+    // batch, without waiting for the driver to finish.
+    void preload(const std::vector<ShaderDefines> &definesList);
+
+    void preload(const std::vector<ShaderPermutation> &permutations);
+
+    // Number of programs compiled so far.
+    std::size_t size() const
+    {
+        return mVariants.size();
+    }
+
+private:
+    // Build a key that does not depend on the order of defines.
+    static std::string makeKey(ShaderDefines defines);
+
+    std::vector<std::filesystem::path> mPaths;
+    std::unordered_map<std::string, std::shared_ptr<Shader>> mVariants;
+};
+
+#endif /* SHADER_VARIANTS_HPP */
@@ -0,0 +1,148 @@
+#ifndef STORAGE_BUFFER_HPP
+#define STORAGE_BUFFER_HPP
+
+#include "Bindable.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <glad/glad.h>
+
+// Shader storage buffer holding an array of T, with a CPU-side copy of the
+// data. Changes to the copy are sent to the GPU with upload() and results
+// written by shaders are fetched with download().
+//
+// T must match the std430 layout of the block it is bound to.
+template<typename T>
+class StorageBuffer : public Bindable
+{
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Storage buffer elements are copied byte for byte");
+public:
+    StorageBuffer()
+        : Bindable(),mData()
+    {
+    }
+
+    StorageBuffer(std::size_t count)
+        : StorageBuffer(std::vector<T>(count))
+    {
+    }
+
+    StorageBuffer(const std::vector<T> &data)
+        : Bindable(),mData(data)
+    {
+        allocate();
+    }
+
+    // Get the CPU-side copy.
+    std::vector<T> &data()
+    {
+        return mData;
+    }
+
+    const std::vector<T> &data() const
+    {
+        return mData;
+    }
+
+    T &operator[](std::size_t i)
+    {
+        return mData[i];
+    }
+
+    const T &operator[](std::size_t i) const
+    {
+        return mData[i];
+    }
+
+    std::size_t size() const
+    {
+        return mData.size();
+    }
+
+    std::size_t sizeBytes() const
+    {
+        return mData.size() * sizeof(T);
+    }
+
+    std::uint32_t getID() const
+    {
+        return mId;
+    }
+
+    // Change the number of elements. The GPU storage is reallocated, so the
+    // contents have to be uploaded again.
+    void resize(std::size_t count)
+    {
+        if(count == mData.size())
+            return;
+        mData.resize(count);
+        // Draws already submitted may still read the old buffer.
+        glres::deleteLater(GLObject::Buffer, mId);
+        allocate();
+    }
+
+    // Send count elements of the CPU-side copy, starting at first, to the
+    // GPU. A count of 0 uploads everything from first on.
+    void upload(std::size_t first = 0, std::size_t count = 0)
+    {
+        if(count == 0)
+            count = mData.size() - first;
+        if(count == 0)
+            return;
+        GLCall(glNamedBufferSubData(mId, first * sizeof(T), count * sizeof(T),
+                                    mData.data() + first));
+    }
+
+    // Read count elements, starting at first, back into the CPU-side copy.
+    // Stalls until the GPU is done with the buffer, so the matching memory
+    // barrier must have been issued.
+    void download(std::size_t first = 0, std::size_t count = 0)
+    {
+        if(count == 0)
+            count = mData.size() - first;
+        if(count == 0)
+            return;
+        GLCall(glGetNamedBufferSubData(mId, first * sizeof(T), count * sizeof(T),
+                                       mData.data() + first));
+    }
+
+    // Bind the buffer to a GL_SHADER_STORAGE_BUFFER binding point.
+    void bindBase(std::uint32_t index) const
+    {
+        GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, mId));
+    }
+
+    virtual void bind()
+    {
+        GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, mId));
+    }
+
+    virtual void unbind()
+    {
+        GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+    }
+
+    virtual ~StorageBuffer()
+    {
+        glres::deleteLater(GLObject::Buffer, mId);
+    }
+
+private:
+    void allocate()
+    {
+        GLCall(glCreateBuffers(1, &mId));
+        // Zero sized storage is an error, keep at least one element.
+        auto bytes = std::max<std::size_t>(sizeBytes(), sizeof(T));
+        GLCall(glNamedBufferStorage(mId, bytes,
+                                    mData.empty() ? nullptr : mData.data(),
+                                    GL_DYNAMIC_STORAGE_BIT));
+    }
+
+    std::vector<T> mData;
+};
+
+#endif /* STORAGE_BUFFER_HPP */
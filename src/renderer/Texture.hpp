@@ -18,7 +18,10 @@ public:
 
     virtual void bind();
     virtual void unbind();
-    virtual ~Texture() = default;
+    virtual ~Texture()
+    {
+        glres::deleteLater(GLObject::Texture, mId);
+    }
 
     static void init();
 private:
@@ -0,0 +1,131 @@
+#include "TransformBatch.hpp"
+
+#include <cmath>
+
+#include "TransformKernel.hpp"
+#include "../jobs.hpp"
+
+namespace
+{
+    // Lanes of the kernel built for the instruction set the compiler
+    // targets.
+#if defined(__AVX2__) && defined(__FMA__)
+    using lanes = __m256;
+    constexpr std::size_t WIDTH = 8;
+    constexpr const char *SIMD_NAME = "AVX2";
+#elif defined(__SSE2__)
+    using lanes = __m128;
+    constexpr std::size_t WIDTH = 4;
+    constexpr const char *SIMD_NAME = "SSE";
+#else
+    using lanes = float;
+    constexpr std::size_t WIDTH = 1;
+    constexpr const char *SIMD_NAME = "scalar";
+#endif
+
+#ifdef PROJ_HAVE_AVX2
+    bool hasAvx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("fma");
+        return supported;
+    }
+#endif
+}
+
+void TransformBatch::clear()
+{
+    for(auto &elements : mElements)
+        elements.clear();
+}
+
+void TransformBatch::resize(std::size_t count)
+{
+    for(int c = 0; c < 4; c++)
+        for(int r = 0; r < 3; r++)
+            mElements[c * 3 + r].resize(count, c == r ? 1.f : 0.f);
+}
+
+std::uint32_t TransformBatch::add(const glm::mat4 &model)
+{
+    auto index = static_cast<std::uint32_t>(size());
+    for(int c = 0; c < 4; c++)
+        for(int r = 0; r < 3; r++)
+            mElements[c * 3 + r].push_back(model[c][r]);
+    return index;
+}
+
+void TransformBatch::set(std::size_t index, const glm::mat4 &model)
+{
+    for(int c = 0; c < 4; c++)
+        for(int r = 0; r < 3; r++)
+            mElements[c * 3 + r][index] = model[c][r];
+}
+
+glm::mat4 TransformBatch::get(std::size_t index) const
+{
+    glm::mat4 model(1.f);
+    for(int c = 0; c < 4; c++)
+        for(int r = 0; r < 3; r++)
+            model[c][r] = mElements[c * 3 + r][index];
+    return model;
+}
+
+void TransformBatch::compute(const glm::mat4 &viewProjection, InstanceData *instances,
+                             glm::mat4 *modelViewProjections, bool parallel) const
+{
+    if(!parallel || size() <= PARALLEL_THRESHOLD)
+    {
+        computeRange(0, size(), viewProjection, instances, modelViewProjections);
+        return;
+    }
+
+    // Jobs start at multiples of GRAIN, which keeps them on whole groups of
+    // lanes.
+    static_assert(GRAIN % 8 == 0, "Jobs must not split a group of lanes");
+    jobs::parallelFor(size(), GRAIN, [&](std::size_t first, std::size_t last)
+    {
+        computeRange(first, last, viewProjection, instances, modelViewProjections);
+    });
+}
+
+void TransformBatch::computeRange(std::size_t first, std::size_t last,
+                                  const glm::mat4 &vp, InstanceData *instances,
+                                  glm::mat4 *mvps) const
+{
+    const float *elements[12];
+    for(std::size_t k = 0; k < mElements.size(); k++)
+        elements[k] = mElements[k].data();
+#ifdef PROJ_HAVE_AVX2
+    if(hasAvx2())
+    {
+        transformRangeAvx2(elements, first, last, vp, instances, mvps);
+        return;
+    }
+#endif
+    transformRange<lanes, WIDTH>(elements, first, last, vp, instances, mvps);
+}
+
+void TransformBatch::computeScalar(const glm::mat4 &viewProjection, InstanceData *instances,
+                                   glm::mat4 *modelViewProjections) const
+{
+    for(std::size_t i = 0; i < size(); i++)
+    {
+        auto model = get(i);
+        if(modelViewProjections != nullptr)
+            modelViewProjections[i] = viewProjection * model;
+        if(instances != nullptr)
+            instances[i] = InstanceData{
+                model, glm::mat4(glm::mat3(glm::transpose(glm::inverse(model))))
+            };
+    }
+}
+
+const char *TransformBatch::getSimdName()
+{
+#ifdef PROJ_HAVE_AVX2
+    if(hasAvx2())
+        return "AVX2";
+#endif
+    return SIMD_NAME;
+}
@@ -0,0 +1,81 @@
+#ifndef TRANSFORM_BATCH_HPP
+#define TRANSFORM_BATCH_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "InstanceBatcher.hpp"
+
+// Affine model matrices of many objects, stored as structure of arrays with
+// one array per element of the upper three rows, and a kernel deriving the
+// per-frame matrices of all of them in one pass.
+//
+// compute() works on 8 objects at a time with AVX2 or 4 at a time with SSE,
+// with a scalar fallback. The AVX2 kernel is built separately and picked at
+// run time if the CPU supports it (see TransformKernel.hpp). The
+// normal matrix is the cofactor matrix of the upper 3x3 over its
+// determinant, which is the inverse transpose without a general 4x4
+// inverse. Batches of more than PARALLEL_THRESHOLD objects are split
+// across the job threads.
+class TransformBatch
+{
+public:
+    static constexpr std::size_t PARALLEL_THRESHOLD = 4096;
+    // Objects per job above the threshold.
+    static constexpr std::size_t GRAIN = 2048;
+
+    TransformBatch() = default;
+    TransformBatch(const TransformBatch &) = delete;
+    ~TransformBatch() = default;
+
+    // Remove every object.
+    void clear();
+
+    // Change the number of objects, new ones get the identity.
+    void resize(std::size_t count);
+
+    // Add an object, returns its index. The bottom row of model is taken
+    // to be (0, 0, 0, 1).
+    std::uint32_t add(const glm::mat4 &model);
+
+    // Replace the model matrix of the object at index.
+    void set(std::size_t index, const glm::mat4 &model);
+
+    glm::mat4 get(std::size_t index) const;
+
+    std::size_t size() const
+    {
+        return mElements[0].size();
+    }
+
+    // Write the model and normal matrices of every object to instances,
+    // and viewProjection times the model matrix to modelViewProjections.
+    // Either may be null, the others must hold size() elements. They are
+    // only written to, in order, so instances may point into write
+    // combined memory such as a RingAllocation of the frame.
+    void compute(const glm::mat4 &viewProjection, InstanceData *instances,
+                 glm::mat4 *modelViewProjections, bool parallel = true) const;
+
+    // The same with glm one object at a time, as objects drawn on their
+    // own do. For comparison.
+    void computeScalar(const glm::mat4 &viewProjection, InstanceData *instances,
+                       glm::mat4 *modelViewProjections) const;
+
+    // Name of the instruction set compute() uses.
+    static const char *getSimdName();
+
+private:
+    void computeRange(std::size_t first, std::size_t last,
+                      const glm::mat4 &viewProjection, InstanceData *instances,
+                      glm::mat4 *modelViewProjections) const;
+
+    // Element at column c and row r of every model matrix is in
+    // mElements[c * 3 + r].
+    std::array<std::vector<float>, 12> mElements;
+};
+
+#endif /* TRANSFORM_BATCH_HPP */
@@ -0,0 +1,12 @@
+// Built with AVX2 and FMA enabled, see TransformKernel.hpp.
+#include "TransformKernel.hpp"
+
+#if !defined(__AVX2__) || !defined(__FMA__)
+#error "TransformBatchAvx2.cpp must be built with AVX2 and FMA enabled"
+#endif
+
+void transformRangeAvx2(const float *const *elements, std::size_t first, std::size_t last,
+                        const glm::mat4 &vp, InstanceData *instances, glm::mat4 *mvps)
+{
+    transformRange<__m256, 8>(elements, first, last, vp, instances, mvps);
+}
@@ -0,0 +1,193 @@
+#include "TransformHierarchy.hpp"
+
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+glm::mat4 Transform::toMatrix() const
+{
+    // translate(T) * mat4_cast(R) * scale(S), without the products.
+    glm::mat3 rs = glm::mat3_cast(rotation);
+    glm::mat4 result(1.f);
+    for(int i = 0; i < 3; i++)
+        result[i] = glm::vec4(rs[i] * scale[i], 0.f);
+    result[3] = glm::vec4(translation, 1.f);
+    return result;
+}
+
+std::uint32_t TransformHierarchy::create(std::uint32_t parent, const Transform &local)
+{
+    std::uint32_t node = 0;
+    if(!mFreeHandles.empty())
+    {
+        node = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    }
+    else
+    {
+        node = static_cast<std::uint32_t>(mSlots.size());
+        mSlots.push_back(NONE);
+    }
+
+    // Appending keeps the order, the parent is already stored.
+    mSlots[node] = static_cast<std::uint32_t>(mNodes.size());
+    mNodes.push_back(node);
+    mParents.push_back(parent == NONE ? NONE : mSlots[parent]);
+    mLocals.push_back(local);
+    mWorlds.emplace_back(1.f);
+    mNormalMatrices.emplace_back(1.f);
+    mDirty.push_back(1);
+    return node;
+}
+
+void TransformHierarchy::destroy(std::uint32_t node)
+{
+    auto slot = mSlots[node];
+    auto parent = mParents[slot];
+    for(std::size_t i = slot + 1; i < mNodes.size(); i++)
+    {
+        if(mParents[i] == slot)
+        {
+            mParents[i] = parent;
+            mDirty[i] = 1;
+        }
+    }
+
+    // Erasing keeps the order, only the slots after it shift down.
+    mNodes.erase(mNodes.begin() + slot);
+    mParents.erase(mParents.begin() + slot);
+    mLocals.erase(mLocals.begin() + slot);
+    mWorlds.erase(mWorlds.begin() + slot);
+    mNormalMatrices.erase(mNormalMatrices.begin() + slot);
+    mDirty.erase(mDirty.begin() + slot);
+    for(std::size_t i = slot; i < mNodes.size(); i++)
+    {
+        mSlots[mNodes[i]] = static_cast<std::uint32_t>(i);
+        if(mParents[i] != NONE && mParents[i] > slot)
+            mParents[i]--;
+    }
+    mSlots[node] = NONE;
+    mFreeHandles.push_back(node);
+}
+
+void TransformHierarchy::setParent(std::uint32_t node, std::uint32_t parent)
+{
+    auto slot = mSlots[node];
+    auto parentSlot = parent == NONE ? NONE : mSlots[parent];
+    for(auto p = parentSlot; p != NONE; p = mParents[p])
+    {
+        if(p == slot)
+            throw std::invalid_argument("A transform can not be its own ancestor");
+    }
+
+    mParents[slot] = parentSlot;
+    mDirty[slot] = 1;
+    if(parentSlot != NONE && parentSlot > slot)
+        mNeedsSort = true;
+}
+
+void TransformHierarchy::setLocal(std::uint32_t node, const Transform &local)
+{
+    mLocals[mSlots[node]] = local;
+    markDirty(node);
+}
+
+void TransformHierarchy::translate(std::uint32_t node, const glm::vec3 &xyz)
+{
+    auto &local = mLocals[mSlots[node]];
+    local.translation += local.rotation * (local.scale * xyz);
+    markDirty(node);
+}
+
+void TransformHierarchy::rotate(std::uint32_t node, float radAngle, const glm::vec3 &axis)
+{
+    auto &local = mLocals[mSlots[node]];
+    local.rotation = glm::normalize(local.rotation *
+                                    glm::angleAxis(radAngle, glm::normalize(axis)));
+    markDirty(node);
+}
+
+void TransformHierarchy::scale(std::uint32_t node, const glm::vec3 &xyz)
+{
+    mLocals[mSlots[node]].scale *= xyz;
+    markDirty(node);
+}
+
+void TransformHierarchy::update()
+{
+    if(mNeedsSort)
+        sort();
+
+    mChanged.clear();
+    for(std::size_t i = 0; i < mNodes.size(); i++)
+    {
+        auto parent = mParents[i];
+        // The parent was visited first and keeps its flag until the end.
+        if(parent != NONE && mDirty[parent])
+            mDirty[i] = 1;
+        if(!mDirty[i])
+            continue;
+
+        auto local = mLocals[i].toMatrix();
+        mWorlds[i] = parent == NONE ? local : mWorlds[parent] * local;
+        mNormalMatrices[i] = glm::mat4(glm::transpose(glm::inverse(glm::mat3(mWorlds[i]))));
+        mChanged.push_back(mNodes[i]);
+    }
+    std::fill(mDirty.begin(), mDirty.end(), 0);
+}
+
+void TransformHierarchy::sort()
+{
+    mNeedsSort = false;
+
+    // Depth of every slot, parents are at a smaller depth than their
+    // children, so a stable sort by depth restores the order.
+    std::vector<std::uint32_t> depths(mNodes.size(), NONE);
+    std::vector<std::uint32_t> chain;
+    for(std::size_t i = 0; i < mNodes.size(); i++)
+    {
+        auto slot = static_cast<std::uint32_t>(i);
+        while(slot != NONE && depths[slot] == NONE)
+        {
+            chain.push_back(slot);
+            slot = mParents[slot];
+        }
+        auto depth = slot == NONE ? 0 : depths[slot] + 1;
+        for(auto it = chain.rbegin(); it != chain.rend(); ++it)
+            depths[*it] = depth++;
+        chain.clear();
+    }
+
+    std::vector<std::uint32_t> order(mNodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+    {
+        return depths[a] < depths[b];
+    });
+
+    std::vector<std::uint32_t> newSlots(mNodes.size());
+    for(std::size_t i = 0; i < order.size(); i++)
+        newSlots[order[i]] = static_cast<std::uint32_t>(i);
+
+    auto permute = [&](auto &values)
+    {
+        std::remove_reference_t<decltype(values)> sorted;
+        sorted.reserve(values.size());
+        for(auto slot : order)
+            sorted.push_back(values[slot]);
+        values.swap(sorted);
+    };
+    permute(mNodes);
+    permute(mParents);
+    permute(mLocals);
+    permute(mWorlds);
+    permute(mNormalMatrices);
+    permute(mDirty);
+    for(std::size_t i = 0; i < mNodes.size(); i++)
+    {
+        mSlots[mNodes[i]] = static_cast<std::uint32_t>(i);
+        if(mParents[i] != NONE)
+            mParents[i] = newSlots[mParents[i]];
+    }
+}
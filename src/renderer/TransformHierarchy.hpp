@@ -0,0 +1,128 @@
+#ifndef TRANSFORM_HIERARCHY_HPP
+#define TRANSFORM_HIERARCHY_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+// Translation, rotation and scale of a node relative to its parent,
+// applied in the reverse order.
+struct Transform
+{
+    glm::vec3 translation = glm::vec3(0.f);
+    glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    glm::vec3 scale = glm::vec3(1.f);
+
+    glm::mat4 toMatrix() const;
+};
+
+// Parent/child hierarchy of transforms. Every node has a local Transform,
+// and its world matrix is the world matrix of its parent times its local
+// matrix.
+//
+// Changing a node only marks it dirty. update() then walks the nodes once,
+// with parents always stored before their children, so that a dirty parent
+// is seen before its children and marks them dirty too. The world and
+// normal matrices of the dirty nodes are recomputed there and nowhere else,
+// so nodes that do not move cost one flag test per update.
+//
+// Nodes are referred to by handles that stay the same while the storage
+// is reordered.
+class TransformHierarchy
+{
+public:
+    static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+    TransformHierarchy() = default;
+    TransformHierarchy(const TransformHierarchy &) = delete;
+    ~TransformHierarchy() = default;
+
+    // Add a node under parent, or at the root if parent is NONE. Returns
+    // its handle.
+    std::uint32_t create(std::uint32_t parent = NONE,
+                         const Transform &local = Transform());
+
+    // Remove node. Its children move to its parent and keep their local
+    // transforms.
+    void destroy(std::uint32_t node);
+
+    // Move node under parent, or to the root if parent is NONE. Throws
+    // std::invalid_argument if parent is node or one of its descendants.
+    void setParent(std::uint32_t node, std::uint32_t parent);
+
+    std::uint32_t getParent(std::uint32_t node) const
+    {
+        auto parent = mParents[mSlots[node]];
+        return parent == NONE ? NONE : mNodes[parent];
+    }
+
+    const Transform &getLocal(std::uint32_t node) const
+    {
+        return mLocals[mSlots[node]];
+    }
+
+    void setLocal(std::uint32_t node, const Transform &local);
+
+    // Move, turn or grow node in its own frame, like multiplying its local
+    // matrix on the right. The scale is kept apart and always applied
+    // first, so non-uniform scales do not shear later rotations.
+    void translate(std::uint32_t node, const glm::vec3 &xyz);
+    void rotate(std::uint32_t node, float radAngle, const glm::vec3 &axis);
+    void scale(std::uint32_t node, const glm::vec3 &xyz);
+
+    // Recompute the matrices of the nodes changed since the last update
+    // and of their descendants.
+    void update();
+
+    // Matrices as of the last update().
+    const glm::mat4 &getWorld(std::uint32_t node) const
+    {
+        return mWorlds[mSlots[node]];
+    }
+
+    // Inverse transpose of the world matrix, for normals.
+    const glm::mat4 &getNormalMatrix(std::uint32_t node) const
+    {
+        return mNormalMatrices[mSlots[node]];
+    }
+
+    // Nodes whose matrices were recomputed by the last update(), parents
+    // before children.
+    const std::vector<std::uint32_t> &getChanged() const
+    {
+        return mChanged;
+    }
+
+    std::size_t size() const
+    {
+        return mNodes.size();
+    }
+
+private:
+    // Reorder the storage so that parents come before their children,
+    // after setParent() broke that.
+    void sort();
+    void markDirty(std::uint32_t node)
+    {
+        mDirty[mSlots[node]] = 1;
+    }
+
+    // Slot of every handle, NONE for unused handles.
+    std::vector<std::uint32_t> mSlots;
+    std::vector<std::uint32_t> mFreeHandles;
+    // By slot. mParents holds slots, not handles.
+    std::vector<std::uint32_t> mNodes;
+    std::vector<std::uint32_t> mParents;
+    std::vector<Transform> mLocals;
+    std::vector<glm::mat4> mWorlds;
+    std::vector<glm::mat4> mNormalMatrices;
+    std::vector<std::uint8_t> mDirty;
+    std::vector<std::uint32_t> mChanged;
+    bool mNeedsSort = false;
+};
+
+#endif /* TRANSFORM_HIERARCHY_HPP */
@@ -0,0 +1,212 @@
+#ifndef TRANSFORM_KERNEL_HPP
+#define TRANSFORM_KERNEL_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "InstanceBatcher.hpp"
+
+// The kernel of TransformBatch::compute(). It is built once by
+// TransformBatch.cpp for the instruction set the compiler targets, and once
+// more by TransformBatchAvx2.cpp with AVX2 and FMA enabled, which is used
+// if the CPU has them. Everything is in an unnamed namespace so that the
+// linker never mixes up the copies built for different instruction sets.
+namespace
+{
+    // Distance in floats between the same column of consecutive objects.
+    constexpr std::size_t INSTANCE_STRIDE = sizeof(InstanceData) / sizeof(float);
+    constexpr std::size_t MATRIX_STRIDE = sizeof(glm::mat4) / sizeof(float);
+
+    // Lane-wise operations on one float, and on 8 or 4 of them at a time.
+    template<typename T>
+    T splat(float f);
+    template<typename T>
+    T load(const float *p);
+
+    template<>
+    inline float splat<float>(float f) { return f; }
+    template<>
+    inline float load<float>(const float *p) { return *p; }
+    inline float add(float a, float b) { return a + b; }
+    inline float sub(float a, float b) { return a - b; }
+    inline float mul(float a, float b) { return a * b; }
+    inline float div(float a, float b) { return a / b; }
+    // a * b + c.
+    inline float madd(float a, float b, float c) { return a * b + c; }
+
+    // Store the vectors (x[i], y[i], z[i], w[i]) of every lane i to
+    // dst + i * stride.
+    inline void storeColumns(float x, float y, float z, float w, float *dst,
+                             std::size_t)
+    {
+        dst[0] = x;
+        dst[1] = y;
+        dst[2] = z;
+        dst[3] = w;
+    }
+
+#if defined(__SSE2__)
+    template<>
+    inline __m128 splat<__m128>(float f) { return _mm_set1_ps(f); }
+    template<>
+    inline __m128 load<__m128>(const float *p) { return _mm_loadu_ps(p); }
+    inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+    inline __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    inline __m128 div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+    inline __m128 madd(__m128 a, __m128 b, __m128 c)
+    {
+        return _mm_add_ps(_mm_mul_ps(a, b), c);
+    }
+
+    inline void storeColumns(__m128 x, __m128 y, __m128 z, __m128 w, float *dst,
+                             std::size_t stride)
+    {
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(dst, x);
+        _mm_storeu_ps(dst + stride, y);
+        _mm_storeu_ps(dst + 2 * stride, z);
+        _mm_storeu_ps(dst + 3 * stride, w);
+    }
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+    template<>
+    inline __m256 splat<__m256>(float f) { return _mm256_set1_ps(f); }
+    template<>
+    inline __m256 load<__m256>(const float *p) { return _mm256_loadu_ps(p); }
+    inline __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    inline __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+    inline __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    inline __m256 div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+    inline __m256 madd(__m256 a, __m256 b, __m256 c)
+    {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+
+    inline void storeColumns(__m256 x, __m256 y, __m256 z, __m256 w, float *dst,
+                             std::size_t stride)
+    {
+        for(int half = 0; half < 2; half++)
+        {
+            __m128 x4 = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+            __m128 y4 = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+            __m128 z4 = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+            __m128 w4 = half ? _mm256_extractf128_ps(w, 1) : _mm256_castps256_ps128(w);
+            _MM_TRANSPOSE4_PS(x4, y4, z4, w4);
+            float *out = dst + half * 4 * stride;
+            _mm_storeu_ps(out, x4);
+            _mm_storeu_ps(out + stride, y4);
+            _mm_storeu_ps(out + 2 * stride, z4);
+            _mm_storeu_ps(out + 3 * stride, w4);
+        }
+    }
+#endif
+
+    // The kernel, for as many objects at a time as T has lanes. m[c][r] is
+    // the model matrix element at column c and row r.
+    template<typename T>
+    void transform(const T (&m)[4][3], const glm::mat4 &vp, float *instance,
+                   float *mvp, std::size_t instanceStride, std::size_t mvpStride)
+    {
+        T zero = splat<T>(0.f);
+        T one = splat<T>(1.f);
+
+        if(mvp != nullptr)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                T column[4];
+                for(int r = 0; r < 4; r++)
+                {
+                    column[r] = madd(splat<T>(vp[2][r]), m[c][2],
+                                     madd(splat<T>(vp[1][r]), m[c][1],
+                                          mul(splat<T>(vp[0][r]), m[c][0])));
+                    if(c == 3)
+                        column[r] = add(column[r], splat<T>(vp[3][r]));
+                }
+                storeColumns(column[0], column[1], column[2], column[3],
+                             mvp + c * 4, mvpStride);
+            }
+        }
+
+        if(instance == nullptr)
+            return;
+
+        for(int c = 0; c < 4; c++)
+            storeColumns(m[c][0], m[c][1], m[c][2], c == 3 ? one : zero,
+                         instance + c * 4, instanceStride);
+
+        // Columns of the inverse transpose are the cross products of the
+        // other two columns over the determinant.
+        auto cross = [&](int a, int b, T (&out)[3])
+        {
+            out[0] = sub(mul(m[a][1], m[b][2]), mul(m[a][2], m[b][1]));
+            out[1] = sub(mul(m[a][2], m[b][0]), mul(m[a][0], m[b][2]));
+            out[2] = sub(mul(m[a][0], m[b][1]), mul(m[a][1], m[b][0]));
+        };
+        T normal[3][3];
+        cross(1, 2, normal[0]);
+        cross(2, 0, normal[1]);
+        cross(0, 1, normal[2]);
+        T det = madd(m[0][2], normal[0][2],
+                     madd(m[0][1], normal[0][1], mul(m[0][0], normal[0][0])));
+        T invDet = div(one, det);
+        float *normalMatrix = instance + 16;
+        for(int c = 0; c < 3; c++)
+            storeColumns(mul(normal[c][0], invDet), mul(normal[c][1], invDet),
+                         mul(normal[c][2], invDet), zero, normalMatrix + c * 4,
+                         instanceStride);
+        storeColumns(zero, zero, zero, one, normalMatrix + 12, instanceStride);
+    }
+
+    // Transform the objects from first to last, WIDTH at a time in the lanes
+    // of T and the ones left over one at a time. elements[c * 3 + r] holds
+    // the model matrix element at column c and row r of every object.
+    template<typename T, std::size_t WIDTH>
+    void transformRange(const float *const *elements, std::size_t first, std::size_t last,
+                        const glm::mat4 &vp, InstanceData *instances, glm::mat4 *mvps)
+    {
+        auto instanceAt = [instances](std::size_t i)
+        {
+            return instances == nullptr ? nullptr : &instances[i].model[0][0];
+        };
+        auto mvpAt = [mvps](std::size_t i)
+        {
+            return mvps == nullptr ? nullptr : &mvps[i][0][0];
+        };
+
+        std::size_t i = first;
+        for(; i + WIDTH <= last; i += WIDTH)
+        {
+            T m[4][3];
+            for(int c = 0; c < 4; c++)
+                for(int r = 0; r < 3; r++)
+                    m[c][r] = load<T>(elements[c * 3 + r] + i);
+            transform(m, vp, instanceAt(i), mvpAt(i), INSTANCE_STRIDE, MATRIX_STRIDE);
+        }
+
+        for(; i < last; i++)
+        {
+            float m[4][3];
+            for(int c = 0; c < 4; c++)
+                for(int r = 0; r < 3; r++)
+                    m[c][r] = elements[c * 3 + r][i];
+            transform(m, vp, instanceAt(i), mvpAt(i), INSTANCE_STRIDE, MATRIX_STRIDE);
+        }
+    }
+}
+
+#ifdef PROJ_HAVE_AVX2
+// transformRange() built with AVX2 and FMA, in TransformBatchAvx2.cpp. Only
+// call it if the CPU supports both.
+void transformRangeAvx2(const float *const *elements, std::size_t first, std::size_t last,
+                        const glm::mat4 &vp, InstanceData *instances, glm::mat4 *mvps);
+#endif
+
+#endif /* TRANSFORM_KERNEL_HPP */
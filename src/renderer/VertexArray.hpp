@@ -2,16 +2,19 @@
 #define VERTEX_ARRAY_HPP
 
 #include "Bindable.hpp"
-#include "IndexBuffer.hpp"
-#include "ConstantBuffer.hpp"
+#include "BufferAllocator.hpp"
 #include "loadobj.hpp"
 
 #include <memory>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <filesystem>
 #include <glm/glm.hpp>
 
+// A mesh in its own vertex array. The vertices and indices live in ranges
+// of the static BufferPool, so meshes share a few large buffers.
 class VertexArray : public Bindable
 {
 public:
@@ -21,36 +24,70 @@ public:
                 const std::vector<std::uint32_t> &indices) : Bindable()
     {
         GLCall(glCreateVertexArrays(1, &mId));
-        mVertexBuffer = std::make_unique<ConstantBuffer>(vertices, 0, mId);
-        mTextureBuffer = std::make_unique<ConstantBuffer>(texCoords, 1, mId);
-        mNormalBuffer = std::make_unique<ConstantBuffer>(normals, 2, mId);
-        mIndexBuffer = std::make_unique<IndexBuffer>(indices);
-
-        GLCall(glVertexArrayElementBuffer(mId,
-                                          getID(mIndexBuffer.get())));
-
+        // The three streams go one after the other in a single range, each
+        // at the binding of its attribute.
+        auto positionBytes = vertices.size() * sizeof(glm::vec3);
+        auto texBytes = texCoords.size() * sizeof(glm::vec2);
+        auto normalBytes = normals.size() * sizeof(glm::vec3);
+        std::vector<std::uint8_t> data(positionBytes + texBytes + normalBytes);
+        std::memcpy(data.data(), vertices.data(), positionBytes);
+        std::memcpy(data.data() + positionBytes, texCoords.data(), texBytes);
+        std::memcpy(data.data() + positionBytes + texBytes, normals.data(), normalBytes);
+        auto &pool = BufferPool::get(BufferUsage::Static);
+        mVertexRange = pool.allocate(data.size(), BufferPool::MIN_ALIGNMENT,
+                                     data.data());
+
+        setAttribute(0, mVertexRange.offset, sizeof(glm::vec3), glm::vec3::length());
+        setAttribute(1, mVertexRange.offset + positionBytes, sizeof(glm::vec2),
+                     glm::vec2::length());
+        setAttribute(2, mVertexRange.offset + positionBytes + texBytes,
+                     sizeof(glm::vec3), glm::vec3::length());
+        setIndices(indices);
     }
 
     VertexArray(const std::vector<interleavedType> &vertices,
                 const std::vector<std::uint32_t> &indices) : Bindable()
     {
         GLCall(glCreateVertexArrays(1, &mId));
-
-        mVertexBuffer = std::make_unique<ConstantBuffer>(vertices, 0, mId);
-        mIndexBuffer = std::make_unique<IndexBuffer>(indices);
-        GLCall(glVertexArrayElementBuffer(mId,
-                                          getID(mIndexBuffer.get())));
+        auto &pool = BufferPool::get(BufferUsage::Static);
+        mVertexRange = pool.allocate(vertices.size() * sizeof(interleavedType),
+                                     BufferPool::MIN_ALIGNMENT, vertices.data());
+
+        GLCall(glVertexArrayVertexBuffer(mId, 0, mVertexRange.buffer,
+                                         static_cast<GLintptr>(mVertexRange.offset),
+                                         sizeof(interleavedType)));
+        const std::uint32_t positionIndex = 0;
+        const std::uint32_t texIndex = 1;
+        const std::uint32_t normalIndex = 2;
+        for(auto index : {positionIndex, texIndex, normalIndex})
+        {
+            GLCall(glEnableVertexArrayAttrib(mId, index));
+            GLCall(glVertexArrayAttribBinding(mId, index, 0));
+        }
+        GLCall(glVertexArrayAttribFormat(mId, positionIndex, glm::vec3::length(), GL_FLOAT,
+                                         GL_FALSE, offsetof(interleavedType, vertexCoords)));
+        GLCall(glVertexArrayAttribFormat(mId, texIndex, glm::vec2::length(), GL_FLOAT,
+                                         GL_FALSE, offsetof(interleavedType, texCoords)));
+        GLCall(glVertexArrayAttribFormat(mId, normalIndex, glm::vec3::length(), GL_FLOAT,
+                                         GL_FALSE, offsetof(interleavedType, normalCoords)));
+        setIndices(indices);
     }
 
     VertexArray(const interleavedBuffers &ibs)
         : VertexArray(ibs.interleavedBufs, ibs.indexBuf)
     {
+        mBounds = ibs.bounds;
+        mSphere = ibs.sphere;
+        mSubmeshes = ibs.submeshes;
     }
 
     VertexArray(const buffers &bufs)
         : VertexArray(bufs.vertices, bufs.texUVs, bufs.normals,
                       bufs.indices)
     {
+        mBounds = bufs.bounds;
+        mSphere = bufs.sphere;
+        mSubmeshes = bufs.submeshes;
     }
 
     VertexArray(const std::filesystem::path &path)
@@ -60,15 +97,13 @@ public:
     }
 
     VertexArray() = default;
+    VertexArray(const VertexArray &) = delete;
 
     virtual void bind() 
     {
         GLCall(glBindVertexArray(mId));
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                            getID(mIndexBuffer.get())));
-        GLCall(glDrawElements(GL_TRIANGLES, mIndexBuffer->getNumIndices(),
-               GL_UNSIGNED_INT, nullptr));
-        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+        GLCall(glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mNumIndices),
+                              GL_UNSIGNED_INT, getIndexOffset()));
         GLCall(glBindVertexArray(0));
     }
 
@@ -76,13 +111,79 @@ public:
     {
     }
 
-    virtual ~VertexArray() = default;
+    // Draw count instances of the mesh with one call.
+    void drawInstanced(std::uint32_t count)
+    {
+        GLCall(glBindVertexArray(mId));
+        GLCall(glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mNumIndices),
+                                       GL_UNSIGNED_INT, getIndexOffset(), count));
+        GLCall(glBindVertexArray(0));
+    }
+
+    // Bounds of the mesh in model space.
+    const AABB &getBounds() const
+    {
+        return mBounds;
+    }
+
+    const BoundingSphere &getBoundingSphere() const
+    {
+        return mSphere;
+    }
+
+    const std::vector<Submesh> &getSubmeshes() const
+    {
+        return mSubmeshes;
+    }
+
+    virtual ~VertexArray()
+    {
+        // The ranges go back to the pool once the GPU stopped drawing
+        // from them, before that they could be handed out and overwritten.
+        glres::releaseLater([vertices = mVertexRange, indices = mIndexRange]() mutable
+        {
+            auto &pool = BufferPool::get(BufferUsage::Static);
+            pool.free(vertices);
+            pool.free(indices);
+        });
+        glres::deleteLater(GLObject::VertexArray, mId);
+    }
 protected:
+    // Source attribute index, tightly packed floats, from offset in the
+    // vertex range's buffer.
+    void setAttribute(std::uint32_t index, std::size_t offset, std::size_t stride,
+                      std::int32_t numElems)
+    {
+        GLCall(glVertexArrayVertexBuffer(mId, index, mVertexRange.buffer,
+                                         static_cast<GLintptr>(offset),
+                                         static_cast<GLsizei>(stride)));
+        GLCall(glEnableVertexArrayAttrib(mId, index));
+        GLCall(glVertexArrayAttribFormat(mId, index, numElems, GL_FLOAT, GL_FALSE, 0));
+        GLCall(glVertexArrayAttribBinding(mId, index, index));
+    }
+
+    void setIndices(const std::vector<std::uint32_t> &indices)
+    {
+        mNumIndices = indices.size();
+        mIndexRange = BufferPool::get(BufferUsage::Static).allocate(
+            indices.size() * sizeof(std::uint32_t), BufferPool::MIN_ALIGNMENT,
+            indices.data());
+        GLCall(glVertexArrayElementBuffer(mId, mIndexRange.buffer));
+    }
+
+    // Draw calls take the offset of the indices in the element buffer as a
+    // pointer.
+    const void *getIndexOffset() const
+    {
+        return reinterpret_cast<const void*>(mIndexRange.offset);
+    }
 
-    std::unique_ptr<ConstantBuffer> mVertexBuffer;
-    std::unique_ptr<ConstantBuffer> mTextureBuffer;
-    std::unique_ptr<ConstantBuffer> mNormalBuffer;
-    std::unique_ptr<IndexBuffer> mIndexBuffer;
+    BufferRange mVertexRange;
+    BufferRange mIndexRange;
+    std::size_t mNumIndices = 0;
+    AABB mBounds;
+    BoundingSphere mSphere;
+    std::vector<Submesh> mSubmeshes;
 };
 
 #endif /* VERTEX_ARRAY_HPP */
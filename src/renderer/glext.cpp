@@ -0,0 +1,77 @@
+#include "glext.hpp"
+
+#include <string>
+#include <iostream>
+#include <unordered_set>
+
+#include "glutil.hpp"
+
+namespace
+{
+    std::unordered_set<std::string> extensions;
+
+    glext::PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = nullptr;
+    glext::PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC multiDrawElementsIndirectCountARB = nullptr;
+    bool pipelineStatistics = false;
+}
+
+void glext::init(GLADloadproc loader)
+{
+    extensions.clear();
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for(GLint i = 0; i < numExtensions; i++)
+        extensions.emplace(reinterpret_cast<const char*>(
+                               glGetStringi(GL_EXTENSIONS, i)));
+
+    // The ARB extension is the same feature with identical enums.
+    if(hasExtension("GL_KHR_parallel_shader_compile"))
+        maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            loader("glMaxShaderCompilerThreadsKHR"));
+    else if(hasExtension("GL_ARB_parallel_shader_compile"))
+        maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            loader("glMaxShaderCompilerThreadsARB"));
+
+    if(maxShaderCompilerThreads)
+    {
+        // Let the driver pick as many threads as it likes.
+        maxShaderCompilerThreads(0xFFFFFFFF);
+        std::cout << "Parallel shader compilation enabled.\n";
+    }
+
+    multiDrawElementsIndirectCountARB = nullptr;
+    if(hasExtension("GL_ARB_indirect_parameters"))
+        multiDrawElementsIndirectCountARB = reinterpret_cast<PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC>(
+            loader("glMultiDrawElementsIndirectCountARB"));
+
+    // Only adds query targets, there is nothing to load.
+    pipelineStatistics = hasExtension("GL_ARB_pipeline_statistics_query");
+}
+
+bool glext::hasExtension(std::string_view name)
+{
+    return extensions.find(std::string(name)) != extensions.end();
+}
+
+bool glext::hasParallelShaderCompile()
+{
+    return maxShaderCompilerThreads != nullptr;
+}
+
+bool glext::hasIndirectParameters()
+{
+    return multiDrawElementsIndirectCountARB != nullptr;
+}
+
+bool glext::hasPipelineStatistics()
+{
+    return pipelineStatistics;
+}
+
+void glext::multiDrawElementsIndirectCount(GLenum mode, GLenum type,
+                                           const void *indirect, GLintptr drawCount,
+                                           GLsizei maxDrawCount, GLsizei stride)
+{
+    GLCall(multiDrawElementsIndirectCountARB(mode, type, indirect, drawCount,
+                                             maxDrawCount, stride));
+}
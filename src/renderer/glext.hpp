@@ -0,0 +1,62 @@
+#ifndef GLEXT_HPP
+#define GLEXT_HPP
+
+#include <glad/glad.h>
+
+#include <string_view>
+
+// glad is generated for plain OpenGL 4.5 core, so the extensions we make
+// optional use of are declared and loaded here.
+
+// GL_KHR_parallel_shader_compile
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// GL_ARB_indirect_parameters
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+// GL_ARB_pipeline_statistics_query
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+namespace glext
+{
+    typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+    typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC)(
+        GLenum mode, GLenum type, const void *indirect, GLintptr drawcount,
+        GLsizei maxdrawcount, GLsizei stride);
+
+    // Query the extension list and load the entry points of the extensions
+    // that are present. Must be called after glad has been loaded.
+    void init(GLADloadproc loader);
+
+    // Whether the current context advertises extension name.
+    bool hasExtension(std::string_view name);
+
+    // Whether shaders and programs can be polled with
+    // GL_COMPLETION_STATUS_KHR instead of blocking on their status.
+    bool hasParallelShaderCompile();
+
+    // Whether multi-draws can read their draw count from the buffer bound
+    // to GL_PARAMETER_BUFFER_ARB.
+    bool hasIndirectParameters();
+
+    // Whether queries can count pipeline statistics such as
+    // GL_FRAGMENT_SHADER_INVOCATIONS_ARB.
+    bool hasPipelineStatistics();
+
+    // glMultiDrawElementsIndirectCountARB. Only call it if
+    // hasIndirectParameters().
+    void multiDrawElementsIndirectCount(GLenum mode, GLenum type,
+                                        const void *indirect, GLintptr drawCount,
+                                        GLsizei maxDrawCount, GLsizei stride);
+}
+
+#endif /* GLEXT_HPP */
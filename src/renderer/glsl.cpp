@@ -0,0 +1,249 @@
+#include "glsl.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct sourceFile
+    {
+        std::string contents;
+        std::uint64_t hash;
+    };
+
+    // Raw file contents, by normalized path.
+    std::unordered_map<std::string, std::shared_ptr<const sourceFile>> files;
+    // Preprocessed sources, by content hash of the root file and defines.
+    std::unordered_map<std::uint64_t,
+                       std::shared_ptr<const PreprocessedShader>> results;
+
+    // State of one preprocessor run.
+    struct expansion
+    {
+        PreprocessedShader result;
+        const ShaderDefines *defines;
+        // Files currently being expanded, to catch include cycles.
+        std::vector<std::string> stack;
+        // Files that contained #pragma once and were expanded already.
+        std::unordered_set<std::string> once;
+    };
+
+    std::string normalize(const fs::path &path)
+    {
+        return path.lexically_normal().generic_string();
+    }
+
+    std::shared_ptr<const sourceFile> readFile(const fs::path &path)
+    {
+        auto key = normalize(path);
+        if(auto it = files.find(key); it != files.end())
+            return it->second;
+
+        std::ifstream file(path);
+        if(!file)
+            throw std::runtime_error(fmt::format("Unable to read file {}", key));
+        std::stringstream stream;
+        stream << file.rdbuf();
+
+        auto contents = stream.str();
+        auto hash = glsl::hash(contents);
+        auto entry = std::make_shared<const sourceFile>(
+            sourceFile{std::move(contents), hash});
+        files.emplace(std::move(key), entry);
+        return entry;
+    }
+
+    // Get the name of the directive on line, or an empty view if line is not
+    // a preprocessor directive. rest is set to what follows the name.
+    std::string_view directive(std::string_view line, std::string_view &rest)
+    {
+        auto isSpace = [](char c) { return std::isspace(static_cast<unsigned char>(c)); };
+        std::size_t i = 0;
+        while(i < line.size() && isSpace(line[i]))
+            i++;
+        if(i == line.size() || line[i] != '#')
+            return {};
+        i++;
+        while(i < line.size() && isSpace(line[i]))
+            i++;
+        auto start = i;
+        while(i < line.size() && std::isalpha(static_cast<unsigned char>(line[i])))
+            i++;
+        rest = line.substr(i);
+        return line.substr(start, i - start);
+    }
+
+    std::size_t fileIndex(expansion &state, const fs::path &path)
+    {
+        auto &files = state.result.files;
+        for(std::size_t i = 0; i < files.size(); i++)
+            if(files[i] == path)
+                return i;
+        files.push_back(path);
+        return files.size() - 1;
+    }
+
+    void appendDefines(std::string &out, const ShaderDefines &defines)
+    {
+        for(const auto &[name, value] : defines)
+            out += fmt::format("#define {} {}\n", name, value);
+    }
+
+    void expand(expansion &state, const fs::path &path, bool isRoot)
+    {
+        auto key = normalize(path);
+        if(std::find(state.stack.begin(), state.stack.end(), key) != state.stack.end())
+            throw std::runtime_error(fmt::format("{} includes itself", key));
+        state.stack.push_back(key);
+
+        auto file = readFile(path);
+        auto index = fileIndex(state, fs::path(key));
+        auto &out = state.result.source;
+        std::string_view contents = file->contents;
+
+        bool sawVersion = false;
+        if(isRoot && contents.find("#version") == std::string_view::npos)
+        {
+            appendDefines(out, *state.defines);
+            out += fmt::format("#line 1 {}\n", index);
+            sawVersion = true;
+        }
+
+        std::size_t lineNo = 0;
+        while(!contents.empty())
+        {
+            lineNo++;
+            auto end = contents.find('\n');
+            auto line = contents.substr(0, end);
+            contents = (end == std::string_view::npos)
+                ? std::string_view() : contents.substr(end + 1);
+
+            std::string_view rest;
+            auto name = directive(line, rest);
+            if(name == "version")
+            {
+                if(isRoot && !sawVersion)
+                {
+                    sawVersion = true;
+                    out.append(line);
+                    out += '\n';
+                    appendDefines(out, *state.defines);
+                    out += fmt::format("#line {} {}\n", lineNo + 1, index);
+                }
+                else
+                    out += '\n';
+            }
+            else if(name == "pragma" && rest.find("once") != std::string_view::npos)
+            {
+                state.once.insert(key);
+                out += '\n';
+            }
+            else if(name == "include")
+            {
+                auto open = rest.find('"');
+                auto close = (open == std::string_view::npos)
+                    ? open : rest.find('"', open + 1);
+                if(close == std::string_view::npos)
+                    throw std::runtime_error(
+                        fmt::format("{}:{}: malformed #include", key, lineNo));
+
+                auto includePath = fs::path(key).parent_path() /
+                    fs::path(std::string(rest.substr(open + 1, close - open - 1)));
+                if(state.once.count(normalize(includePath)))
+                {
+                    out += '\n';
+                    continue;
+                }
+
+                out += fmt::format("#line 1 {}\n",
+                                   fileIndex(state, fs::path(normalize(includePath))));
+                expand(state, includePath, false);
+                out += fmt::format("#line {} {}\n", lineNo + 1, index);
+            }
+            else
+            {
+                out.append(line);
+                out += '\n';
+            }
+        }
+
+        state.stack.pop_back();
+    }
+}
+
+std::string PreprocessedShader::remapLog(const std::string &log) const
+{
+    // Drivers prefix messages with the source string number followed by the
+    // line, e.g. "0:12(3): error" (Mesa), "0(12) : error" (NVIDIA) or
+    // "ERROR: 0:12: " (AMD).
+    std::string result;
+    std::istringstream stream(log);
+    std::string line;
+    while(std::getline(stream, line))
+    {
+        std::size_t start = 0;
+        for(std::string_view prefix : {"ERROR: ", "WARNING: "})
+            if(line.compare(0, prefix.size(), prefix) == 0)
+                start = prefix.size();
+
+        std::size_t end = start;
+        while(end < line.size() && std::isdigit(static_cast<unsigned char>(line[end])))
+            end++;
+        if(end > start && end < line.size() && (line[end] == ':' || line[end] == '('))
+        {
+            auto index = std::stoul(line.substr(start, end - start));
+            if(index < files.size())
+                line.replace(start, end - start, files[index].generic_string());
+        }
+        result += line;
+        result += '\n';
+    }
+    return result;
+}
+
+std::shared_ptr<const PreprocessedShader>
+glsl::preprocess(const fs::path &path, const ShaderDefines &defines)
+{
+    auto root = readFile(path);
+    auto key = hash(normalize(path), root->hash);
+    for(const auto &[name, value] : defines)
+        key = hash(value, hash(name, key));
+
+    if(auto it = results.find(key); it != results.end())
+        return it->second;
+
+    expansion state{{}, &defines, {}, {}};
+    expand(state, path, true);
+    auto result = std::make_shared<const PreprocessedShader>(std::move(state.result));
+    results.emplace(key, result);
+    return result;
+}
+
+void glsl::clearCache()
+{
+    files.clear();
+    results.clear();
+}
+
+std::uint64_t glsl::hash(std::string_view data, std::uint64_t seed)
+{
+    constexpr std::uint64_t FNV_PRIME = 0x100000001b3ULL;
+    for(char c : data)
+    {
+        seed ^= static_cast<std::uint8_t>(c);
+        seed *= FNV_PRIME;
+    }
+    // Separate consecutive fields so ("ab", "c") and ("a", "bc") differ.
+    seed ^= 0xff;
+    seed *= FNV_PRIME;
+    return seed;
+}
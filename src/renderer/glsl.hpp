@@ -0,0 +1,47 @@
+#ifndef GLSL_HPP
+#define GLSL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+#include "Shader.hpp"
+
+// A shader source with every #include expanded and the defines injected.
+struct PreprocessedShader
+{
+    // Source handed to glShaderSource.
+    std::string source;
+    // Files that make up source. The index of a file is the source string
+    // number used for it in the #line directives, the root file is 0.
+    std::vector<std::filesystem::path> files;
+
+    // Replace the source string numbers in a compiler info log with the
+    // paths of the files they refer to.
+    std::string remapLog(const std::string &log) const;
+};
+
+// Minimal GLSL preprocessor. It handles #include "file" (relative to the
+// including file), #pragma once and define injection, everything else is
+// left to the driver so ordinary #ifndef include guards work as well.
+//
+// File contents are read once and kept in memory. Preprocessed results are
+// cached by the content hash of the root file and the defines.
+namespace glsl
+{
+    std::shared_ptr<const PreprocessedShader>
+    preprocess(const std::filesystem::path &path,
+               const ShaderDefines &defines = {});
+
+    // Forget every cached file and result.
+    void clearCache();
+
+    // 64-bit FNV-1a hash of data, continuing from seed.
+    std::uint64_t hash(std::string_view data,
+                       std::uint64_t seed = 0xcbf29ce484222325ULL);
+}
+
+#endif /* GLSL_HPP */
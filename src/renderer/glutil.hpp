@@ -9,6 +9,8 @@
 #include <exception>
 #include <stdexcept>
 
+#include "Bounds.hpp"
+
 #ifdef DEBUG
 
 inline int curLine = 0;
@@ -31,6 +33,13 @@ struct buffers
     std::vector<glm::vec2> texUVs;
     std::vector<glm::vec3> normals;
     std::vector<std::uint32_t> indices;
+    // Bounds of the whole mesh, in model space.
+    AABB bounds;
+    BoundingSphere sphere;
+    std::vector<Submesh> submeshes;
+
+    // Fill in bounds and sphere, and the bounds of every submesh.
+    void computeBounds();
 
     static buffers createFromData(const std::vector<glm::vec3> &verts,
                                   const std::vector<glm::vec2> &uvs,
@@ -49,6 +58,19 @@ struct interleavedBuffers
 {
     std::vector<interleavedType> interleavedBufs;
     std::vector<std::uint32_t> indexBuf;
+    AABB bounds;
+    BoundingSphere sphere;
+    std::vector<Submesh> submeshes;
+};
+
+// Where a mesh lives inside a GeometryHeap.
+struct MeshRange
+{
+    std::uint32_t baseVertex = 0;
+    std::uint32_t firstIndex = 0;
+    std::uint32_t indexCount = 0;
+    AABB bounds;
+    BoundingSphere sphere;
 };
 
 class OpenGLException : public std::exception
@@ -87,7 +109,8 @@ inline interleavedBuffers bufsToInterleaved(const buffers &bufs)
         overallBuffer[i] = { bufs.vertices[i], bufs.texUVs[i],
             bufs.normals[i] };
 
-    return interleavedBuffers{ overallBuffer, bufs.indices };
+    return interleavedBuffers{ overallBuffer, bufs.indices, bufs.bounds,
+        bufs.sphere, bufs.submeshes };
 }
 
 
@@ -0,0 +1,137 @@
+#include "headless.hpp"
+
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <fmt/core.h>
+
+#if defined(PROJ_HAVE_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// EGL_MESA_platform_surfaceless
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// EGL_KHR_no_config_context
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR static_cast<EGLConfig>(0)
+#endif
+
+namespace
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool hasExtension(const char *extensions, std::string_view name)
+    {
+        std::string_view list = extensions == nullptr ? "" : extensions;
+        for(std::size_t start = 0; start < list.size();)
+        {
+            auto end = list.find(' ', start);
+            if(end == std::string_view::npos)
+                end = list.size();
+            if(list.substr(start, end - start) == name)
+                return true;
+            start = end + 1;
+        }
+        return false;
+    }
+
+    [[noreturn]] void fail(const std::string &what)
+    {
+        throw std::runtime_error(fmt::format("Headless: {} (EGL error {:#x})",
+                                             what, eglGetError()));
+    }
+}
+
+void headless::init()
+{
+    // Client extensions are queried without a display.
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(!hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        throw std::runtime_error("Headless: EGL_MESA_platform_surfaceless is unavailable");
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if(getPlatformDisplay == nullptr)
+        fail("eglGetPlatformDisplayEXT is unavailable");
+
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                                 nullptr);
+    EGLint major = 0, minor = 0;
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        fail("Could not initialize the surfaceless display");
+    std::cout << "EGL " << major << '.' << minor << ", "
+              << eglQueryString(display, EGL_VENDOR) << '\n';
+
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!hasExtension(extensions, "EGL_KHR_surfaceless_context"))
+        fail("EGL_KHR_surfaceless_context is unavailable");
+    if(!eglBindAPI(EGL_OPENGL_API))
+        fail("Desktop OpenGL is unavailable");
+
+    // Nothing is drawn to an EGL surface, so the config only has to
+    // support desktop OpenGL. Without any, try a context without one.
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE,
+    };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint numConfigs = 0;
+    if(!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) ||
+       numConfigs == 0)
+    {
+        if(!hasExtension(extensions, "EGL_KHR_no_config_context"))
+            fail("No config supports OpenGL");
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if(context == EGL_NO_CONTEXT)
+        fail("Could not create an OpenGL 4.5 core context");
+    if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        fail("Could not make the context current");
+}
+
+void headless::quit()
+{
+    if(display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+}
+
+void *headless::getProcAddress(const char *name)
+{
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+#else
+
+void headless::init()
+{
+    throw std::runtime_error("Headless: this build has no EGL support");
+}
+
+void headless::quit()
+{
+}
+
+void *headless::getProcAddress(const char *)
+{
+    return nullptr;
+}
+
+#endif // PROJ_HAVE_EGL
@@ -0,0 +1,22 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+// OpenGL without a window or display, for CI and render farm machines.
+// The context is created through EGL on Mesa's surfaceless platform, so it
+// works on software rasterizers such as llvmpipe. It has no default
+// framebuffer, the renderer draws into one of its own instead.
+namespace headless
+{
+    // Create an OpenGL 4.5 core context and make it current. Throws
+    // std::runtime_error if EGL, the surfaceless platform or such a
+    // context is unavailable.
+    void init();
+
+    // Destroy the context.
+    void quit();
+
+    // Get the address of an OpenGL function, for glad.
+    void *getProcAddress(const char *name);
+}
+
+#endif /* HEADLESS_HPP */
@@ -60,7 +60,15 @@ buffers buffers::createFromData(const std::vector<glm::vec3> &verts,
     outVerts.resize(outBufferLen);
     outUVs.resize(outBufferLen);
     outNormals.resize(outBufferLen);
-    return buffers{outVerts, outUVs, outNormals, indices};
+    return buffers{outVerts, outUVs, outNormals, indices, AABB(), BoundingSphere(), {}};
+}
+
+void buffers::computeBounds()
+{
+    ::computeBounds(vertices, indices, 0, indices.size(), bounds, sphere);
+    for(auto &submesh : submeshes)
+        ::computeBounds(vertices, indices, submesh.firstIndex, submesh.indexCount,
+                        submesh.bounds, submesh.sphere);
 }
 
 static std::tuple<int, int, int> readTVN(const std::string &str)
@@ -136,9 +144,20 @@ buffers loadObjFile(const std::filesystem::path &path)
     if(!objFile)
         throw std::invalid_argument("Could not open "s + path.generic_string());
 
+    // Index into vertexIndices at which each object or group starts. Faces
+    // before the first "o" or "g" line make a group of their own.
+    std::vector<std::size_t> groupStarts = {0};
+
     std::string line;
     while(std::getline(objFile, line))
     {
+        if(line.size() > 1 && (line[0] == 'o' || line[0] == 'g') &&
+           std::isspace(static_cast<unsigned char>(line[1])))
+        {
+            groupStarts.push_back(vertexIndices.size());
+            continue;
+        }
+
         if(line == "" ||
            line[0] == '#' ||
            line[0] == 'm' ||
@@ -225,6 +244,17 @@ buffers loadObjFile(const std::filesystem::path &path)
         outNormal.push_back(tmpNormal[normalIndex - 1]);
     }
 
-    return buffers::createFromData(outVertices, outUV, outNormal);
+    // createFromData keeps one index per input vertex, so the group
+    // boundaries are also boundaries in the index buffer.
+    auto result = buffers::createFromData(outVertices, outUV, outNormal);
+    groupStarts.push_back(vertexIndices.size());
+    for(std::size_t i = 0; i + 1 < groupStarts.size(); i++)
+        if(groupStarts[i + 1] > groupStarts[i])
+            result.submeshes.push_back(Submesh{
+                    static_cast<std::uint32_t>(groupStarts[i]),
+                    static_cast<std::uint32_t>(groupStarts[i + 1] - groupStarts[i]),
+                    {}, {}});
+    result.computeBounds();
+    return result;
 }
 
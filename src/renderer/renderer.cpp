@@ -7,6 +7,12 @@ extern "C" {
 }
 
 #include "glutil.hpp"
+#include "glext.hpp"
+#include "GLResource.hpp"
+#include "GpuProfiler.hpp"
+#include "ResolutionController.hpp"
+#include "RenderTarget.hpp"
+#include "headless.hpp"
 
 #include "renderer.hpp"
 #include "Shader.hpp"
@@ -19,6 +25,10 @@ extern "C" {
 #include <string>
 #include <fmt/core.h>
 #include <chrono>
+#include <array>
+#include <memory>
+#include <cmath>
+#include <algorithm>
 
 using namespace std::string_literals;
 
@@ -102,8 +112,33 @@ namespace
 
     }
 
-    // SDL window.
+    // SDL window, null in headless mode.
     SDL_Window *window = nullptr;
+    bool headlessMode = false;
+
+    // Declared first so that it outlives the targets taken from it.
+    std::unique_ptr<RenderTargetPool> targetPool;
+    // Stands in for the default framebuffer in headless mode.
+    std::unique_ptr<RenderTarget> offscreenTarget;
+    // Size in pixels of the window's framebuffer, or of offscreenTarget.
+    int outputWidth = 0;
+    int outputHeight = 0;
+
+    // With dynamic resolution the scene is drawn into sceneTarget,
+    // renderWidth by renderHeight pixels taken from the pool for every
+    // frame, and stretched over the output by present().
+    std::unique_ptr<ResolutionController> resolution;
+    PooledTarget sceneTarget;
+    int renderWidth = 0;
+    int renderHeight = 0;
+    // GPU time of every frame from clearWindow() to present(), read back
+    // NUM_TIMED_FRAMES frames later.
+    constexpr std::size_t NUM_TIMED_FRAMES = 4;
+    std::array<QueryHandle, NUM_TIMED_FRAMES> frameTimers;
+    std::array<bool, NUM_TIMED_FRAMES> frameTimerPending = {};
+    std::size_t timedFrame = 0;
+    bool timingFrame = false;
+    double gpuFrameMs = 0.;
     // SDLGL context.
     SDL_GLContext context = {};
 
@@ -114,12 +149,96 @@ namespace
     // timing
     float deltaTime = 0.0f;	// time between current frame and last frame
     float lastFrame = 0.0f;
+
+    // The formats asked of SDL for the window.
+    RenderTargetDesc getWindowDesc(int width, int height)
+    {
+        RenderTargetDesc desc;
+        desc.width = width;
+        desc.height = height;
+        desc.colorFormats[0] = GL_RGBA8;
+        desc.depthFormat = GL_DEPTH24_STENCIL8;
+        return desc;
+    }
+
+    GLuint getOutputFramebuffer()
+    {
+        return offscreenTarget ? offscreenTarget->getFramebuffer() : 0;
+    }
+
+    void setRenderScale(float scale)
+    {
+        renderWidth = std::max(1, static_cast<int>(std::lround(outputWidth * scale)));
+        renderHeight = std::max(1, static_cast<int>(std::lround(outputHeight * scale)));
+    }
+
+    // Add the GPU time of the frame timed in slot frame, if the GPU is done
+    // with it, to the resolution controller.
+    void readFrameTimer(std::size_t frame)
+    {
+        if(!frameTimerPending[frame])
+            return;
+        frameTimerPending[frame] = false;
+
+        GLint available = GL_FALSE;
+        GLCall(glGetQueryObjectiv(frameTimers[frame].get(), GL_QUERY_RESULT_AVAILABLE,
+                                  &available));
+        if(!available)
+            return;
+        GLuint64 elapsed = 0;
+        GLCall(glGetQueryObjectui64v(frameTimers[frame].get(), GL_QUERY_RESULT, &elapsed));
+        gpuFrameMs = static_cast<double>(elapsed) / 1e6;
+        if(resolution->update(gpuFrameMs))
+            setRenderScale(resolution->getScale());
+    }
+
+    // Create the window and its context, and load OpenGL through SDL.
+    void createWindow(const std::string &title, int width, int height)
+    {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+        SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+        SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+        SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+        SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+        SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+        SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+        SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+
+        window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED, width, height,
+                                  SDL_WINDOW_OPENGL);
+        if(!window)
+            throw std::runtime_error("Could not create window: "s + SDL_GetError());
+
+        context = SDL_GL_CreateContext(window);
+        if(!context)
+            throw std::runtime_error("Could not create OpenGL context: "s + SDL_GetError());
+
+        {
+            int dubBuf = 0;
+            SDL_GL_GetAttribute(SDL_GL_DOUBLEBUFFER, &dubBuf);
+            if(dubBuf)
+                std::cout << "Doublebuffeering enabled.\n";
+            else
+                std::cerr << "Doublebuffering could not be enabled.\n";
+            // TODO check other OpenGL values.
+        }
+
+        if(!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress))
+            throw std::runtime_error(fmt::format("Could not init glad"));
+        glext::init((GLADloadproc)SDL_GL_GetProcAddress);
+    }
 }
 
-void rndr::init(const std::string &title, int width, int height)
+void rndr::init(const std::string &title, int width, int height, bool offscreen)
 {
     Texture::init();
-    if(auto ret = SDL_Init(SDL_INIT_EVERYTHING);
+    headlessMode = offscreen;
+    // Without a display only events are available, which keeps input
+    // polling working.
+    if(auto ret = SDL_Init(offscreen ? SDL_INIT_EVENTS | SDL_INIT_TIMER : SDL_INIT_EVERYTHING);
        ret != 0)
         throw std::runtime_error(
             fmt::format("Could not initialize SDL. Got return code {} and message \"{}\"",
@@ -130,48 +249,41 @@ void rndr::init(const std::string &title, int width, int height)
     lastX = scrWidth / 2.f;
     lastY = scrHeight / 2.f;
 
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-    SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
-    SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
-    SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
-    SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
-
-    window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED,
-                              SDL_WINDOWPOS_UNDEFINED, width, height,
-                              SDL_WINDOW_OPENGL);
-    if(!window)
-        throw std::runtime_error("Could not create window: "s + SDL_GetError());
-
-    context = SDL_GL_CreateContext(window);
-    if(!context)
-        throw std::runtime_error("Could not create OpenGL context: "s + SDL_GetError());
-
+    if(offscreen)
     {
-        int dubBuf = 0;
-        SDL_GL_GetAttribute(SDL_GL_DOUBLEBUFFER, &dubBuf);
-        if(dubBuf)
-            std::cout << "Doublebuffeering enabled.\n";
-        else
-            std::cerr << "Doublebuffering could not be enabled.\n";
-        // TODO check other OpenGL values.
+        headless::init();
+        if(!gladLoadGLLoader((GLADloadproc)headless::getProcAddress))
+            throw std::runtime_error(fmt::format("Could not init glad"));
+        glext::init((GLADloadproc)headless::getProcAddress);
+        std::cout << "Rendering headless at " << width << 'x' << height << " on "
+                  << glGetString(GL_RENDERER) << ".\n";
+    }
+    else
+    {
+        createWindow(title, width, height);
     }
-
-    if(!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress))
-        throw std::runtime_error(fmt::format("Could not init glad"));
-
 
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
     glDebugMessageCallback(openGLMessageCallback, nullptr);
 
-    // Use vsync.
-    if(SDL_GL_SetSwapInterval(1) < 0)
-        std::cerr << "Warning: unable to use vsync: " << SDL_GetError() << '\n';
+    if(offscreen)
+    {
+        outputWidth = width;
+        outputHeight = height;
+        offscreenTarget = std::make_unique<RenderTarget>(getWindowDesc(width, height));
+    }
+    else
+    {
+        SDL_GL_GetDrawableSize(window, &outputWidth, &outputHeight);
+        // Use vsync.
+        if(SDL_GL_SetSwapInterval(1) < 0)
+            std::cerr << "Warning: unable to use vsync: " << SDL_GetError() << '\n';
+    }
+    targetPool = std::make_unique<RenderTargetPool>();
+    setRenderScale(1.f);
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer()));
+    GLCall(glViewport(0, 0, renderWidth, renderHeight));
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_STENCIL_TEST);    
@@ -182,24 +294,166 @@ void rndr::quit()
     std::cout << "Quitting the graphics system.\n";
     if(window)
     {
+        // Objects destroyed after this are freed with the context.
+        disableDynamicResolution();
+        targetPool.reset();
+        gpuprof::quit();
+        glres::shutdown();
         SDL_GL_DeleteContext(context);
         std::cout << "Killing the window.\n";
         SDL_DestroyWindow(window);
         std::cout << "Killing SDL.\n";
         SDL_Quit();
     }
+    else if(headlessMode)
+    {
+        disableDynamicResolution();
+        targetPool.reset();
+        offscreenTarget.reset();
+        gpuprof::quit();
+        glres::shutdown();
+        headless::quit();
+        SDL_Quit();
+        headlessMode = false;
+    }
     std::cout << "Done quitting the graphics system.\n";
 }
 
 
 void rndr::clearWindow()
 {
+    glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer());
+    glViewport(0, 0, renderWidth, renderHeight);
+    // Frames not presented, like those of benchmarks, are timed together.
+    if(resolution && !timingFrame)
+    {
+        GLCall(glBeginQuery(GL_TIME_ELAPSED, frameTimers[timedFrame].get()));
+        timingFrame = true;
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 }
 
 void rndr::present()
 {
-    SDL_GL_SwapWindow(window);
+    if(resolution)
+    {
+        // Bilinear upscale, the scene covers the whole output.
+        GLCall(glBlitNamedFramebuffer(getFramebuffer(), getOutputFramebuffer(),
+                                      0, 0, renderWidth, renderHeight,
+                                      0, 0, outputWidth, outputHeight,
+                                      GL_COLOR_BUFFER_BIT, GL_LINEAR));
+        sceneTarget.reset();
+        if(timingFrame)
+        {
+            GLCall(glEndQuery(GL_TIME_ELAPSED));
+            frameTimerPending[timedFrame] = true;
+            timingFrame = false;
+            timedFrame = (timedFrame + 1) % NUM_TIMED_FRAMES;
+            // The next slot was timed NUM_TIMED_FRAMES - 1 frames ago.
+            readFrameTimer(timedFrame);
+        }
+    }
+
+    if(headlessMode)
+    {
+        // Nothing to show, but the work is submitted as a swap would.
+        GLCall(glFlush());
+    }
+    else
+    {
+        SDL_GL_SwapWindow(window);
+    }
+    targetPool->endFrame();
+    gpuprof::endFrame();
+    glres::endFrame();
+}
+
+bool rndr::isHeadless()
+{
+    return headlessMode;
+}
+
+std::uint32_t rndr::getFramebuffer()
+{
+    if(!resolution)
+        return getOutputFramebuffer();
+    // Taken on the first use of the frame, at the size picked by the last
+    // present().
+    if(!sceneTarget)
+        sceneTarget = targetPool->acquire(getWindowDesc(renderWidth, renderHeight));
+    return sceneTarget->getFramebuffer();
+}
+
+void rndr::enableDynamicResolution(float minScale, float maxScale, double budgetMs)
+{
+    disableDynamicResolution();
+    resolution = std::make_unique<ResolutionController>(minScale, maxScale, budgetMs);
+    for(auto &timer : frameTimers)
+        GLCall(glCreateQueries(GL_TIME_ELAPSED, 1, timer.put()));
+    setRenderScale(resolution->getScale());
+}
+
+void rndr::disableDynamicResolution()
+{
+    if(!resolution)
+        return;
+    if(timingFrame)
+    {
+        GLCall(glEndQuery(GL_TIME_ELAPSED));
+        timingFrame = false;
+    }
+    for(auto &timer : frameTimers)
+        timer.reset();
+    frameTimerPending = {};
+    sceneTarget.reset();
+    resolution.reset();
+    gpuFrameMs = 0.;
+    setRenderScale(1.f);
+}
+
+float rndr::getResolutionScale()
+{
+    return resolution ? resolution->getScale() : 1.f;
+}
+
+int rndr::getRenderWidth()
+{
+    return renderWidth;
+}
+
+int rndr::getRenderHeight()
+{
+    return renderHeight;
+}
+
+double rndr::getGpuFrameMs()
+{
+    return gpuFrameMs;
+}
+
+RenderTargetPool &rndr::getTargetPool()
+{
+    return *targetPool;
 }
 
 
+
+float rndr::getWindowWidth()
+{
+    return scrWidth;
+}
+
+float rndr::getWindowHeight()
+{
+    return scrHeight;
+}
+
+int rndr::getDrawableWidth()
+{
+    return outputWidth;
+}
+
+int rndr::getDrawableHeight()
+{
+    return outputHeight;
+}
@@ -2,13 +2,51 @@
 #define RENDERER_HPP
 
 #include <string>
+#include <cstdint>
+
+class RenderTargetPool;
 
 namespace rndr
 {
-    void init(const std::string &title, int width, int height);
+    // Open a window of width by height pixels with an OpenGL 4.5 core
+    // context. If offscreen is true there is no window, the context is
+    // created headless and drawn into a framebuffer of that size.
+    void init(const std::string &title, int width, int height,
+              bool offscreen = false);
     void quit();
     void present();
     void clearWindow();
+    bool isHeadless();
+    // The framebuffer standing for the window, which passes that draw to
+    // the screen bind. 0 unless headless or with dynamic resolution.
+    std::uint32_t getFramebuffer();
+
+    // Draw the scene at between minScale and maxScale of the window's
+    // resolution, as picked by a ResolutionController to keep the GPU time
+    // of a frame within budgetMs. getFramebuffer() is then an offscreen
+    // target that present() stretches over the window. Throws
+    // std::invalid_argument for a bad range or budget.
+    void enableDynamicResolution(float minScale, float maxScale, double budgetMs);
+    void disableDynamicResolution();
+    // Fraction of the window's resolution the scene is drawn at.
+    float getResolutionScale();
+    // Size in pixels of the part of getFramebuffer() the scene is drawn
+    // in, the viewport set by clearWindow().
+    int getRenderWidth();
+    int getRenderHeight();
+    // GPU time of a recent frame with dynamic resolution, 0 without.
+    double getGpuFrameMs();
+
+    // Targets for passes that need them for part of a frame, see
+    // RenderTargetPool. present() ends its frame.
+    RenderTargetPool &getTargetPool();
+    // Size of the window in the units of mouse events.
+    float getWindowWidth();
+    float getWindowHeight();
+    // Size of the window's framebuffer in pixels, larger than the window
+    // on high DPI displays. The offscreen framebuffer's size if headless.
+    int getDrawableWidth();
+    int getDrawableHeight();
 }
 
 #endif /* RENDERER_HPP */
@@ -1,6 +1,10 @@
 #include "settings.hpp"
 
 #include <unordered_map>
+#include <stdexcept>
+#include <charconv>
+
+using namespace std::literals::string_literals;
 
 namespace
 {
@@ -8,7 +12,7 @@ namespace
 
     struct setting
     {
-        std::variant<std::string, vecs, std::int64_t, double, bool> data;
+        proj::SettingValue data;
         std::string descr;
     };
 
@@ -17,11 +21,93 @@ namespace
         { "screenMode", { vecs{"Fullscreen", "Windowed", "Fullscreen Windowed" },
             "Screen Mode"}},
         { "resolution", { vecs{"1200x900", "1920x1080" }, "Resultion"}},
-        { "serverPort", { 27901, "Port number to connect to the server"}}
+        { "serverPort", { std::int64_t(27901), "Port number to connect to the server"}},
+        { "benchmark", { ""s, "Run the named benchmark instead of the game"}},
+        { "headless", { false, "Render offscreen through EGL, without a window"}},
+        { "dynamicResolution", { false, "Lower the resolution of the scene to keep to the frame budget"}},
+        { "minResolutionScale", { 0.5, "Lowest fraction of the window resolution with dynamic resolution"}},
+        { "maxResolutionScale", { 1., "Highest fraction of the window resolution with dynamic resolution"}},
+        { "frameBudgetMs", { 16.6, "GPU time per frame dynamic resolution aims for"}},
     };
+
+    // Convert str to the type currently held by value.
+    void parseInto(proj::SettingValue &value, const std::string &name,
+                   const std::string &str)
+    {
+        auto fail = [&name, &str]()
+        {
+            throw std::invalid_argument("Bad value \""s + str
+                                        + "\" for setting " + name);
+        };
+
+        std::visit([&](auto &data)
+        {
+            using T = std::decay_t<decltype(data)>;
+            if constexpr(std::is_same_v<T, std::string>)
+                data = str;
+            else if constexpr(std::is_same_v<T, vecs>)
+                data = vecs{str};
+            else if constexpr(std::is_same_v<T, bool>)
+            {
+                if(str == "true" || str == "1" || str.empty())
+                    data = true;
+                else if(str == "false" || str == "0")
+                    data = false;
+                else
+                    fail();
+            }
+            else if constexpr(std::is_same_v<T, double>)
+            {
+                try
+                {
+                    std::size_t end = 0;
+                    data = std::stod(str, &end);
+                    if(end != str.size())
+                        fail();
+                }
+                catch(const std::logic_error &)
+                {
+                    fail();
+                }
+            }
+            else
+            {
+                auto [ptr, err] = std::from_chars(str.data(),
+                                                  str.data() + str.size(), data);
+                if(err != std::errc() || ptr != str.data() + str.size())
+                    fail();
+            }
+        }, value);
+    }
 }
 
 void proj::init(const std::vector<std::string> &args)
 {
-    // TODO
+    for(const auto &arg : args)
+    {
+        if(arg.rfind("--", 0) != 0)
+            throw std::invalid_argument("Unexpected argument "s + arg);
+
+        auto equals = arg.find('=');
+        std::string name = arg.substr(2, equals - 2);
+        auto found = settings.find(name);
+        if(found == settings.end())
+        {
+            // Unknown settings are kept, as a string or a boolean flag.
+            if(equals == std::string::npos)
+                settings[name] = { true, "" };
+            else
+                settings[name] = { arg.substr(equals + 1), "" };
+            continue;
+        }
+
+        parseInto(found->second.data, name,
+                  equals == std::string::npos ? "" : arg.substr(equals + 1));
+    }
+}
+
+const proj::SettingValue *proj::getSettingValue(std::string_view name)
+{
+    auto found = settings.find(std::string(name));
+    return found == settings.end() ? nullptr : &found->second.data;
 }
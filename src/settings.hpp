@@ -6,9 +6,28 @@
 #include <cstdint>
 #include <string_view>
 #include <vector>
+#include <optional>
 
 namespace proj
 {
+    using SettingValue = std::variant<std::string, std::vector<std::string>,
+                                      std::int64_t, double, bool>;
+
+    // Parse the command line. Arguments are of the form "--name=value", or
+    // "--name" for a boolean that is set to true.
     void init(const std::vector<std::string> &args);
+
+    // Get the value of a setting, or nullptr if there is no such setting.
+    const SettingValue *getSettingValue(std::string_view name);
+
+    // Get the value of a setting if it exists and holds a T.
+    template<typename T>
+    inline std::optional<T> getSetting(std::string_view name)
+    {
+        auto value = getSettingValue(name);
+        if(value == nullptr || !std::holds_alternative<T>(*value))
+            return std::nullopt;
+        return std::get<T>(*value);
+    }
 }
 #endif /* SETTINGS_HPP */